@@ -34,6 +34,9 @@ project "Walnut"
       systemversion "latest"
       defines { "WL_PLATFORM_WINDOWS" }
 
+   filter "options:track-allocations"
+      defines { "WL_TRACK_ALLOCATIONS" }
+
    filter "configurations:Debug"
       defines { "WL_DEBUG" }
       runtime "Debug"
@@ -0,0 +1,258 @@
+#include "AllocationTracker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+	#include <malloc.h>
+#else
+	#include <signal.h>
+#endif
+
+namespace Walnut {
+
+	static constexpr uint32_t s_MaxSectionDepth = 16;
+	static constexpr uint64_t s_MaxLoggedViolations = 16;
+
+	// Plain data only, operator new can run before and after any dynamic initialization
+	static thread_local AllocationCounters s_ThreadCounters;
+	static thread_local const char* s_SectionNames[s_MaxSectionDepth];
+	static thread_local uint32_t s_SectionDepth = 0;
+	static thread_local uint32_t s_AllowDepth = 0;
+
+	static std::atomic<uint64_t> s_GlobalAllocations{ 0 };
+	static std::atomic<uint64_t> s_GlobalBytes{ 0 };
+	static std::atomic<uint64_t> s_GlobalFrees{ 0 };
+	static std::atomic<uint64_t> s_ViolationCount{ 0 };
+	static std::atomic<bool> s_AssertOnViolation{ false };
+
+#ifdef WL_TRACK_ALLOCATIONS
+	static thread_local bool s_ReportingViolation = false;
+
+	namespace Utils {
+
+		static void DebugBreak()
+		{
+#ifdef _MSC_VER
+			__debugbreak();
+#else
+			raise(SIGTRAP);
+#endif
+		}
+
+		// fprintf doesn't go through operator new, the guard covers anything that would
+		static void ReportViolation(size_t size)
+		{
+			uint64_t index = s_ViolationCount.fetch_add(1, std::memory_order_relaxed);
+			if (s_ReportingViolation)
+				return;
+
+			s_ReportingViolation = true;
+			if (index < s_MaxLoggedViolations)
+			{
+				const char* name = s_SectionNames[(s_SectionDepth < s_MaxSectionDepth ? s_SectionDepth : s_MaxSectionDepth) - 1];
+				fprintf(stderr, "[ALLOCATION] %zu bytes allocated in zero-allocation section \"%s\"%s\n", size, name ? name : "",
+					index + 1 == s_MaxLoggedViolations ? ", not logging further violations" : "");
+			}
+			if (s_AssertOnViolation.load(std::memory_order_relaxed))
+				DebugBreak();
+			s_ReportingViolation = false;
+		}
+
+	}
+
+	static void OnAllocate(size_t size)
+	{
+		s_ThreadCounters.Allocations++;
+		s_ThreadCounters.Bytes += size;
+		s_GlobalAllocations.fetch_add(1, std::memory_order_relaxed);
+		s_GlobalBytes.fetch_add(size, std::memory_order_relaxed);
+
+		if (s_SectionDepth > 0 && s_AllowDepth == 0)
+			Utils::ReportViolation(size);
+	}
+
+	static void OnFree(void* memory)
+	{
+		if (!memory)
+			return;
+
+		s_ThreadCounters.Frees++;
+		s_GlobalFrees.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void* Allocate(size_t size)
+	{
+		OnAllocate(size);
+		return malloc(size ? size : 1);
+	}
+
+	static void* AllocateAligned(size_t size, std::align_val_t alignment)
+	{
+		OnAllocate(size);
+#ifdef _MSC_VER
+		return _aligned_malloc(size ? size : 1, (size_t)alignment);
+#else
+		void* memory = nullptr;
+		size_t bytes = (size_t)alignment < sizeof(void*) ? sizeof(void*) : (size_t)alignment;
+		if (posix_memalign(&memory, bytes, size ? size : 1) != 0)
+			return nullptr;
+		return memory;
+#endif
+	}
+
+	static void Free(void* memory)
+	{
+		OnFree(memory);
+		free(memory);
+	}
+
+	static void FreeAligned(void* memory)
+	{
+		OnFree(memory);
+#ifdef _MSC_VER
+		_aligned_free(memory);
+#else
+		free(memory);
+#endif
+	}
+#endif
+
+	bool AllocationTracker::IsEnabled()
+	{
+#ifdef WL_TRACK_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void* AllocationTracker::Allocate(size_t size)
+	{
+#ifdef WL_TRACK_ALLOCATIONS
+		return Walnut::Allocate(size);
+#else
+		return malloc(size);
+#endif
+	}
+
+	void AllocationTracker::Free(void* memory)
+	{
+#ifdef WL_TRACK_ALLOCATIONS
+		Walnut::Free(memory);
+#else
+		free(memory);
+#endif
+	}
+
+	AllocationCounters AllocationTracker::GetThreadCounters()
+	{
+		return s_ThreadCounters;
+	}
+
+	AllocationCounters AllocationTracker::GetGlobalCounters()
+	{
+		AllocationCounters counters;
+		counters.Allocations = s_GlobalAllocations.load(std::memory_order_relaxed);
+		counters.Bytes = s_GlobalBytes.load(std::memory_order_relaxed);
+		counters.Frees = s_GlobalFrees.load(std::memory_order_relaxed);
+		return counters;
+	}
+
+	void AllocationTracker::BeginNoAllocationSection(const char* name)
+	{
+		if (s_SectionDepth < s_MaxSectionDepth)
+			s_SectionNames[s_SectionDepth] = name;
+		s_SectionDepth++;
+	}
+
+	void AllocationTracker::EndNoAllocationSection()
+	{
+		if (s_SectionDepth > 0)
+			s_SectionDepth--;
+	}
+
+	uint64_t AllocationTracker::GetViolationCount()
+	{
+		return s_ViolationCount.load(std::memory_order_relaxed);
+	}
+
+	void AllocationTracker::SetAssertOnViolation(bool assert)
+	{
+		s_AssertOnViolation.store(assert, std::memory_order_relaxed);
+	}
+
+	void AllocationTracker::BeginAllowAllocations()
+	{
+		s_AllowDepth++;
+	}
+
+	void AllocationTracker::EndAllowAllocations()
+	{
+		if (s_AllowDepth > 0)
+			s_AllowDepth--;
+	}
+
+}
+
+#ifdef WL_TRACK_ALLOCATIONS
+
+// Replacements of the global allocation functions, linked in with the rest of this file
+
+void* operator new(size_t size)
+{
+	void* memory = Walnut::Allocate(size);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	void* memory = Walnut::Allocate(size);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Walnut::Allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Walnut::Allocate(size); }
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* memory = Walnut::AllocateAligned(size, alignment);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	void* memory = Walnut::AllocateAligned(size, alignment);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Walnut::AllocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Walnut::AllocateAligned(size, alignment); }
+
+void operator delete(void* memory) noexcept { Walnut::Free(memory); }
+void operator delete[](void* memory) noexcept { Walnut::Free(memory); }
+void operator delete(void* memory, size_t) noexcept { Walnut::Free(memory); }
+void operator delete[](void* memory, size_t) noexcept { Walnut::Free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { Walnut::Free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { Walnut::Free(memory); }
+
+void operator delete(void* memory, std::align_val_t) noexcept { Walnut::FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { Walnut::FreeAligned(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { Walnut::FreeAligned(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { Walnut::FreeAligned(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { Walnut::FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { Walnut::FreeAligned(memory); }
+
+#endif
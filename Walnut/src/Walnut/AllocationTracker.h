@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Walnut {
+
+	struct AllocationCounters
+	{
+		uint64_t Allocations = 0;
+		uint64_t Bytes = 0; // Requested by operator new, frees don't subtract
+		uint64_t Frees = 0;
+
+		AllocationCounters operator-(const AllocationCounters& other) const
+		{
+			return { Allocations - other.Allocations, Bytes - other.Bytes, Frees - other.Frees };
+		}
+
+		AllocationCounters& operator+=(const AllocationCounters& other)
+		{
+			Allocations += other.Allocations;
+			Bytes += other.Bytes;
+			Frees += other.Frees;
+			return *this;
+		}
+	};
+
+	// Counts heap allocations made through the global operator new/delete, which Walnut replaces when built with
+	// WL_TRACK_ALLOCATIONS (premake5 --track-allocations), and through Allocate/Free, which Application installs
+	// as ImGui's allocator. Without it every counter stays zero and the sections below cost a thread-local increment.
+	// GLFW and the Vulkan driver are not covered, see VulkanAllocator.h for the latter.
+	class AllocationTracker
+	{
+	public:
+		static bool IsEnabled();
+
+		// malloc/free, counted and checked like operator new/delete. For libraries with allocator hooks.
+		static void* Allocate(size_t size);
+		static void Free(void* memory);
+
+		// Of the calling thread, cheap enough to take around every layer call
+		static AllocationCounters GetThreadCounters();
+		// Of all threads
+		static AllocationCounters GetGlobalCounters();
+
+		// Any operator new on this thread until the matching End is a violation: it is counted, the first few
+		// are logged, and with SetAssertOnViolation the debugger breaks on it. Sections nest.
+		static void BeginNoAllocationSection(const char* name);
+		static void EndNoAllocationSection();
+		static uint64_t GetViolationCount();
+		static void SetAssertOnViolation(bool assert);
+
+		// Suspends the sections of this thread, e.g. for user callbacks called from a zero-allocation section
+		static void BeginAllowAllocations();
+		static void EndAllowAllocations();
+	};
+
+	class ScopedNoAllocations
+	{
+	public:
+		ScopedNoAllocations(const char* name, bool active = true)
+			: m_Active(active)
+		{
+			if (m_Active)
+				AllocationTracker::BeginNoAllocationSection(name);
+		}
+
+		~ScopedNoAllocations()
+		{
+			if (m_Active)
+				AllocationTracker::EndNoAllocationSection();
+		}
+	private:
+		bool m_Active;
+	};
+
+	class ScopedAllowAllocations
+	{
+	public:
+		ScopedAllowAllocations() { AllocationTracker::BeginAllowAllocations(); }
+		~ScopedAllowAllocations() { AllocationTracker::EndAllowAllocations(); }
+	};
+
+}
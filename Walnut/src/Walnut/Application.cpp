@@ -1,13 +1,27 @@
 #include "Application.h"
 
+#include "DescriptorAllocator.h"
+#include "Image.h"
+#include "ImageReadback.h"
+#include "FrameCapture.h"
+#include "Metrics.h"
+#include "MPSCQueue.h"
+#include "TiledImage.h"
+#include "Input/Input.h"
+#include "Input/InputRecording.h"
+
 //
 // Adapted from Dear ImGui Vulkan example
 //
 
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_vulkan.h"
+#include "imgui_internal.h"     // ImFontAtlasBuildSetupFont
 #include <stdio.h>          // printf, fprintf
 #include <stdlib.h>         // abort
+#include <string.h>         // memcpy, memcmp, strstr
+#include <ctype.h>          // isalnum
+#include <float.h>          // FLT_MAX
 #define GLFW_INCLUDE_NONE
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -15,6 +29,11 @@
 #include <glm/glm.hpp>
 
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include <future>
+#include <thread>
 
 // Emedded font
 #include "ImGui/Roboto-Regular.embed"
@@ -33,7 +52,7 @@ extern bool g_ApplicationRunning;
 #define IMGUI_VULKAN_DEBUG_REPORT
 #endif
 
-static VkAllocationCallbacks* g_Allocator = NULL;
+static const VkAllocationCallbacks* g_Allocator = NULL;
 static VkInstance               g_Instance = VK_NULL_HANDLE;
 static VkPhysicalDevice         g_PhysicalDevice = VK_NULL_HANDLE;
 static VkDevice                 g_Device = VK_NULL_HANDLE;
@@ -43,17 +62,50 @@ static VkDebugReportCallbackEXT g_DebugReport = VK_NULL_HANDLE;
 static VkPipelineCache          g_PipelineCache = VK_NULL_HANDLE;
 static VkDescriptorPool         g_DescriptorPool = VK_NULL_HANDLE;
 
+static ImFontAtlas*             g_FontAtlas = nullptr;
+static VkFence                  g_FontUploadFence = VK_NULL_HANDLE;
+
 static ImGui_ImplVulkanH_Window g_MainWindowData;
 static int                      g_MinImageCount = 2;
 static bool                     g_SwapChainRebuild = false;
 
-// Per-frame-in-flight
-static std::vector<std::vector<VkCommandBuffer>> s_AllocatedCommandBuffers;
-static std::vector<std::vector<std::function<void()>>> s_ResourceFreeQueue;
-
-// Unlike g_MainWindowData.FrameIndex, this is not the the swapchain image index
-// and is always guaranteed to increase (eg. 0, 1, 2, 0, 1, 2)
+// Per-frame-in-flight, independent of the number of swapchain images
+struct FrameContext
+{
+	VkFence Fence = VK_NULL_HANDLE;
+	VkCommandPool CommandPool = VK_NULL_HANDLE;
+	VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+	VkSemaphore ImageAcquiredSemaphore = VK_NULL_HANDLE;
+	uint64_t FrameNumber = 0; // Last frame submitted with Fence
+
+	// Allocated by Application::GetCommandBuffer
+	std::vector<VkCommandBuffer> AllocatedCommandBuffers;
+
+	// Application::GetFrameArena, reset once Fence has signaled
+	std::unique_ptr<Walnut::FrameArena> Arena;
+};
+static std::vector<FrameContext> s_Frames;
 static uint32_t s_CurrentFrameIndex = 0;
+// Frame whose arena Application::GetFrameArena hands out. Stays put from the submit until the next BeginFrame,
+// so nothing allocates from a slot that is about to be reset.
+static uint32_t s_ArenaFrameIndex = 0;
+
+// Fence of the frame that last rendered to each swapchain image
+static std::vector<VkFence> s_ImagesInFlight;
+
+// Monotonic frame numbers: the one being recorded and the newest one known to be finished on the GPU
+static uint64_t s_CurrentFrameNumber = 1;
+static uint64_t s_CompletedFrameNumber = 0;
+
+static Walnut::DeletionQueue s_DeletionQueue;
+
+// Application::SubmitToMainThread, drained by Run
+static std::unique_ptr<Walnut::MPSCQueue<std::function<void()>>> s_MainThreadQueue;
+static std::thread::id s_MainThreadID;
+// Read by producer threads, the queue itself only exists between Init and Shutdown
+static std::atomic<bool> s_MainThreadQueueOpen = false;
+// Producers between checking s_MainThreadQueueOpen and finishing their push, Shutdown waits for them before freeing the queue
+static std::atomic<uint32_t> s_MainThreadQueueProducers = 0;
 
 static Walnut::Application* s_Instance = nullptr;
 
@@ -66,6 +118,22 @@ void check_vk_result(VkResult err)
 		abort();
 }
 
+static std::string ReadEnvironmentVariable(const char* name)
+{
+#ifdef _MSC_VER
+	char* buffer = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&buffer, &length, name) != 0 || !buffer)
+		return {};
+	std::string value = buffer;
+	free(buffer);
+	return value;
+#else
+	const char* value = getenv(name);
+	return value ? value : "";
+#endif
+}
+
 #ifdef IMGUI_VULKAN_DEBUG_REPORT
 static VKAPI_ATTR VkBool32 VKAPI_CALL debug_report(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location, int32_t messageCode, const char* pLayerPrefix, const char* pMessage, void* pUserData)
 {
@@ -149,18 +217,35 @@ static void SetupVulkan(const char** extensions, uint32_t extensions_count)
 			}
 		}
 
+		// WALNUT_GPU=<name substring> forces a device, e.g. "llvmpipe" to run on a software implementation
+		std::string gpu_override = ReadEnvironmentVariable("WALNUT_GPU");
+		if (!gpu_override.empty())
+		{
+			for (int i = 0; i < (int)gpu_count; i++)
+			{
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(gpus[i], &properties);
+				if (strstr(properties.deviceName, gpu_override.c_str()))
+				{
+					use_gpu = i;
+					break;
+				}
+			}
+		}
+
 		g_PhysicalDevice = gpus[use_gpu];
 		free(gpus);
 	}
 
-	// Select graphics queue family
+	// Select graphics queue family, Layer::OnCompute records into the same queue so it has to support compute as well
 	{
 		uint32_t count;
 		vkGetPhysicalDeviceQueueFamilyProperties(g_PhysicalDevice, &count, NULL);
 		VkQueueFamilyProperties* queues = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * count);
 		vkGetPhysicalDeviceQueueFamilyProperties(g_PhysicalDevice, &count, queues);
+		const VkQueueFlags required_flags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
 		for (uint32_t i = 0; i < count; i++)
-			if (queues[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if ((queues[i].queueFlags & required_flags) == required_flags)
 			{
 				g_QueueFamily = i;
 				break;
@@ -270,55 +355,201 @@ static void CleanupVulkanWindow()
 	ImGui_ImplVulkanH_DestroyWindow(g_Instance, g_Device, &g_MainWindowData, g_Allocator);
 }
 
-static void FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data)
+static void FinishFontUpload()
+{
+	if (!g_FontUploadFence)
+		return;
+
+	VkResult err = vkWaitForFences(g_Device, 1, &g_FontUploadFence, VK_TRUE, UINT64_MAX);
+	check_vk_result(err);
+	vkDestroyFence(g_Device, g_FontUploadFence, g_Allocator);
+	g_FontUploadFence = VK_NULL_HANDLE;
+
+	ImGui_ImplVulkan_DestroyFontUploadObjects();
+}
+
+static void CreateFrameContexts(uint32_t count, size_t arenaBlockSize)
 {
 	VkResult err;
 
-	VkSemaphore image_acquired_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].ImageAcquiredSemaphore;
-	VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
-	err = vkAcquireNextImageKHR(g_Device, wd->Swapchain, UINT64_MAX, image_acquired_semaphore, VK_NULL_HANDLE, &wd->FrameIndex);
-	if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR)
+	s_Frames.resize(count);
+	for (FrameContext& frame : s_Frames)
 	{
-		g_SwapChainRebuild = true;
-		return;
+		{
+			VkCommandPoolCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			info.queueFamilyIndex = g_QueueFamily;
+			err = vkCreateCommandPool(g_Device, &info, g_Allocator, &frame.CommandPool);
+			check_vk_result(err);
+		}
+		{
+			VkCommandBufferAllocateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			info.commandPool = frame.CommandPool;
+			info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			info.commandBufferCount = 1;
+			err = vkAllocateCommandBuffers(g_Device, &info, &frame.CommandBuffer);
+			check_vk_result(err);
+		}
+		{
+			VkFenceCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+			err = vkCreateFence(g_Device, &info, g_Allocator, &frame.Fence);
+			check_vk_result(err);
+		}
+		{
+			VkSemaphoreCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			err = vkCreateSemaphore(g_Device, &info, g_Allocator, &frame.ImageAcquiredSemaphore);
+			check_vk_result(err);
+		}
+		frame.FrameNumber = 0;
+		frame.Arena = std::make_unique<Walnut::FrameArena>(arenaBlockSize);
 	}
-	check_vk_result(err);
+	s_CurrentFrameIndex = 0;
+	s_ArenaFrameIndex = 0;
+}
 
-	s_CurrentFrameIndex = (s_CurrentFrameIndex + 1) % g_MainWindowData.ImageCount;
+static void DestroyFrameContexts()
+{
+	for (FrameContext& frame : s_Frames)
+	{
+		vkDestroySemaphore(g_Device, frame.ImageAcquiredSemaphore, g_Allocator);
+		vkDestroyFence(g_Device, frame.Fence, g_Allocator);
+		// Also frees the command buffers allocated from it
+		vkDestroyCommandPool(g_Device, frame.CommandPool, g_Allocator);
+	}
+	s_Frames.clear();
+}
 
-	ImGui_ImplVulkanH_Frame* fd = &wd->Frames[wd->FrameIndex];
+// Waits until the GPU is done with the oldest frame in flight, then recycles its resources
+static void BeginFrame()
+{
+	VkResult err;
+
+	FrameContext& frame = s_Frames[s_CurrentFrameIndex];
 	{
-		err = vkWaitForFences(g_Device, 1, &fd->Fence, VK_TRUE, UINT64_MAX);    // wait indefinitely instead of periodically checking
+		err = vkWaitForFences(g_Device, 1, &frame.Fence, VK_TRUE, UINT64_MAX);    // wait indefinitely instead of periodically checking
 		check_vk_result(err);
 
-		err = vkResetFences(g_Device, 1, &fd->Fence);
-		check_vk_result(err);
+		// The fence also covers everything submitted before that frame
+		s_CompletedFrameNumber = glm::max(s_CompletedFrameNumber, frame.FrameNumber);
 	}
+
+	frame.Arena->Reset();
+	s_ArenaFrameIndex = s_CurrentFrameIndex;
 	
 	{
-		// Free resources in queue
-		for (auto& func : s_ResourceFreeQueue[s_CurrentFrameIndex])
-			func();
-		s_ResourceFreeQueue[s_CurrentFrameIndex].clear();
+		// Free resources in queue. Anything pushed during frame N may also be used by the secondary viewports
+		// rendered after it, which are only guaranteed to be done once frame N + 1 has completed.
+		s_DeletionQueue.Flush(g_Device, s_CompletedFrameNumber);
+
+		Walnut::ImageReadback::ProcessCompleted(s_CompletedFrameNumber);
+		Walnut::FrameCapture::ProcessCompleted(s_CompletedFrameNumber);
+
+		Walnut::Image::ProcessPendingShrinks();
 	}
 	{
 		// Free command buffers allocated by Application::GetCommandBuffer
-		// These use g_MainWindowData.FrameIndex and not s_CurrentFrameIndex because they're tied to the swapchain image index
-		auto& allocatedCommandBuffers = s_AllocatedCommandBuffers[wd->FrameIndex];
-		if (allocatedCommandBuffers.size() > 0)
+		if (frame.AllocatedCommandBuffers.size() > 0)
 		{
-			vkFreeCommandBuffers(g_Device, fd->CommandPool, (uint32_t)allocatedCommandBuffers.size(), allocatedCommandBuffers.data());
-			allocatedCommandBuffers.clear();
+			vkFreeCommandBuffers(g_Device, frame.CommandPool, (uint32_t)frame.AllocatedCommandBuffers.size(), frame.AllocatedCommandBuffers.data());
+			frame.AllocatedCommandBuffers.clear();
 		}
 
-		err = vkResetCommandPool(g_Device, fd->CommandPool, 0);
+		err = vkResetCommandPool(g_Device, frame.CommandPool, 0);
+		check_vk_result(err);
+	}
+}
+
+// Layer code may allocate inside the frame's zero-allocation section, and its allocations are counted per layer
+template<typename Func>
+static void CallLayer(Walnut::AllocationCounters& allocations, Func&& func)
+{
+	Walnut::ScopedAllowAllocations allow;
+	Walnut::AllocationCounters start = Walnut::AllocationTracker::GetThreadCounters();
+	func();
+	allocations += Walnut::AllocationTracker::GetThreadCounters() - start;
+}
+
+// Returns false if nothing was submitted (swapchain out of date)
+static bool FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data, const std::vector<std::shared_ptr<Walnut::Layer>>& layers,
+	std::vector<Walnut::AllocationCounters>& layerAllocations)
+{
+	VkResult err;
+
+	// Releases the staging buffer of the font upload submitted in Init
+	FinishFontUpload();
+
+	FrameContext& frame = s_Frames[s_CurrentFrameIndex];
+
+	err = vkAcquireNextImageKHR(g_Device, wd->Swapchain, UINT64_MAX, frame.ImageAcquiredSemaphore, VK_NULL_HANDLE, &wd->FrameIndex);
+	if (err == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		g_SwapChainRebuild = true;
+		return false;
+	}
+	if (err == VK_SUBOPTIMAL_KHR)
+	{
+		// The image was acquired and the semaphore will be signaled, so still render and present it
+		g_SwapChainRebuild = true;
+	}
+	else
+	{
+		check_vk_result(err);
+	}
+
+	// With fewer swapchain images than frames in flight, the image can still be in use by an older frame
+	if (s_ImagesInFlight[wd->FrameIndex] != VK_NULL_HANDLE && s_ImagesInFlight[wd->FrameIndex] != frame.Fence)
+	{
+		err = vkWaitForFences(g_Device, 1, &s_ImagesInFlight[wd->FrameIndex], VK_TRUE, UINT64_MAX);
 		check_vk_result(err);
+	}
+	s_ImagesInFlight[wd->FrameIndex] = frame.Fence;
+
+	ImGui_ImplVulkanH_Frame* fd = &wd->Frames[wd->FrameIndex];
+	VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->FrameIndex].RenderCompleteSemaphore;
+	{
 		VkCommandBufferBeginInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-		err = vkBeginCommandBuffer(fd->CommandBuffer, &info);
+		err = vkBeginCommandBuffer(frame.CommandBuffer, &info);
 		check_vk_result(err);
 	}
+
+	// Tiles streamed in during OnUIRender, before anything that samples the atlases. The bookkeeping allocates.
+	{
+		Walnut::ScopedAllowAllocations allow;
+		Walnut::TiledImage::RecordUploads(frame.CommandBuffer, s_CurrentFrameNumber);
+	}
+
+	// Image render passes carry their own dependencies, no barrier needed between the two
+	for (size_t i = 0; i < layers.size(); i++)
+		CallLayer(layerAllocations[i], [&]() { layers[i]->OnRender(frame.CommandBuffer); });
+
+	// Storage images stay in GENERAL, so no layout transition orders this frame's compute writes after the previous
+	// frame's UI pass sampling them. An execution dependency is enough for write-after-read.
+	vkCmdPipelineBarrier(frame.CommandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, NULL, 0, NULL, 0, NULL);
+
+	for (size_t i = 0; i < layers.size(); i++)
+		CallLayer(layerAllocations[i], [&]() { layers[i]->OnCompute(frame.CommandBuffer); });
+
+	// Make compute writes visible to the UI pass (and to copies recorded after it)
+	{
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(frame.CommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, NULL, 0, NULL);
+	}
+
+	// After compute so readbacks see this frame's results
+	Walnut::ImageReadback::RecordPendingCopies(frame.CommandBuffer, s_CurrentFrameNumber);
+
 	{
 		VkRenderPassBeginInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -328,38 +559,47 @@ static void FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data)
 		info.renderArea.extent.height = wd->Height;
 		info.clearValueCount = 1;
 		info.pClearValues = &wd->ClearValue;
-		vkCmdBeginRenderPass(fd->CommandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(frame.CommandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
 	}
 
 	// Record dear imgui primitives into command buffer
-	ImGui_ImplVulkan_RenderDrawData(draw_data, fd->CommandBuffer);
+	ImGui_ImplVulkan_RenderDrawData(draw_data, frame.CommandBuffer);
+
+	vkCmdEndRenderPass(frame.CommandBuffer);
+
+	// Renders the UI a second time into a copyable image while a capture is running
+	Walnut::FrameCapture::Record(frame.CommandBuffer, draw_data, wd->ClearValue, (uint32_t)wd->Width, (uint32_t)wd->Height, s_CurrentFrameNumber);
 
 	// Submit command buffer
-	vkCmdEndRenderPass(fd->CommandBuffer);
 	{
 		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		VkSubmitInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		info.waitSemaphoreCount = 1;
-		info.pWaitSemaphores = &image_acquired_semaphore;
+		info.pWaitSemaphores = &frame.ImageAcquiredSemaphore;
 		info.pWaitDstStageMask = &wait_stage;
 		info.commandBufferCount = 1;
-		info.pCommandBuffers = &fd->CommandBuffer;
+		info.pCommandBuffers = &frame.CommandBuffer;
 		info.signalSemaphoreCount = 1;
 		info.pSignalSemaphores = &render_complete_semaphore;
 
-		err = vkEndCommandBuffer(fd->CommandBuffer);
+		err = vkEndCommandBuffer(frame.CommandBuffer);
 		check_vk_result(err);
-		err = vkQueueSubmit(g_Queue, 1, &info, fd->Fence);
+		err = vkResetFences(g_Device, 1, &frame.Fence);
 		check_vk_result(err);
+		err = vkQueueSubmit(g_Queue, 1, &info, frame.Fence);
+		check_vk_result(err);
+
+		frame.FrameNumber = s_CurrentFrameNumber++;
+		s_DeletionQueue.SetCurrentFrame(s_CurrentFrameNumber);
+		s_CurrentFrameIndex = (s_CurrentFrameIndex + 1) % (uint32_t)s_Frames.size();
 	}
+	return true;
 }
 
 static void FramePresent(ImGui_ImplVulkanH_Window* wd)
 {
-	if (g_SwapChainRebuild)
-		return;
-	VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
+	VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->FrameIndex].RenderCompleteSemaphore;
 	VkPresentInfoKHR info = {};
 	info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	info.waitSemaphoreCount = 1;
@@ -374,7 +614,310 @@ static void FramePresent(ImGui_ImplVulkanH_Window* wd)
 		return;
 	}
 	check_vk_result(err);
-	wd->SemaphoreIndex = (wd->SemaphoreIndex + 1) % wd->ImageCount; // Now we can use the next set of semaphores
+}
+
+static std::filesystem::path GetCacheDirectory()
+{
+#ifdef WL_PLATFORM_WINDOWS
+	std::filesystem::path base = ReadEnvironmentVariable("LOCALAPPDATA");
+#else
+	std::filesystem::path base = ReadEnvironmentVariable("XDG_CACHE_HOME");
+	if (base.empty() && !ReadEnvironmentVariable("HOME").empty())
+		base = std::filesystem::path(ReadEnvironmentVariable("HOME")) / ".cache";
+#endif
+	if (base.empty())
+	{
+		std::error_code ec;
+		base = std::filesystem::temp_directory_path(ec);
+	}
+	return base / "Walnut";
+}
+
+static std::filesystem::path GetPipelineCachePath(const std::string& applicationName)
+{
+	std::string fileName = applicationName;
+	for (char& c : fileName)
+	{
+		if (!isalnum((unsigned char)c))
+			c = '_';
+	}
+	return GetCacheDirectory() / (fileName + ".pipelinecache");
+}
+
+// Prepended to the driver's blob so stale caches (other GPU, driver update, format change) are rejected
+struct PipelineCacheHeader
+{
+	uint32_t Magic = 0x43504C57; // "WLPC"
+	uint32_t Version = 1;
+	uint32_t VendorID = 0;
+	uint32_t DeviceID = 0;
+	uint32_t DriverVersion = 0;
+	uint8_t PipelineCacheUUID[VK_UUID_SIZE] = {};
+	uint64_t DataSize = 0;
+};
+
+static PipelineCacheHeader GetPipelineCacheHeader()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(g_PhysicalDevice, &properties);
+
+	PipelineCacheHeader header;
+	header.VendorID = properties.vendorID;
+	header.DeviceID = properties.deviceID;
+	header.DriverVersion = properties.driverVersion;
+	memcpy(header.PipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
+
+// Anything past this is a corrupt cache, not something to size allocations from
+static constexpr uint64_t s_MaxPipelineCacheSize = 256ull * 1024 * 1024;
+
+// The blob must fit the rest of the file, so a corrupt header can't request a huge allocation
+static bool IsPipelineCacheSizeValid(std::ifstream& stream, uint64_t dataSize)
+{
+	if (dataSize > s_MaxPipelineCacheSize)
+		return false;
+
+	std::streampos position = stream.tellg();
+	stream.seekg(0, std::ios::end);
+	std::streampos end = stream.tellg();
+	stream.seekg(position);
+	return stream && position >= 0 && end >= position && (uint64_t)(end - position) >= dataSize;
+}
+
+static void CreatePipelineCache(const std::filesystem::path& path)
+{
+	std::vector<char> data;
+
+	std::ifstream stream(path, std::ios::binary);
+	if (stream)
+	{
+		PipelineCacheHeader expected = GetPipelineCacheHeader();
+		PipelineCacheHeader header;
+		stream.read((char*)&header, sizeof(header));
+
+		if (stream && header.Magic == expected.Magic && header.Version == expected.Version
+			&& header.VendorID == expected.VendorID && header.DeviceID == expected.DeviceID
+			&& header.DriverVersion == expected.DriverVersion
+			&& memcmp(header.PipelineCacheUUID, expected.PipelineCacheUUID, VK_UUID_SIZE) == 0
+			&& IsPipelineCacheSizeValid(stream, header.DataSize))
+		{
+			data.resize(header.DataSize);
+			stream.read(data.data(), data.size());
+			if (!stream)
+				data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	info.initialDataSize = data.size();
+	info.pInitialData = data.empty() ? nullptr : data.data();
+	VkResult err = vkCreatePipelineCache(g_Device, &info, g_Allocator, &g_PipelineCache);
+	if (err != VK_SUCCESS && !data.empty())
+	{
+		// Driver rejected the blob, start from an empty cache
+		info.initialDataSize = 0;
+		info.pInitialData = nullptr;
+		err = vkCreatePipelineCache(g_Device, &info, g_Allocator, &g_PipelineCache);
+	}
+	check_vk_result(err);
+}
+
+static void SavePipelineCache(const std::filesystem::path& path)
+{
+	size_t size = 0;
+	VkResult err = vkGetPipelineCacheData(g_Device, g_PipelineCache, &size, nullptr);
+	if (err != VK_SUCCESS || size == 0)
+		return;
+
+	std::vector<char> data(size);
+	err = vkGetPipelineCacheData(g_Device, g_PipelineCache, &size, data.data());
+	if (err != VK_SUCCESS)
+		return;
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	// Write to a temporary file first so a crash mid-write never leaves a truncated cache behind
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+		if (!stream)
+			return;
+
+		PipelineCacheHeader header = GetPipelineCacheHeader();
+		header.DataSize = size;
+		stream.write((const char*)&header, sizeof(header));
+		stream.write(data.data(), size);
+		if (!stream)
+			return;
+	}
+	std::filesystem::rename(tempPath, path, ec);
+}
+
+// The rasterized font atlas is cached on disk; the key covers everything that affects the output
+struct FontAtlasCacheHeader
+{
+	uint32_t Magic = 0x41464C57; // "WLFA"
+	uint32_t Version = 2;
+	uint32_t ImGuiVersion = IMGUI_VERSION_NUM;
+	uint32_t GlyphSize = sizeof(ImFontGlyph);
+	uint64_t FontDataHash = 0;
+	float FontSize = 0.0f;
+	int32_t TexWidth = 0, TexHeight = 0;
+	float Ascent = 0.0f, Descent = 0.0f;
+	ImVec2 TexUvScale, TexUvWhitePixel;
+	ImVec4 TexUvLines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+	// Where the software mouse cursors (io.MouseDrawCursor) were packed, width 0 if they weren't
+	uint16_t MouseCursorsX = 0, MouseCursorsY = 0, MouseCursorsWidth = 0, MouseCursorsHeight = 0;
+	uint32_t GlyphCount = 0;
+};
+
+// Anything past these is a corrupt cache, not something to size allocations from
+static constexpr int32_t s_MaxFontAtlasSize = 16384;
+static constexpr uint32_t s_MaxFontAtlasGlyphs = IM_UNICODE_CODEPOINT_MAX + 1;
+
+static uint64_t HashFontData(const void* data, size_t size)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= ((const uint8_t*)data)[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool LoadFontAtlasCache(ImFontAtlas* atlas, ImFont* font, const std::filesystem::path& path, uint64_t fontDataHash)
+{
+#if IMGUI_VERSION_NUM >= 18900
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream)
+		return false;
+
+	FontAtlasCacheHeader expected;
+	FontAtlasCacheHeader header;
+	stream.read((char*)&header, sizeof(header));
+	if (!stream || header.Magic != expected.Magic || header.Version != expected.Version
+		|| header.ImGuiVersion != expected.ImGuiVersion || header.GlyphSize != expected.GlyphSize
+		|| header.FontDataHash != fontDataHash || header.FontSize != atlas->ConfigData[0].SizePixels)
+		return false;
+
+	if (header.GlyphCount > s_MaxFontAtlasGlyphs || header.TexWidth <= 0 || header.TexHeight <= 0
+		|| header.TexWidth > s_MaxFontAtlasSize || header.TexHeight > s_MaxFontAtlasSize
+		|| header.MouseCursorsX + header.MouseCursorsWidth > header.TexWidth
+		|| header.MouseCursorsY + header.MouseCursorsHeight > header.TexHeight)
+		return false;
+
+	bool mouseCursors = header.MouseCursorsWidth > 0 && header.MouseCursorsHeight > 0;
+	if (!mouseCursors && !(atlas->Flags & ImFontAtlasFlags_NoMouseCursors))
+		return false;
+
+	std::vector<ImFontGlyph> glyphs(header.GlyphCount);
+	stream.read((char*)glyphs.data(), glyphs.size() * sizeof(ImFontGlyph));
+	std::vector<unsigned char> pixels((size_t)header.TexWidth * header.TexHeight);
+	stream.read((char*)pixels.data(), pixels.size());
+	if (!stream)
+		return false;
+
+	// Reproduce the state ImFontAtlas::Build() would leave behind, without rasterizing
+	if (mouseCursors)
+	{
+		atlas->PackIdMouseCursors = atlas->AddCustomRectRegular(header.MouseCursorsWidth, header.MouseCursorsHeight);
+		ImFontAtlasCustomRect* rect = atlas->GetCustomRectByIndex(atlas->PackIdMouseCursors);
+		rect->X = header.MouseCursorsX;
+		rect->Y = header.MouseCursorsY;
+	}
+	ImFontAtlasBuildSetupFont(atlas, font, &atlas->ConfigData[0], header.Ascent, header.Descent);
+	for (const ImFontGlyph& glyph : glyphs)
+		font->AddGlyph(NULL, (ImWchar)glyph.Codepoint, glyph.X0, glyph.Y0, glyph.X1, glyph.Y1, glyph.U0, glyph.V0, glyph.U1, glyph.V1, glyph.AdvanceX);
+	font->BuildLookupTable();
+
+	atlas->TexWidth = header.TexWidth;
+	atlas->TexHeight = header.TexHeight;
+	atlas->TexUvScale = header.TexUvScale;
+	atlas->TexUvWhitePixel = header.TexUvWhitePixel;
+	memcpy(atlas->TexUvLines, header.TexUvLines, sizeof(header.TexUvLines));
+	atlas->TexPixelsAlpha8 = (unsigned char*)IM_ALLOC(pixels.size());
+	memcpy(atlas->TexPixelsAlpha8, pixels.data(), pixels.size());
+	atlas->TexReady = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+static void SaveFontAtlasCache(ImFontAtlas* atlas, ImFont* font, const std::filesystem::path& path, uint64_t fontDataHash)
+{
+	if (!atlas->TexPixelsAlpha8)
+		return;
+
+	FontAtlasCacheHeader header;
+	header.FontDataHash = fontDataHash;
+	header.FontSize = atlas->ConfigData[0].SizePixels;
+	header.TexWidth = atlas->TexWidth;
+	header.TexHeight = atlas->TexHeight;
+	header.Ascent = font->Ascent;
+	header.Descent = font->Descent;
+	header.TexUvScale = atlas->TexUvScale;
+	header.TexUvWhitePixel = atlas->TexUvWhitePixel;
+	memcpy(header.TexUvLines, atlas->TexUvLines, sizeof(header.TexUvLines));
+	if (atlas->PackIdMouseCursors >= 0)
+	{
+		const ImFontAtlasCustomRect* rect = atlas->GetCustomRectByIndex(atlas->PackIdMouseCursors);
+		header.MouseCursorsX = rect->X;
+		header.MouseCursorsY = rect->Y;
+		header.MouseCursorsWidth = rect->Width;
+		header.MouseCursorsHeight = rect->Height;
+	}
+	header.GlyphCount = (uint32_t)font->Glyphs.Size;
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+		if (!stream)
+			return;
+
+		stream.write((const char*)&header, sizeof(header));
+		stream.write((const char*)font->Glyphs.Data, font->Glyphs.Size * sizeof(ImFontGlyph));
+		stream.write((const char*)atlas->TexPixelsAlpha8, (size_t)atlas->TexWidth * atlas->TexHeight);
+		if (!stream)
+			return;
+	}
+	std::filesystem::rename(tempPath, path, ec);
+}
+
+// Runs on a worker thread while the window, device and swapchain are created.
+// No ImGui context exists yet, so nothing here may touch GImGui.
+static ImFontAtlas* BuildFontAtlas()
+{
+	ImFontAtlas* atlas = IM_NEW(ImFontAtlas)();
+
+	ImFontConfig fontConfig;
+	fontConfig.FontDataOwnedByAtlas = false;
+	ImFont* robotoFont = atlas->AddFontFromMemoryTTF((void*)g_RobotoRegular, sizeof(g_RobotoRegular), 20.0f, &fontConfig);
+
+	uint64_t fontDataHash = HashFontData(g_RobotoRegular, sizeof(g_RobotoRegular));
+	std::filesystem::path cachePath = GetCacheDirectory() / "Roboto-Regular-20.fontatlas";
+	if (!LoadFontAtlasCache(atlas, robotoFont, cachePath, fontDataHash))
+	{
+		atlas->Build();
+		SaveFontAtlasCache(atlas, robotoFont, cachePath, fontDataHash);
+	}
+
+	// Also do the RGBA conversion here instead of inside ImGui_ImplVulkan_CreateFontsTexture
+	unsigned char* pixels;
+	int width, height;
+	atlas->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+	return atlas;
 }
 
 static void glfw_error_callback(int error, const char* description)
@@ -385,7 +928,7 @@ static void glfw_error_callback(int error, const char* description)
 namespace Walnut {
 
 	Application::Application(const ApplicationSpecification& specification)
-		: m_Specification(specification)
+		: m_Specification(specification), m_FrameStatistics(specification.FrameStatistics)
 	{
 		s_Instance = this;
 
@@ -406,6 +949,27 @@ namespace Walnut {
 
 	void Application::Init()
 	{
+		m_StartupTimings.clear();
+		Timer startupTimer;
+		Timer phaseTimer;
+		auto endPhase = [&](const char* name)
+		{
+			m_StartupTimings.push_back({ name, phaseTimer.ElapsedMillis() });
+			phaseTimer.Reset();
+		};
+
+		s_MainThreadID = std::this_thread::get_id();
+		s_MainThreadQueue = std::make_unique<MPSCQueue<std::function<void()>>>(m_Specification.MainThreadQueueCapacity);
+		s_MainThreadQueueOpen.store(true);
+		AsyncFileReader::Initialize(m_Specification.FileReader);
+
+		// Before anything ImGui allocates, including the font atlas, so zero-allocation sections see ImGui too
+		ImGui::SetAllocatorFunctions([](size_t size, void*) { return AllocationTracker::Allocate(size); },
+			[](void* memory, void*) { AllocationTracker::Free(memory); });
+
+		// Rasterize (or load) the font atlas while the window, device and swapchain are created
+		std::future<ImFontAtlas*> fontAtlasFuture = std::async(std::launch::async, BuildFontAtlas);
+
 		// Setup GLFW window
 		glfwSetErrorCallback(glfw_error_callback);
 		if (!glfwInit())
@@ -415,7 +979,9 @@ namespace Walnut {
 		}
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_VISIBLE, m_Specification.Hidden ? GLFW_FALSE : GLFW_TRUE);
 		m_WindowHandle = glfwCreateWindow(m_Specification.Width, m_Specification.Height, m_Specification.Name.c_str(), NULL, NULL);
+		endPhase("GLFW window");
 
 		// Setup Vulkan
 		if (!glfwVulkanSupported())
@@ -425,7 +991,21 @@ namespace Walnut {
 		}
 		uint32_t extensions_count = 0;
 		const char** extensions = glfwGetRequiredInstanceExtensions(&extensions_count);
+
+		std::string hostAllocator = ReadEnvironmentVariable("WALNUT_VK_HOST_ALLOCATOR");
+		if (hostAllocator == "tracking")
+			m_Specification.HostAllocator = VulkanHostAllocator::Tracking;
+		else if (hostAllocator == "pooled")
+			m_Specification.HostAllocator = VulkanHostAllocator::Pooled;
+		VulkanAllocator::Init(m_Specification.HostAllocator);
+		g_Allocator = VulkanAllocator::GetCallbacks();
+
 		SetupVulkan(extensions, extensions_count);
+		DescriptorAllocator::Init(g_Device);
+		endPhase("Vulkan instance/device");
+
+		CreatePipelineCache(GetPipelineCachePath(m_Specification.Name));
+		endPhase("Pipeline cache");
 
 		// Create Window Surface
 		VkSurfaceKHR surface;
@@ -438,12 +1018,18 @@ namespace Walnut {
 		ImGui_ImplVulkanH_Window* wd = &g_MainWindowData;
 		SetupVulkanWindow(wd, surface, w, h);
 
-		s_AllocatedCommandBuffers.resize(wd->ImageCount);
-		s_ResourceFreeQueue.resize(wd->ImageCount);
+		CreateFrameContexts(glm::max(m_Specification.FramesInFlight, 1u), m_Specification.FrameArenaBlockSize);
+		s_ImagesInFlight.assign(wd->ImageCount, VK_NULL_HANDLE);
+		s_CompletedFrameNumber = s_CurrentFrameNumber - 1;
+		s_DeletionQueue.SetCurrentFrame(s_CurrentFrameNumber);
+		endPhase("Swapchain");
+
+		g_FontAtlas = fontAtlasFuture.get();
+		endPhase("Font atlas (wait)");
 
 		// Setup Dear ImGui context
 		IMGUI_CHECKVERSION();
-		ImGui::CreateContext();
+		ImGui::CreateContext(g_FontAtlas);
 		ImGuiIO& io = ImGui::GetIO(); (void)io;
 		io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
 		//io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
@@ -465,7 +1051,34 @@ namespace Walnut {
 		}
 
 		// Setup Platform/Renderer backends
+		// Input callbacks first, the ImGui backend chains to them
+		Input::Init(m_WindowHandle);
 		ImGui_ImplGlfw_InitForVulkan(m_WindowHandle, true);
+
+		// After the ImGui backend, replay disconnects its callbacks from the window and calls them directly
+		if (m_Specification.InputRecordPath.empty())
+			m_Specification.InputRecordPath = ReadEnvironmentVariable("WALNUT_INPUT_RECORD");
+		if (m_Specification.InputReplayPath.empty())
+			m_Specification.InputReplayPath = ReadEnvironmentVariable("WALNUT_INPUT_REPLAY");
+		if (!m_Specification.InputReplayPath.empty() && InputRecording::StartReplay(m_Specification.InputReplayPath, m_WindowHandle))
+			m_TimeStep = m_Specification.ReplayTimeStep;
+		else if (!m_Specification.InputRecordPath.empty())
+			InputRecording::StartRecording(m_Specification.InputRecordPath, m_WindowHandle);
+
+		if (m_Specification.MetricsSocketPath.empty())
+			m_Specification.MetricsSocketPath = ReadEnvironmentVariable("WALNUT_METRICS_SOCKET");
+		if (!m_Specification.MetricsSocketPath.empty())
+			Metrics::StartServer(m_Specification.MetricsSocketPath, m_Specification.Name);
+
+		if (m_Specification.CheckFrameAllocations)
+		{
+			if (!AllocationTracker::IsEnabled())
+				std::cerr << "[ALLOCATION] CheckFrameAllocations needs a build with WL_TRACK_ALLOCATIONS\n";
+#ifdef WL_DEBUG
+			AllocationTracker::SetAssertOnViolation(true);
+#endif
+		}
+
 		ImGui_ImplVulkan_InitInfo init_info = {};
 		init_info.Instance = g_Instance;
 		init_info.PhysicalDevice = g_PhysicalDevice;
@@ -476,17 +1089,17 @@ namespace Walnut {
 		init_info.DescriptorPool = g_DescriptorPool;
 		init_info.Subpass = 0;
 		init_info.MinImageCount = g_MinImageCount;
-		init_info.ImageCount = wd->ImageCount;
+		// ImGui cycles its vertex/index buffers over ImageCount, so it must cover every frame in flight,
+		// twice if FrameCapture may render the main viewport a second time per frame
+		init_info.ImageCount = glm::max(wd->ImageCount, (uint32_t)s_Frames.size()) * (m_Specification.AllowFrameCapture ? 2 : 1);
 		init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 		init_info.Allocator = g_Allocator;
 		init_info.CheckVkResultFn = check_vk_result;
 		ImGui_ImplVulkan_Init(&init_info, wd->RenderPass);
 
-		// Load default font
-		ImFontConfig fontConfig;
-		fontConfig.FontDataOwnedByAtlas = false;
-		ImFont* robotoFont = io.Fonts->AddFontFromMemoryTTF((void*)g_RobotoRegular, sizeof(g_RobotoRegular), 20.0f, &fontConfig);
-		io.FontDefault = robotoFont;
+		// Default font, built by BuildFontAtlas
+		io.FontDefault = io.Fonts->Fonts[0];
+		endPhase("ImGui context/backends");
 
 		// Upload Fonts
 		{
@@ -510,17 +1123,31 @@ namespace Walnut {
 			end_info.pCommandBuffers = &command_buffer;
 			err = vkEndCommandBuffer(command_buffer);
 			check_vk_result(err);
-			err = vkQueueSubmit(g_Queue, 1, &end_info, VK_NULL_HANDLE);
-			check_vk_result(err);
 
-			err = vkDeviceWaitIdle(g_Device);
+			// Don't wait for the upload here, FrameRender does before the command pool is reused
+			VkFenceCreateInfo fence_info = {};
+			fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			err = vkCreateFence(g_Device, &fence_info, g_Allocator, &g_FontUploadFence);
+			check_vk_result(err);
+			err = vkQueueSubmit(g_Queue, 1, &end_info, g_FontUploadFence);
 			check_vk_result(err);
-			ImGui_ImplVulkan_DestroyFontUploadObjects();
 		}
+		endPhase("Font upload (submit)");
+
+		m_StartupTimings.push_back({ "Total", startupTimer.ElapsedMillis() });
+		m_StartupTimer.Reset();
+
+#ifndef WL_DIST
+		for (const StartupTiming& timing : m_StartupTimings)
+			std::cout << "[STARTUP] " << timing.Name << " - " << timing.Milliseconds << "ms\n";
+#endif
 	}
 
 	void Application::Shutdown()
 	{
+		// Functions posted for the layers still see them attached
+		ExecuteMainThreadTasks(UINT64_MAX);
+
 		for (auto& layer : m_LayerStack)
 			layer->OnDetach();
 
@@ -530,19 +1157,46 @@ namespace Walnut {
 		VkResult err = vkDeviceWaitIdle(g_Device);
 		check_vk_result(err);
 
+		// Nothing drains the queue from here on. Closing it first lets callbacks of the reads still in flight drop
+		// their functions instead of blocking on a full queue, which would deadlock the join in AsyncFileReader::Shutdown.
+		s_MainThreadQueueOpen.store(false);
+		AsyncFileReader::Shutdown();
+
+		// A producer that saw the queue open may still be pushing
+		while (s_MainThreadQueueProducers.load() != 0)
+			std::this_thread::yield();
+
+		// Posted while the layers were detached, dropped. Releases what they captured before the queue is flushed.
+		s_MainThreadQueue.reset();
+
+		// Releases the images of unrecorded readbacks, so before the queue is flushed
+		ImageReadback::Shutdown();
+		FrameCapture::Stop();
+
+		InputRecording::StopRecording();
+		InputRecording::StopReplay();
+		Metrics::StopServer();
+
 		// Free resources in queue
-		for (auto& queue : s_ResourceFreeQueue)
-		{
-			for (auto& func : queue)
-				func();
-		}
-		s_ResourceFreeQueue.clear();
+		s_DeletionQueue.FlushAll(g_Device);
+
+		DescriptorAllocator::Shutdown();
+		DestroyFrameContexts();
+
+		FinishFontUpload();
 
 		ImGui_ImplVulkan_Shutdown();
 		ImGui_ImplGlfw_Shutdown();
 		ImGui::DestroyContext();
+		IM_DELETE(g_FontAtlas);
+		g_FontAtlas = nullptr;
 
 		CleanupVulkanWindow();
+
+		SavePipelineCache(GetPipelineCachePath(m_Specification.Name));
+		vkDestroyPipelineCache(g_Device, g_PipelineCache, g_Allocator);
+		g_PipelineCache = VK_NULL_HANDLE;
+
 		CleanupVulkan();
 
 		glfwDestroyWindow(m_WindowHandle);
@@ -554,14 +1208,29 @@ namespace Walnut {
 	void Application::Run()
 	{
 		m_Running = true;
+		m_LastFrameTimeNanos = Clock::GetNanoseconds();
 
 		ImGui_ImplVulkanH_Window* wd = &g_MainWindowData;
 		ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 		ImGuiIO& io = ImGui::GetIO();
 
+		MetricCounter& framesMetric = Metrics::GetCounter("walnut_frames_total", "Frames rendered by the main loop");
+		MetricHistogram& frameTimeMetric = Metrics::GetHistogram("walnut_frame_time_seconds", "Wall time between the ends of consecutive frames",
+			{ 0.004, 0.007, 0.0105, 0.017, 0.025, 0.034, 0.05, 0.1, 0.25 });
+		MetricHistogram& cpuTimeMetric = Metrics::GetHistogram("walnut_frame_cpu_seconds", "Time from the start of a frame to its submission",
+			{ 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066 });
+
+		// Frames in which the framework still grows its buffers before the zero-allocation check starts
+		constexpr uint64_t allocationWarmupFrames = 10;
+		uint64_t frameCount = 0;
+
 		// Main loop
 		while (!glfwWindowShouldClose(m_WindowHandle) && m_Running)
 		{
+			AllocationCounters frameAllocationsStart = AllocationTracker::GetThreadCounters();
+			for (AllocationCounters& allocations : m_LayerAllocations)
+				allocations = {};
+
 			// Poll and handle events (inputs, window resize, etc.)
 			// You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants to use your inputs.
 			// - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
@@ -569,12 +1238,36 @@ namespace Walnut {
 			// Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
 			glfwPollEvents();
 
-			for (auto& layer : m_LayerStack)
-				layer->OnUpdate(m_TimeStep);
+			Timer frameTimer;
+			if (InputRecording::IsReplaying() && !InputRecording::ReplayNextFrame())
+			{
+				std::string statisticsPath = m_Specification.ReplayStatisticsPath;
+				if (statisticsPath.empty())
+					statisticsPath = m_Specification.InputReplayPath + ".stats.json";
+				InputRecording::WriteReplayStatistics(statisticsPath, m_Specification.ReplayTimeStep);
+				InputRecording::StopReplay();
+				Close();
+				continue;
+			}
+
+			ScopedNoAllocations frameSection("Application::Run", m_Specification.CheckFrameAllocations && frameCount >= allocationWarmupFrames);
+			frameCount++;
+
+			Input::Update();
+
+			BeginFrame();
+
+			ExecuteMainThreadTasks((uint64_t)(m_Specification.MainThreadTaskBudget * 1e6f));
+
+			for (size_t i = 0; i < m_LayerStack.size(); i++)
+				CallLayer(m_LayerAllocations[i], [&]() { m_LayerStack[i]->OnUpdate(m_TimeStep); });
 
 			// Resize swap chain?
 			if (g_SwapChainRebuild)
 			{
+				// Rare, and the new swapchain may have more images to track
+				ScopedAllowAllocations allow;
+
 				int width, height;
 				glfwGetFramebufferSize(m_WindowHandle, &width, &height);
 				if (width > 0 && height > 0)
@@ -583,9 +1276,9 @@ namespace Walnut {
 					ImGui_ImplVulkanH_CreateOrResizeWindow(g_Instance, g_PhysicalDevice, g_Device, &g_MainWindowData, g_QueueFamily, g_Allocator, width, height, g_MinImageCount);
 					g_MainWindowData.FrameIndex = 0;
 
-					// Clear allocated command buffers from here since entire pool is destroyed
-					s_AllocatedCommandBuffers.clear();
-					s_AllocatedCommandBuffers.resize(g_MainWindowData.ImageCount);
+					// CreateOrResizeWindow waited for the device to go idle
+					s_CompletedFrameNumber = s_CurrentFrameNumber - 1;
+					s_ImagesInFlight.assign(g_MainWindowData.ImageCount, VK_NULL_HANDLE);
 
 					g_SwapChainRebuild = false;
 				}
@@ -594,6 +1287,19 @@ namespace Walnut {
 			// Start the Dear ImGui frame
 			ImGui_ImplVulkan_NewFrame();
 			ImGui_ImplGlfw_NewFrame();
+			if (InputRecording::IsReplaying())
+			{
+				// The backend reads the real clock, and the real cursor while it doesn't know the cursor is inside the window
+				io.DeltaTime = m_TimeStep;
+				glm::vec2 mousePosition = InputRecording::GetReplayMousePosition();
+				if (mousePosition.x != -FLT_MAX && (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable))
+				{
+					int windowX, windowY;
+					glfwGetWindowPos(m_WindowHandle, &windowX, &windowY);
+					mousePosition += glm::vec2((float)windowX, (float)windowY);
+				}
+				io.AddMousePosEvent(mousePosition.x, mousePosition.y);
+			}
 			ImGui::NewFrame();
 
 			{
@@ -642,13 +1348,14 @@ namespace Walnut {
 				{
 					if (ImGui::BeginMenuBar())
 					{
+						ScopedAllowAllocations allow;
 						m_MenubarCallback();
 						ImGui::EndMenuBar();
 					}
 				}
 
-				for (auto& layer : m_LayerStack)
-					layer->OnUIRender();
+				for (size_t i = 0; i < m_LayerStack.size(); i++)
+					CallLayer(m_LayerAllocations[i], [&]() { m_LayerStack[i]->OnUIRender(); });
 
 				ImGui::End();
 			}
@@ -661,8 +1368,9 @@ namespace Walnut {
 			wd->ClearValue.color.float32[1] = clear_color.y * clear_color.w;
 			wd->ClearValue.color.float32[2] = clear_color.z * clear_color.w;
 			wd->ClearValue.color.float32[3] = clear_color.w;
+			bool main_is_submitted = false;
 			if (!main_is_minimized)
-				FrameRender(wd, main_draw_data);
+				main_is_submitted = FrameRender(wd, main_draw_data, m_LayerStack, m_LayerAllocations);
 
 			// Update and Render additional Platform Windows
 			if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
@@ -671,14 +1379,41 @@ namespace Walnut {
 				ImGui::RenderPlatformWindowsDefault();
 			}
 
+			float cpuMilliseconds = frameTimer.ElapsedMillis();
+
 			// Present Main Platform Window
-			if (!main_is_minimized)
+			if (main_is_submitted)
 				FramePresent(wd);
 
-			float time = GetTime();
-			m_FrameTime = time - m_LastFrameTime;
+			if (!m_FirstFrameRendered)
+			{
+				m_StartupTimings.push_back({ "Init to first frame", m_StartupTimer.ElapsedMillis() });
+#ifndef WL_DIST
+				std::cout << "[STARTUP] " << m_StartupTimings.back().Name << " - " << m_StartupTimings.back().Milliseconds << "ms\n";
+#endif
+				m_FirstFrameRendered = true;
+			}
+
+			uint64_t time = Clock::GetNanoseconds();
+			uint64_t frameNanoseconds = time - m_LastFrameTimeNanos;
+			m_FrameTime = (float)((double)frameNanoseconds * 1e-9);
 			m_TimeStep = glm::min<float>(m_FrameTime, 0.0333f);
-			m_LastFrameTime = time;
+			m_LastFrameTimeNanos = time;
+
+			m_FrameStatistics.AddFrame(frameNanoseconds, time);
+			Clock::Update();
+
+			framesMetric.Increment();
+			frameTimeMetric.Observe((double)frameNanoseconds * 1e-9);
+			cpuTimeMetric.Observe(cpuMilliseconds * 0.001);
+
+			m_FrameAllocations = AllocationTracker::GetThreadCounters() - frameAllocationsStart;
+
+			if (InputRecording::IsReplaying())
+			{
+				m_TimeStep = m_Specification.ReplayTimeStep;
+				InputRecording::AddReplayFrameTiming(m_FrameTime * 1000.0f, cpuMilliseconds);
+			}
 		}
 
 	}
@@ -688,9 +1423,32 @@ namespace Walnut {
 		m_Running = false;
 	}
 
+	bool Application::StartCapture(const FrameCaptureSpecification& specification)
+	{
+		if (!m_Specification.AllowFrameCapture)
+		{
+			std::cerr << "[Application] StartCapture needs ApplicationSpecification::AllowFrameCapture\n";
+			return false;
+		}
+
+		ImGui_ImplVulkanH_Window* wd = &g_MainWindowData;
+		return FrameCapture::Start(specification, wd->SurfaceFormat.format, (uint32_t)wd->Width, (uint32_t)wd->Height);
+	}
+
+	void Application::StopCapture()
+	{
+		if (!FrameCapture::IsActive())
+			return;
+
+		// Rare enough that waiting for the copies in flight is simpler than tracking them
+		VkResult err = vkDeviceWaitIdle(g_Device);
+		check_vk_result(err);
+		FrameCapture::Stop();
+	}
+
 	float Application::GetTime()
 	{
-		return (float)glfwGetTime();
+		return (float)Clock::GetSeconds();
 	}
 
 	VkInstance Application::GetInstance()
@@ -708,12 +1466,22 @@ namespace Walnut {
 		return g_Device;
 	}
 
+	VkPipelineCache Application::GetPipelineCache()
+	{
+		return g_PipelineCache;
+	}
+
+	const VkAllocationCallbacks* Application::GetAllocator()
+	{
+		return g_Allocator;
+	}
+
 	VkCommandBuffer Application::GetCommandBuffer(bool begin)
 	{
-		ImGui_ImplVulkanH_Window* wd = &g_MainWindowData;
+		FrameContext& frame = s_Frames[s_CurrentFrameIndex];
 
 		// Use any command queue
-		VkCommandPool command_pool = wd->Frames[wd->FrameIndex].CommandPool;
+		VkCommandPool command_pool = frame.CommandPool;
 
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo = {};
 		cmdBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -721,7 +1489,7 @@ namespace Walnut {
 		cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 		cmdBufAllocateInfo.commandBufferCount = 1;
 
-		VkCommandBuffer& command_buffer = s_AllocatedCommandBuffers[wd->FrameIndex].emplace_back();
+		VkCommandBuffer& command_buffer = frame.AllocatedCommandBuffers.emplace_back();
 		auto err = vkAllocateCommandBuffers(g_Device, &cmdBufAllocateInfo, &command_buffer);
 
 		VkCommandBufferBeginInfo begin_info = {};
@@ -749,7 +1517,7 @@ namespace Walnut {
 		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceCreateInfo.flags = 0;
 		VkFence fence;
-		err = vkCreateFence(g_Device, &fenceCreateInfo, nullptr, &fence);
+		err = vkCreateFence(g_Device, &fenceCreateInfo, g_Allocator, &fence);
 		check_vk_result(err);
 
 		err = vkQueueSubmit(g_Queue, 1, &end_info, fence);
@@ -758,13 +1526,105 @@ namespace Walnut {
 		err = vkWaitForFences(g_Device, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
 		check_vk_result(err);
 
-		vkDestroyFence(g_Device, fence, nullptr);
+		vkDestroyFence(g_Device, fence, g_Allocator);
+	}
+
+
+	void Application::SubmitToMainThread(std::function<void()>&& function)
+	{
+		if (TrySubmitToMainThread(std::move(function)))
+			return;
+
+		if (!s_MainThreadQueueOpen.load())
+		{
+			std::cerr << "[Application] SubmitToMainThread without a running Application, dropped\n";
+			return;
+		}
+
+		static MetricCounter& s_FullMetric = Metrics::GetCounter("walnut_main_thread_queue_full_total", "SubmitToMainThread calls that found the queue full");
+		s_FullMetric.Increment();
+
+		if (IsMainThread())
+		{
+			// Waiting would never end, nobody else drains the queue
+			function();
+			return;
+		}
+
+		while (!TrySubmitToMainThread(std::move(function)))
+		{
+			// Closed while waiting, nobody will drain it anymore
+			if (!s_MainThreadQueueOpen.load())
+				return;
+			std::this_thread::yield();
+		}
+	}
+
+	bool Application::TrySubmitToMainThread(std::function<void()>&& function)
+	{
+		// Counted before checking the flag, so Shutdown either sees this producer or this producer sees the queue closed
+		s_MainThreadQueueProducers.fetch_add(1);
+		bool pushed = s_MainThreadQueueOpen.load() && s_MainThreadQueue->TryPush(std::move(function));
+		s_MainThreadQueueProducers.fetch_sub(1);
+		return pushed;
+	}
+
+	bool Application::IsMainThread()
+	{
+		return std::this_thread::get_id() == s_MainThreadID;
+	}
+
+	void Application::ExecuteMainThreadTasks(uint64_t budgetNanos)
+	{
+		static MetricCounter& s_ExecutedMetric = Metrics::GetCounter("walnut_main_thread_tasks_total", "Functions run by the main thread for SubmitToMainThread");
+		static MetricGauge& s_PendingMetric = Metrics::GetGauge("walnut_main_thread_tasks_pending", "Functions waiting for the main thread after the last frame's budget");
+
+		if (!s_MainThreadQueue)
+			return;
+
+		// Posted functions are client code
+		ScopedAllowAllocations allow;
+
+		uint64_t start = Clock::GetNanoseconds();
+		uint64_t executed = 0;
+		std::function<void()> function;
+		while (s_MainThreadQueue->TryPop(function))
+		{
+			function();
+			function = nullptr;
+			executed++;
+
+			if (Clock::GetNanoseconds() - start >= budgetNanos)
+				break;
+		}
+
+		s_ExecutedMetric.Increment(executed);
+		s_PendingMetric.Set((double)s_MainThreadQueue->GetSize());
 	}
 
+	FrameArena& Application::GetFrameArena()
+	{
+		return *s_Frames[s_ArenaFrameIndex].Arena;
+	}
+
+	DeletionQueue& Application::GetDeletionQueue()
+	{
+		return s_DeletionQueue;
+	}
 
 	void Application::SubmitResourceFree(std::function<void()>&& func)
 	{
-		s_ResourceFreeQueue[s_CurrentFrameIndex].emplace_back(func);
+		s_DeletionQueue.PushCallback(std::move(func));
+	}
+
+	uint64_t Application::GetCurrentFrameNumber()
+	{
+		return s_CurrentFrameNumber;
+	}
+
+	uint64_t Application::GetCompletedFrameNumber()
+	{
+		return s_CompletedFrameNumber;
 	}
 
 }
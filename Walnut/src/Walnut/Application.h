@@ -1,6 +1,15 @@
 #pragma once
 
 #include "Layer.h"
+#include "AllocationTracker.h"
+#include "AsyncFileReader.h"
+#include "Clock.h"
+#include "Timer.h"
+#include "FrameStatistics.h"
+#include "DeletionQueue.h"
+#include "FrameCapture.h"
+#include "FrameArena.h"
+#include "VulkanAllocator.h"
 
 #include <string>
 #include <vector>
@@ -21,6 +30,60 @@ namespace Walnut {
 		std::string Name = "Walnut App";
 		uint32_t Width = 1600;
 		uint32_t Height = 900;
+		// Creates the window invisible, e.g. for benchmarks and automated runs. It still renders and presents.
+		bool Hidden = false;
+
+		// Frames the CPU may record ahead of the GPU, independent of the swapchain image count.
+		// Lower means less latency, higher means fewer stalls on vkWaitForFences.
+		uint32_t FramesInFlight = 2;
+
+		// Host allocator for the Vulkan driver, see VulkanAllocator.h. Also set by the WALNUT_VK_HOST_ALLOCATOR
+		// environment variable ("tracking" or "pooled").
+		VulkanHostAllocator HostAllocator = VulkanHostAllocator::Default;
+
+		// Marks Walnut's own part of every frame as a zero-allocation section after a few warm-up frames (layers and
+		// the menubar callback may allocate), see AllocationTracker. Debug builds break into the debugger on a
+		// violation. Needs a build with WL_TRACK_ALLOCATIONS.
+		bool CheckFrameAllocations = false;
+
+		// Initial size of each frame arena, per thread that allocates from it. Grows when a frame needs more.
+		size_t FrameArenaBlockSize = 1024 * 1024;
+
+		// Functions posted with Application::SubmitToMainThread that may wait at once, producers block beyond that
+		size_t MainThreadQueueCapacity = 4096;
+		// Milliseconds per frame spent running posted functions, the rest waits for the next frame.
+		// At least one runs every frame, so a slow one delays the frame rather than starving the queue.
+		float MainThreadTaskBudget = 2.0f;
+
+		// Background file reads, see AsyncFileReader and Image::LoadAsync
+		AsyncFileReaderSpecification FileReader;
+
+		// Window, hitch thresholds and histogram of Application::GetFrameStatistics
+		FrameStatisticsSpecification FrameStatistics;
+
+		// Records the input of the main window to this file, see InputRecording.h.
+		// Also set by the WALNUT_INPUT_RECORD environment variable.
+		std::string InputRecordPath;
+		// Replays a recording instead of the real input, with a fixed time step, then writes frame statistics
+		// (JSON, <InputReplayPath>.stats.json unless ReplayStatisticsPath is set) and closes the application.
+		// Also set by WALNUT_INPUT_REPLAY. Build with IMGUI_UNLIMITED_FRAME_RATE so vsync doesn't cap the timings.
+		std::string InputReplayPath;
+		std::string ReplayStatisticsPath;
+		float ReplayTimeStep = 1.0f / 60.0f;
+
+		// Lets Application::StartCapture record the main window. Capturing renders ImGui's draw data a second time
+		// per frame, so this doubles ImGui's ring of vertex/index buffers for the lifetime of the application.
+		bool AllowFrameCapture = false;
+
+		// Serves the Metrics registry in the Prometheus text format on this Unix-domain socket, see Metrics.h.
+		// Also set by the WALNUT_METRICS_SOCKET environment variable.
+		std::string MetricsSocketPath;
+	};
+
+	struct StartupTiming
+	{
+		std::string Name;
+		float Milliseconds = 0.0f;
 	};
 
 	class Application
@@ -38,27 +101,70 @@ namespace Walnut {
 		void PushLayer()
 		{
 			static_assert(std::is_base_of<Layer, T>::value, "Pushed type is not subclass of Layer!");
+			m_LayerAllocations.emplace_back();
 			m_LayerStack.emplace_back(std::make_shared<T>())->OnAttach();
 		}
 
-		void PushLayer(const std::shared_ptr<Layer>& layer) { m_LayerStack.emplace_back(layer); layer->OnAttach(); }
+		void PushLayer(const std::shared_ptr<Layer>& layer) { m_LayerAllocations.emplace_back(); m_LayerStack.emplace_back(layer); layer->OnAttach(); }
 
 		void Close();
 
+		// Seconds as float lose precision after hours of uptime, prefer GetTimeNanos for measuring
 		float GetTime();
+		static uint64_t GetTimeNanos() { return Clock::GetNanoseconds(); }
+		// Rolling frame times of the main loop, including hitches
+		const FrameStatistics& GetFrameStatistics() const { return m_FrameStatistics; }
+		FrameStatistics& GetFrameStatistics() { return m_FrameStatistics; }
+		// Heap allocations of the main thread during the last frame, and per layer in stack order. All zero unless
+		// built with WL_TRACK_ALLOCATIONS.
+		const AllocationCounters& GetFrameAllocations() const { return m_FrameAllocations; }
+		const std::vector<AllocationCounters>& GetLayerAllocations() const { return m_LayerAllocations; }
+		// Per-phase breakdown of Init, plus the time from the end of Init to the first presented frame
+		const std::vector<StartupTiming>& GetStartupTimings() const { return m_StartupTimings; }
 		GLFWwindow* GetWindowHandle() const { return m_WindowHandle; }
 
+		// Records the main window to disk from the next frame on, at the window's current size.
+		// Fails unless ApplicationSpecification::AllowFrameCapture is set.
+		bool StartCapture(const FrameCaptureSpecification& specification);
+		void StopCapture();
+		bool IsCapturing() const { return FrameCapture::IsActive(); }
+		FrameCaptureStats GetCaptureStats() const { return FrameCapture::GetStats(); }
+
 		static VkInstance GetInstance();
 		static VkPhysicalDevice GetPhysicalDevice();
 		static VkDevice GetDevice();
+		// Persisted to the user cache directory on shutdown, pass it when creating pipelines
+		static VkPipelineCache GetPipelineCache();
+		// Pass to every vkCreate*/vkDestroy*, nullptr unless a tracking host allocator was chosen
+		static const VkAllocationCallbacks* GetAllocator();
 
+		// Main thread only, workers post their uploads with SubmitToMainThread
 		static VkCommandBuffer GetCommandBuffer(bool begin);
 		static void FlushCommandBuffer(VkCommandBuffer commandBuffer);
 
+		// Runs the function on the main thread at the start of a later frame, after its fence has been waited for and
+		// before Layer::OnUpdate, in submission order per thread. Callable from any thread without locks; blocks
+		// while the queue is full (see ApplicationSpecification::MainThreadQueueCapacity), and runs the function
+		// right away if called from the main thread with a full queue. Stop posting threads in Layer::OnDetach at the latest,
+		// functions still queued then are dropped.
+		static void SubmitToMainThread(std::function<void()>&& function);
+		// False instead of blocking when the queue is full, or when no Application is running (the function is then dropped)
+		static bool TrySubmitToMainThread(std::function<void()>&& function);
+		static bool IsMainThread();
+
+		// Scratch memory for OnUpdate/OnUIRender and jobs of this frame, valid until its fence signals, see FrameArena.h
+		static FrameArena& GetFrameArena();
+
+		// Destroys Vulkan handles once no frame in flight can reference them anymore, callable from any thread
+		static DeletionQueue& GetDeletionQueue();
 		static void SubmitResourceFree(std::function<void()>&& func);
+		// Number of the frame currently being recorded, and of the last one the GPU has finished
+		static uint64_t GetCurrentFrameNumber();
+		static uint64_t GetCompletedFrameNumber();
 	private:
 		void Init();
 		void Shutdown();
+		void ExecuteMainThreadTasks(uint64_t budgetNanos);
 	private:
 		ApplicationSpecification m_Specification;
 		GLFWwindow* m_WindowHandle = nullptr;
@@ -66,9 +172,16 @@ namespace Walnut {
 
 		float m_TimeStep = 0.0f;
 		float m_FrameTime = 0.0f;
-		float m_LastFrameTime = 0.0f;
+		uint64_t m_LastFrameTimeNanos = 0;
+		FrameStatistics m_FrameStatistics;
+
+		std::vector<StartupTiming> m_StartupTimings;
+		Timer m_StartupTimer;
+		bool m_FirstFrameRendered = false;
 
 		std::vector<std::shared_ptr<Layer>> m_LayerStack;
+		std::vector<AllocationCounters> m_LayerAllocations;
+		AllocationCounters m_FrameAllocations;
 		std::function<void()> m_MenubarCallback;
 	};
 
@@ -0,0 +1,669 @@
+#include "AsyncFileReader.h"
+
+#include "Metrics.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+	#define WL_IO_URING
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <linux/io_uring.h>
+	#include <poll.h>
+	#include <sys/eventfd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace Walnut {
+
+	struct FileReadRequest
+	{
+		std::string Path;
+		FileReadCallback Callback;
+	};
+
+	static AsyncFileReaderSpecification s_Specification;
+
+	static std::mutex s_Mutex;
+	static bool s_Started = false;
+	static bool s_Stop = false;
+	// Set once the io_uring thread is done, it still hands completed reads to the workers while stopping
+	static bool s_StopWorkers = false;
+	static bool s_UsingIOUring = false;
+	static std::atomic<uint32_t> s_PendingCount = 0;
+
+	// Run by the workers: callbacks of completed reads, or whole blocking reads without io_uring
+	static std::deque<std::function<void()>> s_Tasks;
+	static std::condition_variable s_TaskCondition;
+	static std::vector<std::thread> s_Workers;
+
+	// Waiting for the io_uring thread
+	static std::deque<FileReadRequest> s_Requests;
+	static std::thread s_IOThread;
+
+	namespace Utils {
+
+		struct FileReadMetrics
+		{
+			MetricCounter& Reads;
+			MetricCounter& Failures;
+			MetricCounter& Bytes;
+		};
+
+		static FileReadMetrics& GetFileReadMetrics()
+		{
+			static FileReadMetrics s_Metrics = {
+				Metrics::GetCounter("walnut_file_reads_total", "Files read by AsyncFileReader"),
+				Metrics::GetCounter("walnut_file_read_failures_total", "AsyncFileReader reads that failed"),
+				Metrics::GetCounter("walnut_file_read_bytes_total", "Bytes read by AsyncFileReader"),
+			};
+			return s_Metrics;
+		}
+
+		static void PushTask(std::function<void()>&& task)
+		{
+			{
+				std::scoped_lock<std::mutex> lock(s_Mutex);
+				s_Tasks.push_back(std::move(task));
+			}
+			s_TaskCondition.notify_one();
+		}
+
+		static void Complete(FileReadResult&& result, FileReadCallback& callback)
+		{
+			FileReadMetrics& metrics = GetFileReadMetrics();
+			metrics.Reads.Increment();
+			if (result.Success)
+				metrics.Bytes.Increment(result.Data.size());
+			else
+				metrics.Failures.Increment();
+
+			callback(std::move(result));
+			s_PendingCount.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		static FileReadResult ReadFileBlocking(const std::string& path)
+		{
+			FileReadResult result;
+			result.Path = path;
+
+			// Fails for directories, which std::ifstream happily opens
+			std::error_code error;
+			uintmax_t size = std::filesystem::file_size(path, error);
+			if (error)
+			{
+				result.Error = error.message();
+				return result;
+			}
+
+			std::ifstream file(path, std::ios::binary);
+			result.Data.resize((size_t)size);
+			if (!file || (size > 0 && !file.read((char*)result.Data.data(), (std::streamsize)size)))
+			{
+				result.Data.clear();
+				result.Error = "Could not read file";
+				return result;
+			}
+
+			result.Success = true;
+			return result;
+		}
+
+		static void WorkerThread()
+		{
+			while (true)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(s_Mutex);
+					s_TaskCondition.wait(lock, []() { return !s_Tasks.empty() || s_StopWorkers; });
+
+					// Drain everything before stopping
+					if (s_Tasks.empty())
+						return;
+
+					task = std::move(s_Tasks.front());
+					s_Tasks.pop_front();
+				}
+
+				task();
+			}
+		}
+
+	}
+
+#ifdef WL_IO_URING
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// io_uring, through the raw system calls
+
+	namespace Utils {
+
+		// Submission and completion rings shared with the kernel. Only the io_uring thread touches them.
+		struct IORing
+		{
+			int FD = -1;
+
+			void* SQRing = nullptr;
+			size_t SQRingSize = 0;
+			void* CQRing = nullptr;
+			size_t CQRingSize = 0;
+			io_uring_sqe* SQEs = nullptr;
+			size_t SQEsSize = 0;
+
+			unsigned* SQHead = nullptr;
+			unsigned* SQTail = nullptr;
+			unsigned* SQMask = nullptr;
+			unsigned* SQArray = nullptr;
+			unsigned SQEntries = 0;
+
+			unsigned* CQHead = nullptr;
+			unsigned* CQTail = nullptr;
+			unsigned* CQMask = nullptr;
+			io_uring_cqe* CQEs = nullptr;
+
+			// Queued, not yet passed to io_uring_enter
+			unsigned Unsubmitted = 0;
+		};
+
+		static IORing s_Ring;
+		static int s_WakeEventFD = -1;
+
+		static void DestroyRing(IORing& ring)
+		{
+			if (ring.SQEs)
+				munmap(ring.SQEs, ring.SQEsSize);
+			if (ring.CQRing && ring.CQRing != ring.SQRing)
+				munmap(ring.CQRing, ring.CQRingSize);
+			if (ring.SQRing)
+				munmap(ring.SQRing, ring.SQRingSize);
+			if (ring.FD >= 0)
+				close(ring.FD);
+			ring = IORing();
+		}
+
+		static bool CreateRing(IORing& ring, unsigned entries)
+		{
+			io_uring_params params = {};
+			ring.FD = (int)syscall(__NR_io_uring_setup, entries, &params);
+			if (ring.FD < 0)
+				return false;
+
+			ring.SQRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			ring.CQRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+			if (singleMap)
+				ring.SQRingSize = ring.CQRingSize = std::max(ring.SQRingSize, ring.CQRingSize);
+
+			ring.SQRing = mmap(nullptr, ring.SQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.FD, IORING_OFF_SQ_RING);
+			if (ring.SQRing == MAP_FAILED)
+			{
+				ring.SQRing = nullptr;
+				DestroyRing(ring);
+				return false;
+			}
+
+			ring.CQRing = singleMap ? ring.SQRing : mmap(nullptr, ring.CQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.FD, IORING_OFF_CQ_RING);
+			if (ring.CQRing == MAP_FAILED)
+			{
+				ring.CQRing = nullptr;
+				DestroyRing(ring);
+				return false;
+			}
+
+			ring.SQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+			ring.SQEs = (io_uring_sqe*)mmap(nullptr, ring.SQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.FD, IORING_OFF_SQES);
+			if (ring.SQEs == MAP_FAILED)
+			{
+				ring.SQEs = nullptr;
+				DestroyRing(ring);
+				return false;
+			}
+
+			uint8_t* sq = (uint8_t*)ring.SQRing;
+			ring.SQHead = (unsigned*)(sq + params.sq_off.head);
+			ring.SQTail = (unsigned*)(sq + params.sq_off.tail);
+			ring.SQMask = (unsigned*)(sq + params.sq_off.ring_mask);
+			ring.SQArray = (unsigned*)(sq + params.sq_off.array);
+			ring.SQEntries = params.sq_entries;
+
+			uint8_t* cq = (uint8_t*)ring.CQRing;
+			ring.CQHead = (unsigned*)(cq + params.cq_off.head);
+			ring.CQTail = (unsigned*)(cq + params.cq_off.tail);
+			ring.CQMask = (unsigned*)(cq + params.cq_off.ring_mask);
+			ring.CQEs = (io_uring_cqe*)(cq + params.cq_off.cqes);
+			return true;
+		}
+
+		// Zeroed entry, published to the kernel by the next SubmitAndWait. nullptr if the ring is full.
+		static io_uring_sqe* PushSQE(IORing& ring, uint64_t userData)
+		{
+			unsigned tail = *ring.SQTail;
+			unsigned head = __atomic_load_n(ring.SQHead, __ATOMIC_ACQUIRE);
+			if (tail - head >= ring.SQEntries)
+				return nullptr;
+
+			unsigned index = tail & *ring.SQMask;
+			io_uring_sqe* sqe = &ring.SQEs[index];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->user_data = userData;
+			ring.SQArray[index] = index;
+			__atomic_store_n(ring.SQTail, tail + 1, __ATOMIC_RELEASE);
+			ring.Unsubmitted++;
+			return sqe;
+		}
+
+		// Submits everything queued and waits for at least one completion
+		static bool SubmitAndWait(IORing& ring)
+		{
+			while (true)
+			{
+				int submitted = (int)syscall(__NR_io_uring_enter, ring.FD, ring.Unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (submitted >= 0)
+				{
+					ring.Unsubmitted -= std::min((unsigned)submitted, ring.Unsubmitted);
+					return true;
+				}
+				if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+					return false;
+				if (errno != EINTR)
+					std::this_thread::yield();
+			}
+		}
+
+		// A file being read, its chunks may complete in any order
+		struct ActiveRead
+		{
+			FileReadRequest Request;
+			FileReadResult Result;
+			int FD = -1;
+			uint64_t Size = 0;
+			uint64_t NextOffset = 0; // Next chunk to submit
+			uint64_t Completed = 0;
+			uint32_t InFlight = 0;
+			bool Failed = false;
+		};
+
+		struct ChunkRead
+		{
+			ActiveRead* Read = nullptr;
+			uint64_t Offset = 0;
+			uint32_t Length = 0;
+		};
+
+		// user_data of the eventfd poll, chunks use their index + 1
+		static constexpr uint64_t WakeUserData = 0;
+
+		static void WakeIOThread()
+		{
+			uint64_t value = 1;
+			ssize_t written = ::write(s_WakeEventFD, &value, sizeof(value));
+			(void)written;
+		}
+
+		static void FailRead(ActiveRead& read, const char* operation, int error)
+		{
+			if (read.Failed)
+				return;
+			read.Failed = true;
+			read.Result.Error = std::string(operation) + ": " + strerror(error);
+		}
+
+		static void IOThread()
+		{
+			IORing& ring = s_Ring;
+			const uint32_t chunkSize = std::max(s_Specification.ChunkSize, 4096u);
+			const uint32_t maxOpenFiles = std::max(s_Specification.MaxOpenFiles, 1u);
+			// One entry is kept for the eventfd poll
+			const uint32_t maxChunks = std::max(std::min(s_Specification.QueueDepth, ring.SQEntries - 1), 1u);
+
+			std::vector<std::unique_ptr<ActiveRead>> active;
+			std::vector<ChunkRead> chunks(maxChunks);
+			std::vector<uint32_t> freeChunks;
+			for (uint32_t i = maxChunks; i > 0; i--)
+				freeChunks.push_back(i - 1);
+			size_t nextFile = 0; // Round robin, so every open file makes progress
+			bool pollArmed = false;
+
+			while (true)
+			{
+				std::vector<FileReadRequest> requests;
+				bool stop;
+				{
+					std::scoped_lock<std::mutex> lock(s_Mutex);
+					while (active.size() + requests.size() < maxOpenFiles && !s_Requests.empty())
+					{
+						requests.push_back(std::move(s_Requests.front()));
+						s_Requests.pop_front();
+					}
+					stop = s_Stop && s_Requests.empty();
+				}
+
+				for (FileReadRequest& request : requests)
+				{
+					auto read = std::make_unique<ActiveRead>();
+					read->Result.Path = request.Path;
+					read->Request = std::move(request);
+
+					// Blocking, io_uring's openat/statx would need a newer kernel for little gain
+					read->FD = open(read->Request.Path.c_str(), O_RDONLY | O_CLOEXEC);
+					struct stat status;
+					if (read->FD < 0)
+						FailRead(*read, "open", errno);
+					else if (fstat(read->FD, &status) != 0)
+						FailRead(*read, "fstat", errno);
+					else
+						read->Size = (uint64_t)status.st_size;
+
+					if (!read->Failed)
+						read->Result.Data.resize(read->Size);
+					active.push_back(std::move(read));
+				}
+
+				// Queue chunks of the open files until the ring is full
+				while (!freeChunks.empty())
+				{
+					bool queued = false;
+					for (size_t i = 0; i < active.size() && !freeChunks.empty(); i++)
+					{
+						ActiveRead& read = *active[(nextFile + i) % active.size()];
+						if (read.Failed || read.NextOffset >= read.Size)
+							continue;
+
+						uint32_t chunkIndex = freeChunks.back();
+						io_uring_sqe* sqe = PushSQE(ring, chunkIndex + 1);
+						if (!sqe)
+							break;
+						freeChunks.pop_back();
+
+						ChunkRead& chunk = chunks[chunkIndex];
+						chunk.Read = &read;
+						chunk.Offset = read.NextOffset;
+						chunk.Length = (uint32_t)std::min<uint64_t>(chunkSize, read.Size - read.NextOffset);
+						read.NextOffset += chunk.Length;
+						read.InFlight++;
+
+						sqe->opcode = IORING_OP_READ;
+						sqe->fd = read.FD;
+						sqe->addr = (uint64_t)(uintptr_t)(read.Result.Data.data() + chunk.Offset);
+						sqe->len = chunk.Length;
+						sqe->off = chunk.Offset;
+						queued = true;
+					}
+					if (!queued)
+						break;
+					if (!active.empty())
+						nextFile = (nextFile + 1) % active.size();
+				}
+
+				// Hand finished files to the workers
+				for (size_t i = 0; i < active.size();)
+				{
+					ActiveRead& read = *active[i];
+					if (read.InFlight > 0 || (!read.Failed && read.Completed < read.Size))
+					{
+						i++;
+						continue;
+					}
+
+					if (read.FD >= 0)
+						close(read.FD);
+					read.Result.Success = !read.Failed;
+					if (read.Failed)
+						read.Result.Data.clear();
+
+					auto task = std::make_shared<ActiveRead>(std::move(read));
+					PushTask([task]() { Complete(std::move(task->Result), task->Request.Callback); });
+
+					active.erase(active.begin() + i);
+				}
+				if (!active.empty())
+					nextFile %= active.size();
+
+				if (stop && active.empty())
+					return;
+
+				// New requests, and shutdown, arrive through the eventfd
+				if (!pollArmed)
+				{
+					if (io_uring_sqe* sqe = PushSQE(ring, WakeUserData))
+					{
+						sqe->opcode = IORING_OP_POLL_ADD;
+						sqe->fd = s_WakeEventFD;
+						sqe->poll_events = POLLIN;
+						pollArmed = true;
+					}
+				}
+
+				if (!SubmitAndWait(ring))
+				{
+					std::cerr << "[AsyncFileReader] io_uring_enter failed: " << strerror(errno) << std::endl;
+					for (std::unique_ptr<ActiveRead>& read : active)
+						FailRead(*read, "io_uring_enter", errno);
+				}
+
+				unsigned head = *ring.CQHead;
+				unsigned tail = __atomic_load_n(ring.CQTail, __ATOMIC_ACQUIRE);
+				for (; head != tail; head++)
+				{
+					const io_uring_cqe& cqe = ring.CQEs[head & *ring.CQMask];
+					if (cqe.user_data == WakeUserData)
+					{
+						uint64_t value;
+						ssize_t bytes = ::read(s_WakeEventFD, &value, sizeof(value));
+						(void)bytes;
+						pollArmed = false;
+						continue;
+					}
+
+					uint32_t chunkIndex = (uint32_t)(cqe.user_data - 1);
+					ChunkRead& chunk = chunks[chunkIndex];
+					ActiveRead& read = *chunk.Read;
+
+					if (cqe.res > 0 && (uint32_t)cqe.res < chunk.Length)
+					{
+						// Short read, queue the rest again
+						read.Completed += (uint64_t)cqe.res;
+						chunk.Offset += (uint64_t)cqe.res;
+						chunk.Length -= (uint32_t)cqe.res;
+						if (io_uring_sqe* sqe = PushSQE(ring, chunkIndex + 1))
+						{
+							sqe->opcode = IORING_OP_READ;
+							sqe->fd = read.FD;
+							sqe->addr = (uint64_t)(uintptr_t)(read.Result.Data.data() + chunk.Offset);
+							sqe->len = chunk.Length;
+							sqe->off = chunk.Offset;
+							continue;
+						}
+						FailRead(read, "read", EAGAIN);
+					}
+					else if (cqe.res > 0)
+					{
+						read.Completed += (uint64_t)cqe.res;
+					}
+					else if (cqe.res == 0)
+					{
+						// The file shrank while being read
+						FailRead(read, "read", EIO);
+					}
+					else
+					{
+						FailRead(read, "read", -cqe.res);
+					}
+
+					read.InFlight--;
+					freeChunks.push_back(chunkIndex);
+				}
+				__atomic_store_n(ring.CQHead, head, __ATOMIC_RELEASE);
+			}
+		}
+
+		// IORING_OP_READ needs Linux 5.6, older kernels create the ring but fail every read with -EINVAL.
+		// IORING_REGISTER_PROBE came with the same release, so a failing probe means no READ either.
+		static bool SupportsRead(const IORing& ring)
+		{
+			constexpr unsigned opCount = 256;
+			std::vector<uint8_t> storage(sizeof(io_uring_probe) + opCount * sizeof(io_uring_probe_op));
+			io_uring_probe* probe = (io_uring_probe*)storage.data();
+			if (syscall(__NR_io_uring_register, ring.FD, IORING_REGISTER_PROBE, probe, opCount) < 0)
+				return false;
+
+			return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+				(probe->ops[IORING_OP_POLL_ADD].flags & IO_URING_OP_SUPPORTED);
+		}
+
+		static bool StartIOURing()
+		{
+			s_WakeEventFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (s_WakeEventFD < 0)
+				return false;
+
+			if (!CreateRing(s_Ring, std::max(s_Specification.QueueDepth, 1u) + 1))
+			{
+				close(s_WakeEventFD);
+				s_WakeEventFD = -1;
+				return false;
+			}
+
+			if (!SupportsRead(s_Ring))
+			{
+				DestroyRing(s_Ring);
+				close(s_WakeEventFD);
+				s_WakeEventFD = -1;
+				errno = EOPNOTSUPP;
+				return false;
+			}
+
+			s_IOThread = std::thread(IOThread);
+			return true;
+		}
+
+		static void StopIOURing()
+		{
+			WakeIOThread();
+			s_IOThread.join();
+			DestroyRing(s_Ring);
+			close(s_WakeEventFD);
+			s_WakeEventFD = -1;
+		}
+
+	}
+
+#endif
+
+	// With s_Mutex held
+	static void StartThreads()
+	{
+		s_Started = true;
+		s_Stop = false;
+		s_StopWorkers = false;
+
+#ifdef WL_IO_URING
+		if (s_Specification.UseIOUring)
+		{
+			s_UsingIOUring = Utils::StartIOURing();
+			if (!s_UsingIOUring)
+				std::cerr << "[AsyncFileReader] io_uring unavailable (" << strerror(errno) << "), falling back to blocking reads" << std::endl;
+		}
+#endif
+
+		for (uint32_t i = 0; i < std::max(s_Specification.WorkerThreads, 1u); i++)
+			s_Workers.emplace_back(Utils::WorkerThread);
+	}
+
+	std::future<FileReadResult> AsyncFileReader::Read(std::string_view path)
+	{
+		auto promise = std::make_shared<std::promise<FileReadResult>>();
+		std::future<FileReadResult> future = promise->get_future();
+		Read(path, [promise](FileReadResult&& result) { promise->set_value(std::move(result)); });
+		return future;
+	}
+
+	void AsyncFileReader::Read(std::string_view path, FileReadCallback&& callback)
+	{
+		s_PendingCount.fetch_add(1, std::memory_order_relaxed);
+
+		std::unique_lock<std::mutex> lock(s_Mutex);
+		if (!s_Started)
+			StartThreads();
+
+		if (s_UsingIOUring)
+		{
+#ifdef WL_IO_URING
+			s_Requests.push_back({ std::string(path), std::move(callback) });
+			lock.unlock();
+			Utils::WakeIOThread();
+#endif
+			return;
+		}
+
+		auto request = std::make_shared<FileReadRequest>(FileReadRequest{ std::string(path), std::move(callback) });
+		s_Tasks.push_back([request]()
+		{
+			Utils::Complete(Utils::ReadFileBlocking(request->Path), request->Callback);
+		});
+		lock.unlock();
+		s_TaskCondition.notify_one();
+	}
+
+	uint32_t AsyncFileReader::GetPendingCount()
+	{
+		return s_PendingCount.load(std::memory_order_relaxed);
+	}
+
+	bool AsyncFileReader::IsUsingIOUring()
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+		return s_UsingIOUring;
+	}
+
+	void AsyncFileReader::Initialize(const AsyncFileReaderSpecification& specification)
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+		s_Specification = specification;
+	}
+
+	void AsyncFileReader::Shutdown()
+	{
+		{
+			std::scoped_lock<std::mutex> lock(s_Mutex);
+			if (!s_Started)
+				return;
+			s_Stop = true;
+		}
+
+		// The io_uring thread finishes its reads first, they end up as worker tasks
+#ifdef WL_IO_URING
+		if (s_UsingIOUring)
+			Utils::StopIOURing();
+#endif
+
+		{
+			std::scoped_lock<std::mutex> lock(s_Mutex);
+			s_StopWorkers = true;
+		}
+		s_TaskCondition.notify_all();
+		for (std::thread& worker : s_Workers)
+			worker.join();
+		s_Workers.clear();
+
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+		s_Started = false;
+		s_UsingIOUring = false;
+	}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Walnut {
+
+	struct AsyncFileReaderSpecification
+	{
+		// Reads in flight at once, across all files
+		uint32_t QueueDepth = 64;
+		// Files are read in pieces of this size, so large files don't hold up small ones
+		uint32_t ChunkSize = 512 * 1024;
+		// Files open at once, further requests wait
+		uint32_t MaxOpenFiles = 32;
+		// Run the callbacks (e.g. decoding), and do the reading itself without io_uring
+		uint32_t WorkerThreads = 4;
+		// io_uring on Linux when the kernel allows it (containers often block it), reads on the workers otherwise
+		bool UseIOUring = true;
+	};
+
+	struct FileReadResult
+	{
+		std::string Path;
+		std::vector<uint8_t> Data;
+		bool Success = false;
+		std::string Error;
+	};
+
+	using FileReadCallback = std::function<void(FileReadResult&&)>;
+
+	// Reads whole files in the background, many at once. On Linux a single thread keeps all reads in flight through
+	// io_uring, and completed files are handed to worker threads that run the callbacks, so decoding one file overlaps
+	// with reading the others. Without io_uring the workers read with blocking calls instead.
+	// Threads start with the first read. Callable from any thread.
+	class AsyncFileReader
+	{
+	public:
+		static std::future<FileReadResult> Read(std::string_view path);
+		// The callback runs on a worker thread, hand results to the main thread with Application::SubmitToMainThread
+		static void Read(std::string_view path, FileReadCallback&& callback);
+
+		static uint32_t GetPendingCount();
+		// False before the first read, or when falling back to blocking reads
+		static bool IsUsingIOUring();
+
+		// Called by Application, before the first read
+		static void Initialize(const AsyncFileReaderSpecification& specification);
+		// Completes every pending read, then stops the threads
+		static void Shutdown();
+	};
+
+}
@@ -0,0 +1,215 @@
+#include "Clock.h"
+
+#include <atomic>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define WL_CLOCK_TSC
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+		#include <x86intrin.h>
+	#endif
+#endif
+
+namespace Walnut {
+
+	// Nanoseconds per tick in 32.32 fixed point, published with a sequence counter so readers
+	// on other threads never combine a base from one refinement with the rate of another
+	struct TSCParameters
+	{
+		std::atomic<uint32_t> Sequence{ 0 };
+		std::atomic<uint64_t> BaseTicks{ 0 };
+		std::atomic<uint64_t> BaseNanoseconds{ 0 };
+		std::atomic<uint64_t> Multiplier{ 0 };
+	};
+
+	struct ClockState
+	{
+		// Invariant TSC present, UseTSC turns on with the first calibration in Update
+		bool HasTSC = false;
+		std::atomic<bool> UseTSC{ false };
+		std::chrono::steady_clock::time_point SteadyEpoch;
+
+		TSCParameters Parameters;
+		// Largest value handed out, a refinement lowering the rate could otherwise step the clock back slightly
+		std::atomic<uint64_t> LastNanoseconds{ 0 };
+
+		// First calibration point, every refinement measures the rate from here
+		uint64_t CalibrationTicks = 0;
+		uint64_t CalibrationSteadyNanoseconds = 0;
+		uint64_t NextRefinementNanoseconds = 0;
+		uint64_t RefinementInterval = 1000000000ull;
+	};
+
+	static constexpr uint64_t s_MaxRefinementInterval = 1024ull * 1000000000ull;
+	static constexpr uint64_t s_InitialCalibrationNanoseconds = 10000000ull;
+
+	namespace Utils {
+
+		static uint64_t ReadTSC()
+		{
+#ifdef WL_CLOCK_TSC
+			return __rdtsc();
+#else
+			return 0;
+#endif
+		}
+
+		static bool HasInvariantTSC()
+		{
+#ifdef WL_CLOCK_TSC
+	#ifdef _MSC_VER
+			int info[4] = {};
+			__cpuid(info, 0x80000000);
+			if ((unsigned int)info[0] < 0x80000007)
+				return false;
+			__cpuid(info, 0x80000007);
+			return (info[3] & (1 << 8)) != 0;
+	#else
+			unsigned int a, b, c, d;
+			if (!__get_cpuid(0x80000007, &a, &b, &c, &d))
+				return false;
+			return (d & (1 << 8)) != 0;
+	#endif
+#else
+			return false;
+#endif
+		}
+
+		// (ticks * multiplier) >> 32 without overflowing 64 bits for any realistic uptime
+		static uint64_t TicksToNanoseconds(uint64_t ticks, uint64_t multiplier)
+		{
+			return (ticks >> 32) * multiplier + (((ticks & 0xffffffffull) * multiplier) >> 32);
+		}
+
+		static uint64_t GetMultiplier(uint64_t ticks, uint64_t nanoseconds)
+		{
+			return (uint64_t)((double)nanoseconds / (double)ticks * 4294967296.0);
+		}
+
+	}
+
+	static uint64_t SteadyNanoseconds(const ClockState& state)
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state.SteadyEpoch).count();
+	}
+
+	static void Publish(TSCParameters& parameters, uint64_t baseTicks, uint64_t baseNanoseconds, uint64_t multiplier)
+	{
+		uint32_t sequence = parameters.Sequence.load(std::memory_order_relaxed);
+		parameters.Sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		parameters.BaseTicks.store(baseTicks, std::memory_order_relaxed);
+		parameters.BaseNanoseconds.store(baseNanoseconds, std::memory_order_relaxed);
+		parameters.Multiplier.store(multiplier, std::memory_order_relaxed);
+
+		parameters.Sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	static uint64_t ReadTSCNanoseconds(const TSCParameters& parameters)
+	{
+		uint32_t begin, end;
+		uint64_t baseTicks, baseNanoseconds, multiplier;
+		do
+		{
+			begin = parameters.Sequence.load(std::memory_order_acquire);
+			baseTicks = parameters.BaseTicks.load(std::memory_order_relaxed);
+			baseNanoseconds = parameters.BaseNanoseconds.load(std::memory_order_relaxed);
+			multiplier = parameters.Multiplier.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			end = parameters.Sequence.load(std::memory_order_relaxed);
+		} while ((begin & 1) || begin != end);
+
+		uint64_t ticks = Utils::ReadTSC();
+		// A thread that migrated right after a refinement can read slightly behind the base
+		return baseNanoseconds + (ticks > baseTicks ? Utils::TicksToNanoseconds(ticks - baseTicks, multiplier) : 0);
+	}
+
+	static ClockState& GetState()
+	{
+		static ClockState* s_State = []()
+		{
+			// No busy-wait here, Update calibrates once enough time has passed and the clock
+			// runs on steady_clock until then
+			ClockState* state = new ClockState();
+			state->SteadyEpoch = std::chrono::steady_clock::now();
+			state->HasTSC = Utils::HasInvariantTSC();
+			state->CalibrationTicks = Utils::ReadTSC();
+			state->CalibrationSteadyNanoseconds = SteadyNanoseconds(*state);
+			state->NextRefinementNanoseconds = state->CalibrationSteadyNanoseconds + s_InitialCalibrationNanoseconds;
+			return state;
+		}();
+		return *s_State;
+	}
+
+	uint64_t Clock::GetNanoseconds()
+	{
+		ClockState& state = GetState();
+		uint64_t nanoseconds = state.UseTSC.load(std::memory_order_acquire) ? ReadTSCNanoseconds(state.Parameters) : SteadyNanoseconds(state);
+		uint64_t last = state.LastNanoseconds.load(std::memory_order_relaxed);
+		while (nanoseconds > last)
+		{
+			if (state.LastNanoseconds.compare_exchange_weak(last, nanoseconds, std::memory_order_relaxed))
+				return nanoseconds;
+		}
+		return last;
+	}
+
+	bool Clock::IsUsingTSC()
+	{
+		return GetState().UseTSC.load(std::memory_order_acquire);
+	}
+
+	double Clock::GetTSCFrequency()
+	{
+		ClockState& state = GetState();
+		if (!state.UseTSC.load(std::memory_order_acquire))
+			return 0.0;
+
+		return 4294967296.0 / (double)state.Parameters.Multiplier.load(std::memory_order_relaxed) * 1e9;
+	}
+
+	void Clock::Update()
+	{
+		ClockState& state = GetState();
+		if (!state.HasTSC)
+			return;
+
+		uint64_t steadyNanoseconds = SteadyNanoseconds(state);
+		if (steadyNanoseconds < state.NextRefinementNanoseconds)
+			return;
+
+		if (!state.UseTSC.load(std::memory_order_relaxed))
+		{
+			// First estimate, anchored at the current steady_clock reading so the switch is continuous
+			uint64_t ticks = Utils::ReadTSC();
+			if (ticks <= state.CalibrationTicks)
+			{
+				state.HasTSC = false;
+				return;
+			}
+
+			Publish(state.Parameters, ticks, steadyNanoseconds,
+				Utils::GetMultiplier(ticks - state.CalibrationTicks, steadyNanoseconds - state.CalibrationSteadyNanoseconds));
+			state.UseTSC.store(true, std::memory_order_release);
+			state.NextRefinementNanoseconds = steadyNanoseconds + state.RefinementInterval;
+			return;
+		}
+
+		// Re-anchor at the current reading so the clock stays continuous and only its rate changes
+		uint64_t ticks = Utils::ReadTSC();
+		const TSCParameters& parameters = state.Parameters;
+		uint64_t baseTicks = parameters.BaseTicks.load(std::memory_order_relaxed);
+		uint64_t nanoseconds = parameters.BaseNanoseconds.load(std::memory_order_relaxed) +
+			(ticks > baseTicks ? Utils::TicksToNanoseconds(ticks - baseTicks, parameters.Multiplier.load(std::memory_order_relaxed)) : 0);
+		uint64_t multiplier = Utils::GetMultiplier(ticks - state.CalibrationTicks, steadyNanoseconds - state.CalibrationSteadyNanoseconds);
+		Publish(state.Parameters, ticks, nanoseconds, multiplier);
+
+		state.RefinementInterval = state.RefinementInterval * 2 > s_MaxRefinementInterval ? s_MaxRefinementInterval : state.RefinementInterval * 2;
+		state.NextRefinementNanoseconds = steadyNanoseconds + state.RefinementInterval;
+	}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Walnut {
+
+	// Monotonic 64-bit nanosecond time base, counted from the first use in the process. Unlike float
+	// seconds it keeps full precision regardless of uptime. It starts on std::chrono::steady_clock; on x86
+	// CPUs with an invariant TSC, Update switches to rdtsc once the first ~10 ms allow a calibration against
+	// it, then keeps refining the rate. Never goes backwards, also across threads. Callable from any thread.
+	class Clock
+	{
+	public:
+		static uint64_t GetNanoseconds();
+		static double GetSeconds() { return (double)GetNanoseconds() * 1e-9; }
+
+		// False until the first calibration in Update
+		static bool IsUsingTSC();
+		// Current estimate in ticks per second, 0 without TSC
+		static double GetTSCFrequency();
+
+		// Calibrates the TSC, then refines its rate over a growing interval (1 s, 2 s, ... up to ~17 min).
+		// Cheap unless a refinement is due, called every frame by Application. Only call it from one thread.
+		static void Update();
+	};
+
+}
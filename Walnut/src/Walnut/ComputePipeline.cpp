@@ -0,0 +1,182 @@
+#include "ComputePipeline.h"
+
+#include "Application.h"
+#include "DescriptorAllocator.h"
+#include "Image.h"
+
+#include <iostream>
+
+namespace Walnut {
+
+	ComputePipeline::ComputePipeline(const ComputePipelineSpecification& specification)
+		: m_Specification(specification)
+	{
+		VkDevice device = Application::GetDevice();
+		VkResult err;
+
+		// Descriptor set layout
+		{
+			std::vector<VkDescriptorSetLayoutBinding> bindings(m_Specification.Bindings.size());
+			for (uint32_t i = 0; i < (uint32_t)bindings.size(); i++)
+			{
+				bindings[i].binding = i;
+				bindings[i].descriptorType = m_Specification.Bindings[i];
+				bindings[i].descriptorCount = 1;
+				bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			}
+
+			VkDescriptorSetLayoutCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			info.bindingCount = (uint32_t)bindings.size();
+			info.pBindings = bindings.data();
+			err = vkCreateDescriptorSetLayout(device, &info, Application::GetAllocator(), &m_DescriptorSetLayout);
+			check_vk_result(err);
+		}
+
+		// Pipeline layout
+		{
+			VkPushConstantRange pushConstantRange = {};
+			pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			pushConstantRange.size = m_Specification.PushConstantSize;
+
+			VkPipelineLayoutCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			info.setLayoutCount = 1;
+			info.pSetLayouts = &m_DescriptorSetLayout;
+			info.pushConstantRangeCount = m_Specification.PushConstantSize ? 1 : 0;
+			info.pPushConstantRanges = &pushConstantRange;
+			err = vkCreatePipelineLayout(device, &info, Application::GetAllocator(), &m_PipelineLayout);
+			check_vk_result(err);
+		}
+
+		// Pipeline
+		if (m_Specification.Shader && m_Specification.Shader->IsValid())
+		{
+			VkComputePipelineCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			info.stage.module = m_Specification.Shader->GetModule();
+			info.stage.pName = m_Specification.EntryPoint;
+			info.layout = m_PipelineLayout;
+			err = vkCreateComputePipelines(device, Application::GetPipelineCache(), 1, &info, Application::GetAllocator(), &m_Pipeline);
+			check_vk_result(err);
+		}
+		else
+		{
+			std::cerr << "[ComputePipeline] Shader missing or invalid, Bind/Dispatch will do nothing" << std::endl;
+		}
+	}
+
+	ComputePipeline::~ComputePipeline()
+	{
+		DeletionQueue& deletionQueue = Application::GetDeletionQueue();
+		deletionQueue.Push(m_Pipeline);
+		deletionQueue.Push(m_PipelineLayout);
+
+		// Sets of this layout freed in the same frame are recycled before callbacks run, so they are dropped here too
+		VkDescriptorSetLayout descriptorSetLayout = m_DescriptorSetLayout;
+		deletionQueue.PushCallback([descriptorSetLayout]()
+		{
+			DescriptorAllocator::ReleaseLayout(descriptorSetLayout);
+			vkDestroyDescriptorSetLayout(Application::GetDevice(), descriptorSetLayout, Application::GetAllocator());
+		});
+	}
+
+	VkDescriptorSet ComputePipeline::AllocateDescriptorSet()
+	{
+		return DescriptorAllocator::Allocate(m_DescriptorSetLayout);
+	}
+
+	void ComputePipeline::FreeDescriptorSet(VkDescriptorSet descriptorSet)
+	{
+		DescriptorAllocator::Free(descriptorSet, m_DescriptorSetLayout);
+	}
+
+	void ComputePipeline::WriteStorageImage(VkDescriptorSet descriptorSet, uint32_t binding, const Image& image)
+	{
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageView = image.GetImageView();
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet;
+		write.dstBinding = binding;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(Application::GetDevice(), 1, &write, 0, nullptr);
+	}
+
+	void ComputePipeline::WriteSampledImage(VkDescriptorSet descriptorSet, uint32_t binding, const Image& image)
+	{
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.sampler = image.GetSampler();
+		imageInfo.imageView = image.GetImageView();
+		imageInfo.imageLayout = image.GetShaderReadLayout();
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet;
+		write.dstBinding = binding;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(Application::GetDevice(), 1, &write, 0, nullptr);
+	}
+
+	void ComputePipeline::WriteBuffer(VkDescriptorSet descriptorSet, uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = buffer;
+		bufferInfo.offset = offset;
+		bufferInfo.range = range;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptorSet;
+		write.dstBinding = binding;
+		write.descriptorCount = 1;
+		write.descriptorType = m_Specification.Bindings[binding];
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(Application::GetDevice(), 1, &write, 0, nullptr);
+	}
+
+	void ComputePipeline::Bind(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet)
+	{
+		if (!m_Pipeline)
+			return;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+		if (descriptorSet)
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	}
+
+	void ComputePipeline::PushConstants(VkCommandBuffer commandBuffer, const void* data, uint32_t size)
+	{
+		if (!m_Pipeline)
+			return;
+
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, size, data);
+	}
+
+	void ComputePipeline::Dispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+	{
+		if (!m_Pipeline)
+			return;
+
+		vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+	}
+
+	void ComputePipeline::DispatchForSize(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height)
+	{
+		if (!m_Pipeline)
+			return;
+
+		uint32_t groupCountX = (width + m_Specification.LocalSizeX - 1) / m_Specification.LocalSizeX;
+		uint32_t groupCountY = (height + m_Specification.LocalSizeY - 1) / m_Specification.LocalSizeY;
+		vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+	}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "Shader.h"
+
+namespace Walnut {
+
+	class Image;
+
+	struct ComputePipelineSpecification
+	{
+		std::shared_ptr<Walnut::Shader> Shader;
+		const char* EntryPoint = "main";
+
+		// Set 0, binding i uses Bindings[i]
+		std::vector<VkDescriptorType> Bindings;
+		uint32_t PushConstantSize = 0;
+
+		// Must match local_size_x/y in the shader, used by DispatchForSize
+		uint32_t LocalSizeX = 16, LocalSizeY = 16;
+	};
+
+	// Dispatches are recorded from Layer::OnCompute; writes are made visible to the
+	// UI render pass of the same frame by Application.
+	class ComputePipeline
+	{
+	public:
+		ComputePipeline(const ComputePipelineSpecification& specification);
+		~ComputePipeline();
+
+		// Sets use this pipeline's layout and must be freed before the pipeline is destroyed
+		VkDescriptorSet AllocateDescriptorSet();
+		void FreeDescriptorSet(VkDescriptorSet descriptorSet);
+
+		// Storage images are accessed in GENERAL (see ImageUsage_Storage). Rewrite after Image::Resize, it may reallocate the view
+		void WriteStorageImage(VkDescriptorSet descriptorSet, uint32_t binding, const Image& image);
+		void WriteSampledImage(VkDescriptorSet descriptorSet, uint32_t binding, const Image& image);
+		void WriteBuffer(VkDescriptorSet descriptorSet, uint32_t binding, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+		// False if the shader was missing or invalid, Bind, PushConstants and the dispatches then do nothing
+		bool IsValid() const { return m_Pipeline != nullptr; }
+
+		void Bind(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet = nullptr);
+		void PushConstants(VkCommandBuffer commandBuffer, const void* data, uint32_t size);
+		void Dispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+		// One invocation per pixel, rounded up to whole work groups
+		void DispatchForSize(VkCommandBuffer commandBuffer, uint32_t width, uint32_t height);
+
+		VkPipeline GetPipeline() const { return m_Pipeline; }
+		VkPipelineLayout GetPipelineLayout() const { return m_PipelineLayout; }
+		VkDescriptorSetLayout GetDescriptorSetLayout() const { return m_DescriptorSetLayout; }
+	private:
+		ComputePipelineSpecification m_Specification;
+
+		VkDescriptorSetLayout m_DescriptorSetLayout = nullptr;
+		VkPipelineLayout m_PipelineLayout = nullptr;
+		VkPipeline m_Pipeline = nullptr;
+	};
+
+}
@@ -0,0 +1,120 @@
+#include "DeletionQueue.h"
+
+#include "Application.h"
+#include "DescriptorAllocator.h"
+#include "Metrics.h"
+
+namespace Walnut {
+
+	namespace Utils {
+
+		static void DestroyHandle(VkDevice device, VkFramebuffer handle) { vkDestroyFramebuffer(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkPipeline handle) { vkDestroyPipeline(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkPipelineLayout handle) { vkDestroyPipelineLayout(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkDescriptorSetLayout handle) { vkDestroyDescriptorSetLayout(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkShaderModule handle) { vkDestroyShaderModule(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkRenderPass handle) { vkDestroyRenderPass(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkSampler handle) { vkDestroySampler(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkImageView handle) { vkDestroyImageView(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkImage handle) { vkDestroyImage(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkBuffer handle) { vkDestroyBuffer(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkDeviceMemory handle) { vkFreeMemory(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkFence handle) { vkDestroyFence(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkSemaphore handle) { vkDestroySemaphore(device, handle, Application::GetAllocator()); }
+		static void DestroyHandle(VkDevice device, VkCommandPool handle) { vkDestroyCommandPool(device, handle, Application::GetAllocator()); }
+
+		// Calls destroy(entry) for every entry with Frame < completedFrame and compacts the rest in place,
+		// returns how many were destroyed
+		template<typename Entry, typename Func>
+		static size_t FlushEntries(std::vector<Entry>& entries, uint64_t completedFrame, Func destroy)
+		{
+			size_t kept = 0;
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				if (entries[i].Frame < completedFrame)
+					destroy(entries[i]);
+				else
+					entries[kept++] = std::move(entries[i]);
+			}
+			size_t destroyed = entries.size() - kept;
+			entries.resize(kept);
+			return destroyed;
+		}
+
+	}
+
+	DeletionQueue::DeletionQueue()
+	{
+		std::apply([](auto&... lists) { (lists.Entries.reserve(64), ...); }, m_Lists);
+		m_DescriptorSets.reserve(64);
+		m_Callbacks.reserve(64);
+		m_ReadyCallbacks.reserve(64);
+	}
+
+	void DeletionQueue::Push(VkDescriptorSet descriptorSet, VkDescriptorSetLayout layout)
+	{
+		if (descriptorSet == VK_NULL_HANDLE)
+			return;
+
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+		m_DescriptorSets.push_back({ descriptorSet, layout, m_CurrentFrame.load(std::memory_order_relaxed) });
+	}
+
+	void DeletionQueue::PushCallback(std::function<void()>&& func)
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+		m_Callbacks.push_back({ std::move(func), m_CurrentFrame.load(std::memory_order_relaxed) });
+	}
+
+	void DeletionQueue::Flush(VkDevice device, uint64_t completedFrame)
+	{
+		static MetricCounter& s_FreedMetric = Metrics::GetCounter("walnut_deferred_frees_total", "Objects destroyed by the deletion queue");
+		static MetricGauge& s_PendingMetric = Metrics::GetGauge("walnut_deferred_frees_pending", "Objects waiting in the deletion queue for their frame to complete");
+
+		size_t freed = 0, pending = 0;
+		{
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+
+			freed += Utils::FlushEntries(m_Callbacks, completedFrame, [this](CallbackEntry& entry)
+			{
+				m_ReadyCallbacks.push_back(std::move(entry.Func));
+			});
+
+			std::apply([device, completedFrame, &freed](auto&... lists)
+			{
+				((freed += Utils::FlushEntries(lists.Entries, completedFrame, [device](auto& entry) { Utils::DestroyHandle(device, entry.Handle); })), ...);
+			}, m_Lists);
+
+			freed += Utils::FlushEntries(m_DescriptorSets, completedFrame, [](DescriptorSetEntry& entry)
+			{
+				DescriptorAllocator::Recycle(entry.DescriptorSet, entry.Layout);
+			});
+
+			pending = m_DescriptorSets.size() + m_Callbacks.size();
+			std::apply([&pending](const auto&... lists) { ((pending += lists.Entries.size()), ...); }, m_Lists);
+		}
+
+		s_FreedMetric.Increment(freed);
+		s_PendingMetric.Set((double)pending);
+
+		// Outside the lock since callbacks may push again
+		for (auto& func : m_ReadyCallbacks)
+			func();
+		m_ReadyCallbacks.clear();
+	}
+
+	void DeletionQueue::FlushAll(VkDevice device)
+	{
+		Flush(device, UINT64_MAX);
+	}
+
+	size_t DeletionQueue::GetPendingCount() const
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		size_t count = m_DescriptorSets.size() + m_Callbacks.size();
+		std::apply([&count](const auto&... lists) { ((count += lists.Entries.size()), ...); }, m_Lists);
+		return count;
+	}
+
+}
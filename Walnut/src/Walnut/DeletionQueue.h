@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+namespace Walnut {
+
+	// Deferred destruction of Vulkan objects that may still be referenced by frames in flight.
+	// Handles are stored by type in flat arrays, tagged with the frame number that was being
+	// recorded when they were pushed, and destroyed in batches once the GPU has passed that frame.
+	// Push may be called from any thread; after warm-up it does not allocate.
+	class DeletionQueue
+	{
+	public:
+		DeletionQueue();
+
+		template<typename T>
+		void Push(T handle)
+		{
+			if (handle == VK_NULL_HANDLE)
+				return;
+
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+			std::get<HandleList<T>>(m_Lists).Entries.push_back({ handle, m_CurrentFrame.load(std::memory_order_relaxed) });
+		}
+
+		// The set is handed back to the DescriptorAllocator for recycling rather than destroyed
+		void Push(VkDescriptorSet descriptorSet, VkDescriptorSetLayout layout);
+
+		// For anything that isn't a plain handle. Allocates, so avoid on hot paths.
+		void PushCallback(std::function<void()>&& func);
+
+		// Called by Application
+		void SetCurrentFrame(uint64_t frame) { m_CurrentFrame.store(frame, std::memory_order_relaxed); }
+		// Destroys everything pushed during frames < completedFrame
+		void Flush(VkDevice device, uint64_t completedFrame);
+		void FlushAll(VkDevice device);
+
+		size_t GetPendingCount() const;
+	private:
+		template<typename T>
+		struct HandleList
+		{
+			struct Entry
+			{
+				T Handle;
+				uint64_t Frame;
+			};
+			std::vector<Entry> Entries;
+		};
+
+		struct DescriptorSetEntry
+		{
+			VkDescriptorSet DescriptorSet;
+			VkDescriptorSetLayout Layout;
+			uint64_t Frame;
+		};
+
+		struct CallbackEntry
+		{
+			std::function<void()> Func;
+			uint64_t Frame;
+		};
+
+		std::tuple<
+			// Destroyed in this order, dependents before what they reference
+			HandleList<VkFramebuffer>,
+			HandleList<VkPipeline>,
+			HandleList<VkPipelineLayout>,
+			HandleList<VkDescriptorSetLayout>,
+			HandleList<VkShaderModule>,
+			HandleList<VkRenderPass>,
+			HandleList<VkSampler>,
+			HandleList<VkImageView>,
+			HandleList<VkImage>,
+			HandleList<VkBuffer>,
+			HandleList<VkDeviceMemory>,
+			HandleList<VkFence>,
+			HandleList<VkSemaphore>,
+			HandleList<VkCommandPool>
+		> m_Lists;
+
+		std::vector<DescriptorSetEntry> m_DescriptorSets;
+		std::vector<CallbackEntry> m_Callbacks;
+		// Callbacks run outside the lock since they may push again
+		std::vector<std::function<void()>> m_ReadyCallbacks;
+
+		std::atomic<uint64_t> m_CurrentFrame{ 0 };
+		mutable std::mutex m_Mutex;
+	};
+
+}
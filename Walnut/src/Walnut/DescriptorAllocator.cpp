@@ -0,0 +1,260 @@
+#include "DescriptorAllocator.h"
+
+#include "Application.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Walnut {
+
+	struct DescriptorPool
+	{
+		VkDescriptorPool Pool = VK_NULL_HANDLE;
+		uint32_t MaxSets = 0;
+		uint32_t Allocated = 0;
+	};
+
+	static VkDevice s_Device = VK_NULL_HANDLE;
+	static VkDescriptorSetLayout s_TextureLayout = VK_NULL_HANDLE;
+
+	static std::vector<DescriptorPool> s_Pools;
+	static uint32_t s_NextPoolSize = 0;
+	static uint32_t s_LiveSets = 0;
+	static uint32_t s_CachedSets = 0;
+
+	// Freed sets, per layout, ready to be rewritten and handed out again
+	static std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> s_FreeSets;
+	// Index into s_Pools of every set handed out, for returning the sets of a released layout to their pool
+	static std::unordered_map<VkDescriptorSet, uint32_t> s_SetPools;
+
+	static std::mutex s_Mutex;
+
+	static constexpr uint32_t MaxSetsPerPool = 4096;
+	static constexpr uint32_t MaxDescriptorsPerType = 65536;
+
+	// descriptorsPerType raises the count of every type, for layouts that need more than a pool's usual share
+	static void CreatePool(uint32_t maxSets, uint32_t descriptorsPerType = 0)
+	{
+		// Sized for what Walnut itself allocates (mostly image samplers), the other types get a smaller share
+		VkDescriptorPoolSize poolSizes[] =
+		{
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSets },
+			{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, maxSets / 4 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSets / 4 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, maxSets / 4 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxSets / 4 },
+			{ VK_DESCRIPTOR_TYPE_SAMPLER, maxSets / 8 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, maxSets / 8 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, maxSets / 8 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, maxSets / 8 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, maxSets / 8 },
+			{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, maxSets / 8 },
+		};
+		for (VkDescriptorPoolSize& poolSize : poolSizes)
+		{
+			if (poolSize.descriptorCount < descriptorsPerType)
+				poolSize.descriptorCount = descriptorsPerType;
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		// Sets are recycled per layout, only the sets of a released layout go back to their pool
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		poolInfo.maxSets = maxSets;
+		poolInfo.poolSizeCount = (uint32_t)(sizeof(poolSizes) / sizeof(poolSizes[0]));
+		poolInfo.pPoolSizes = poolSizes;
+
+		DescriptorPool& pool = s_Pools.emplace_back();
+		pool.MaxSets = maxSets;
+		VkResult err = vkCreateDescriptorPool(s_Device, &poolInfo, Application::GetAllocator(), &pool.Pool);
+		check_vk_result(err);
+	}
+
+	void DescriptorAllocator::Init(VkDevice device, uint32_t initialSetsPerPool)
+	{
+		s_Device = device;
+		s_NextPoolSize = initialSetsPerPool < 8 ? 8 : initialSetsPerPool;
+
+		// Must match the layout created by imgui_impl_vulkan so ImGui can bind our sets
+		VkDescriptorSetLayoutBinding binding[1] = {};
+		binding[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding[0].descriptorCount = 1;
+		binding[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		VkDescriptorSetLayoutCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		info.bindingCount = 1;
+		info.pBindings = binding;
+		VkResult err = vkCreateDescriptorSetLayout(s_Device, &info, Application::GetAllocator(), &s_TextureLayout);
+		check_vk_result(err);
+	}
+
+	void DescriptorAllocator::Shutdown()
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+
+		// Destroying the pools implicitly frees every set allocated from them
+		for (DescriptorPool& pool : s_Pools)
+			vkDestroyDescriptorPool(s_Device, pool.Pool, Application::GetAllocator());
+		s_Pools.clear();
+		s_FreeSets.clear();
+		s_SetPools.clear();
+		s_LiveSets = 0;
+		s_CachedSets = 0;
+
+		vkDestroyDescriptorSetLayout(s_Device, s_TextureLayout, Application::GetAllocator());
+		s_TextureLayout = VK_NULL_HANDLE;
+		s_Device = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+
+		// Recycle a previously freed set of the same layout if there is one
+		auto it = s_FreeSets.find(layout);
+		if (it != s_FreeSets.end() && !it->second.empty())
+		{
+			VkDescriptorSet descriptorSet = it->second.back();
+			it->second.pop_back();
+			s_CachedSets--;
+			s_LiveSets++;
+			return descriptorSet;
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		// Newest first, it is the one most likely to have space. Older pools only regain some when a layout is released.
+		for (size_t i = s_Pools.size(); i-- > 0;)
+		{
+			DescriptorPool& pool = s_Pools[i];
+			if (pool.Allocated >= pool.MaxSets)
+				continue;
+
+			allocInfo.descriptorPool = pool.Pool;
+
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			VkResult err = vkAllocateDescriptorSets(s_Device, &allocInfo, &descriptorSet);
+			if (err == VK_SUCCESS)
+			{
+				pool.Allocated++;
+				s_LiveSets++;
+				s_SetPools[descriptorSet] = (uint32_t)i;
+				return descriptorSet;
+			}
+
+			if (err != VK_ERROR_OUT_OF_POOL_MEMORY && err != VK_ERROR_FRAGMENTED_POOL)
+				check_vk_result(err);
+		}
+
+		// Chain a new, larger pool
+		uint32_t maxSets = s_NextPoolSize;
+		s_NextPoolSize = s_NextPoolSize * 2 > MaxSetsPerPool ? MaxSetsPerPool : s_NextPoolSize * 2;
+
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkResult err;
+		for (uint32_t descriptorsPerType = 0;; descriptorsPerType = descriptorsPerType ? descriptorsPerType * 2 : maxSets * 2)
+		{
+			CreatePool(maxSets, descriptorsPerType);
+			allocInfo.descriptorPool = s_Pools.back().Pool;
+			err = vkAllocateDescriptorSets(s_Device, &allocInfo, &descriptorSet);
+			if ((err != VK_ERROR_OUT_OF_POOL_MEMORY && err != VK_ERROR_FRAGMENTED_POOL) || descriptorsPerType >= MaxDescriptorsPerType)
+				break;
+
+			// Even an empty pool can't hold this layout, replace it with one that has more of every type
+			vkDestroyDescriptorPool(s_Device, s_Pools.back().Pool, Application::GetAllocator());
+			s_Pools.pop_back();
+		}
+		check_vk_result(err);
+
+		DescriptorPool& pool = s_Pools.back();
+		pool.Allocated++;
+		s_LiveSets++;
+		s_SetPools[descriptorSet] = (uint32_t)(s_Pools.size() - 1);
+		return descriptorSet;
+	}
+
+	void DescriptorAllocator::Free(VkDescriptorSet descriptorSet, VkDescriptorSetLayout layout)
+	{
+		Application::GetDeletionQueue().Push(descriptorSet, layout);
+	}
+
+	void DescriptorAllocator::Recycle(VkDescriptorSet descriptorSet, VkDescriptorSetLayout layout)
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+		s_FreeSets[layout].push_back(descriptorSet);
+		s_LiveSets--;
+		s_CachedSets++;
+	}
+
+	void DescriptorAllocator::ReleaseLayout(VkDescriptorSetLayout layout)
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+		auto it = s_FreeSets.find(layout);
+		if (it == s_FreeSets.end())
+			return;
+
+		// No other layout can reuse them, so they go back to their pools
+		for (VkDescriptorSet descriptorSet : it->second)
+		{
+			auto poolIt = s_SetPools.find(descriptorSet);
+			DescriptorPool& pool = s_Pools[poolIt->second];
+			VkResult err = vkFreeDescriptorSets(s_Device, pool.Pool, 1, &descriptorSet);
+			check_vk_result(err);
+			pool.Allocated--;
+			s_SetPools.erase(poolIt);
+		}
+
+		s_CachedSets -= (uint32_t)it->second.size();
+		s_FreeSets.erase(it);
+	}
+
+	VkDescriptorSetLayout DescriptorAllocator::GetTextureLayout()
+	{
+		return s_TextureLayout;
+	}
+
+	VkDescriptorSet DescriptorAllocator::AllocateTexture(VkSampler sampler, VkImageView imageView, VkImageLayout imageLayout)
+	{
+		VkDescriptorSet descriptorSet = Allocate(s_TextureLayout);
+
+		VkDescriptorImageInfo descImage[1] = {};
+		descImage[0].sampler = sampler;
+		descImage[0].imageView = imageView;
+		descImage[0].imageLayout = imageLayout;
+		VkWriteDescriptorSet writeDesc[1] = {};
+		writeDesc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDesc[0].dstSet = descriptorSet;
+		writeDesc[0].descriptorCount = 1;
+		writeDesc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDesc[0].pImageInfo = descImage;
+		vkUpdateDescriptorSets(s_Device, 1, writeDesc, 0, nullptr);
+
+		return descriptorSet;
+	}
+
+	void DescriptorAllocator::FreeTexture(VkDescriptorSet descriptorSet)
+	{
+		Free(descriptorSet, s_TextureLayout);
+	}
+
+	DescriptorPoolStats DescriptorAllocator::GetStats()
+	{
+		std::scoped_lock<std::mutex> lock(s_Mutex);
+
+		DescriptorPoolStats stats;
+		stats.PoolCount = (uint32_t)s_Pools.size();
+		for (const DescriptorPool& pool : s_Pools)
+		{
+			stats.SetCapacity += pool.MaxSets;
+			stats.SetsAllocated += pool.Allocated;
+		}
+		stats.SetsLive = s_LiveSets;
+		stats.SetsCached = s_CachedSets;
+		return stats;
+	}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "vulkan/vulkan.h"
+
+namespace Walnut {
+
+	struct DescriptorPoolStats
+	{
+		uint32_t PoolCount = 0;
+		uint32_t SetCapacity = 0;   // Sum of maxSets over all pools
+		uint32_t SetsAllocated = 0; // Sets handed out by the pools (live + cached)
+		uint32_t SetsLive = 0;      // Sets currently owned by callers
+		uint32_t SetsCached = 0;    // Freed sets waiting to be recycled
+	};
+
+	// Grows by chaining descriptor pools instead of relying on a single fixed-size pool.
+	// Freed sets are not returned to their pool but kept per layout and recycled, so a
+	// steady stream of allocate/free (e.g. resizing an Image every frame) stays flat.
+	// ReleaseLayout returns them to their pools, where sets of any layout can reuse the space.
+	class DescriptorAllocator
+	{
+	public:
+		static void Init(VkDevice device, uint32_t initialSetsPerPool = 256);
+		static void Shutdown();
+
+		static VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+		// Deferred through the Application's DeletionQueue; the set is recycled once the GPU is done with it
+		static void Free(VkDescriptorSet descriptorSet, VkDescriptorSetLayout layout);
+		// Immediately makes the set available again, only for sets no longer referenced by any frame in flight
+		static void Recycle(VkDescriptorSet descriptorSet, VkDescriptorSetLayout layout);
+		// Frees the cached sets of a layout that is about to be destroyed, so a new layout reusing the handle can't get them
+		static void ReleaseLayout(VkDescriptorSetLayout layout);
+
+		// Layout compatible with the one used by the ImGui Vulkan backend (binding 0: combined image sampler)
+		static VkDescriptorSetLayout GetTextureLayout();
+		static VkDescriptorSet AllocateTexture(VkSampler sampler, VkImageView imageView, VkImageLayout imageLayout);
+		static void FreeTexture(VkDescriptorSet descriptorSet);
+
+		static DescriptorPoolStats GetStats();
+	};
+
+}
@@ -0,0 +1,190 @@
+#include "FrameArena.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace Walnut {
+
+	// Per thread: the last few arenas it allocated from. Frames in flight rarely exceed three.
+	struct ThreadArenaCacheEntry
+	{
+		uint64_t ArenaID;
+		LinearArena* Arena;
+	};
+
+	static constexpr uint32_t s_ThreadArenaCacheSize = 8;
+	static thread_local ThreadArenaCacheEntry s_ThreadArenaCache[s_ThreadArenaCacheSize];
+	static thread_local uint32_t s_ThreadArenaCacheNext = 0;
+
+	static std::atomic<uint64_t> s_NextArenaID{ 1 };
+
+	LinearArena::LinearArena(size_t blockSize)
+		: m_BlockSize(std::max<size_t>(blockSize, 256))
+	{
+	}
+
+	LinearArena::~LinearArena()
+	{
+		for (Block& block : m_Blocks)
+			free(block.Memory);
+	}
+
+	void LinearArena::AddBlock(size_t size)
+	{
+		Block block = { (uint8_t*)malloc(size), size };
+		if (!block.Memory)
+			throw std::bad_alloc();
+
+		m_Blocks.push_back(block);
+		m_Capacity.store(m_Capacity.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+	}
+
+	void* LinearArena::Allocate(size_t size, size_t alignment)
+	{
+		size_t used = m_UsedBytes.load(std::memory_order_relaxed);
+		while (m_CurrentBlock < m_Blocks.size())
+		{
+			Block& block = m_Blocks[m_CurrentBlock];
+			uintptr_t current = (uintptr_t)block.Memory + m_Offset;
+			uintptr_t start = (current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			if (start + size <= (uintptr_t)block.Memory + block.Size)
+			{
+				m_Offset = start + size - (uintptr_t)block.Memory;
+				m_UsedBytes.store(used + (start + size - current), std::memory_order_relaxed);
+				return (void*)start;
+			}
+
+			// The tail of the block stays unused until the next Reset
+			m_CurrentBlock++;
+			m_Offset = 0;
+		}
+
+		AddBlock(std::max(m_BlockSize, size + alignment));
+		return Allocate(size, alignment);
+	}
+
+	void LinearArena::Reset()
+	{
+		// Grew this frame: one block of the total size, so the next frames don't spill over again
+		if (m_Blocks.size() > 1)
+		{
+			size_t capacity = m_Capacity.load(std::memory_order_relaxed);
+			for (Block& block : m_Blocks)
+				free(block.Memory);
+			m_Blocks.clear();
+			m_Capacity.store(0, std::memory_order_relaxed);
+			AddBlock(capacity);
+		}
+
+		m_CurrentBlock = 0;
+		m_Offset = 0;
+		m_UsedBytes.store(0, std::memory_order_relaxed);
+	}
+
+	FrameArena::FrameArena(size_t blockSize)
+		: m_ID(s_NextArenaID.fetch_add(1, std::memory_order_relaxed)), m_BlockSize(blockSize)
+	{
+	}
+
+	FrameArena::~FrameArena()
+	{
+		// Stale cache entries are harmless, the ID is never handed out again
+	}
+
+	LinearArena& FrameArena::GetThreadArena()
+	{
+		for (uint32_t i = 0; i < s_ThreadArenaCacheSize; i++)
+		{
+			if (s_ThreadArenaCache[i].ArenaID == m_ID)
+				return *s_ThreadArenaCache[i].Arena;
+		}
+
+		LinearArena* arena = nullptr;
+		{
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+
+			std::thread::id thread = std::this_thread::get_id();
+			for (auto& threadArena : m_ThreadArenas)
+			{
+				if (threadArena->Thread == thread)
+				{
+					arena = &threadArena->Arena;
+					break;
+				}
+			}
+
+			if (!arena)
+			{
+				m_ThreadArenas.push_back(std::make_unique<ThreadArena>(thread, m_BlockSize));
+				arena = &m_ThreadArenas.back()->Arena;
+			}
+		}
+
+		s_ThreadArenaCache[s_ThreadArenaCacheNext] = { m_ID, arena };
+		s_ThreadArenaCacheNext = (s_ThreadArenaCacheNext + 1) % s_ThreadArenaCacheSize;
+		return *arena;
+	}
+
+	void* FrameArena::Allocate(size_t size, size_t alignment)
+	{
+		return GetThreadArena().Allocate(size, alignment);
+	}
+
+	const char* FrameArena::Format(const char* format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		va_list argsCopy;
+		va_copy(argsCopy, args);
+		int length = vsnprintf(nullptr, 0, format, args);
+		va_end(args);
+
+		if (length < 0)
+		{
+			va_end(argsCopy);
+			return "";
+		}
+
+		char* buffer = AllocateArray<char>((size_t)length + 1);
+		vsnprintf(buffer, (size_t)length + 1, format, argsCopy);
+		va_end(argsCopy);
+		return buffer;
+	}
+
+	void FrameArena::Reset()
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		size_t used = 0;
+		for (auto& threadArena : m_ThreadArenas)
+		{
+			used += threadArena->Arena.GetUsedBytes();
+			threadArena->Arena.Reset();
+		}
+		m_LastFrameUsedBytes = used;
+	}
+
+	size_t FrameArena::GetUsedBytes() const
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		size_t used = 0;
+		for (auto& threadArena : m_ThreadArenas)
+			used += threadArena->Arena.GetUsedBytes();
+		return used;
+	}
+
+	size_t FrameArena::GetCapacity() const
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		size_t capacity = 0;
+		for (auto& threadArena : m_ThreadArenas)
+			capacity += threadArena->Arena.GetCapacity();
+		return capacity;
+	}
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Walnut {
+
+	// Single-threaded bump allocator over a chain of blocks. Reset rewinds it without freeing, and merges the
+	// blocks into one when it had to grow, so steady-state frames bump through a single block.
+	class LinearArena
+	{
+	public:
+		LinearArena(size_t blockSize);
+		~LinearArena();
+
+		LinearArena(const LinearArena&) = delete;
+		LinearArena& operator=(const LinearArena&) = delete;
+
+		void* Allocate(size_t size, size_t alignment);
+		void Reset();
+
+		// Readable from other threads
+		size_t GetUsedBytes() const { return m_UsedBytes.load(std::memory_order_relaxed); }
+		size_t GetCapacity() const { return m_Capacity.load(std::memory_order_relaxed); }
+	private:
+		void AddBlock(size_t size);
+	private:
+		struct Block
+		{
+			uint8_t* Memory;
+			size_t Size;
+		};
+
+		std::vector<Block> m_Blocks;
+		size_t m_CurrentBlock = 0;
+		size_t m_Offset = 0;
+		size_t m_BlockSize;
+
+		std::atomic<size_t> m_UsedBytes{ 0 };
+		std::atomic<size_t> m_Capacity{ 0 };
+	};
+
+	// Scratch memory for one frame: bump allocation, no frees, no fragmentation. Application owns one per frame in
+	// flight and resets it once that frame's fence has signaled, so memory from Application::GetFrameArena stays
+	// valid until the GPU is done with the frame. Destructors of what lives in it never run.
+	//
+	// Every thread allocates from its own sub-arena, created on first use, so job workers don't contend. Workers
+	// have to be done with the frame before it ends, and should be long-lived: sub-arenas are kept per thread.
+	class FrameArena
+	{
+	public:
+		static constexpr size_t DefaultBlockSize = 1024 * 1024;
+
+		FrameArena(size_t blockSize = DefaultBlockSize);
+		~FrameArena();
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+		// Uninitialized
+		template<typename T>
+		T* AllocateArray(size_t count)
+		{
+			return (T*)Allocate(sizeof(T) * count, alignof(T));
+		}
+
+		template<typename T, typename... Args>
+		T* New(Args&&... args)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Frame arena objects are never destroyed");
+			return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		// printf into the arena, e.g. for ImGui labels
+		const char* Format(const char* format, ...);
+
+		// Called by Application, no thread may allocate from the arena meanwhile
+		void Reset();
+
+		size_t GetUsedBytes() const;
+		size_t GetCapacity() const;
+		// Bytes used before the last Reset, i.e. by the last frame that ran in this arena
+		size_t GetLastFrameUsedBytes() const { return m_LastFrameUsedBytes; }
+	private:
+		LinearArena& GetThreadArena();
+	private:
+		struct ThreadArena
+		{
+			std::thread::id Thread;
+			LinearArena Arena;
+
+			ThreadArena(std::thread::id thread, size_t blockSize)
+				: Thread(thread), Arena(blockSize) {}
+		};
+
+		// Identifies the arena in the per-thread lookup cache, unlike its address it is never reused
+		uint64_t m_ID;
+		size_t m_BlockSize;
+		size_t m_LastFrameUsedBytes = 0;
+
+		mutable std::mutex m_Mutex;
+		std::vector<std::unique_ptr<ThreadArena>> m_ThreadArenas;
+	};
+
+	// STL allocator over a FrameArena, deallocate is a no-op:
+	//     FrameVector<Item> visible(Application::GetFrameArena());
+	template<typename T>
+	class FrameAllocator
+	{
+	public:
+		using value_type = T;
+
+		FrameAllocator(FrameArena& arena) noexcept
+			: m_Arena(&arena) {}
+
+		template<typename U>
+		FrameAllocator(const FrameAllocator<U>& other) noexcept
+			: m_Arena(other.GetArena()) {}
+
+		T* allocate(size_t count) { return m_Arena->AllocateArray<T>(count); }
+		void deallocate(T*, size_t) noexcept {}
+
+		FrameArena* GetArena() const noexcept { return m_Arena; }
+
+		template<typename U>
+		bool operator==(const FrameAllocator<U>& other) const noexcept { return m_Arena == other.GetArena(); }
+		template<typename U>
+		bool operator!=(const FrameAllocator<U>& other) const noexcept { return m_Arena != other.GetArena(); }
+	private:
+		FrameArena* m_Arena;
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+	using FrameString = std::basic_string<char, std::char_traits<char>, FrameAllocator<char>>;
+
+}
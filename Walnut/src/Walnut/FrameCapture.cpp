@@ -0,0 +1,565 @@
+#include "FrameCapture.h"
+
+#include "Application.h"
+#include "Timer.h"
+
+#include "imgui.h"
+#include "backends/imgui_impl_vulkan.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Walnut {
+
+	struct CaptureSlot
+	{
+		VkBuffer Buffer = nullptr;
+		VkDeviceMemory Memory = nullptr;
+		void* Mapped = nullptr;
+		uint64_t Frame = 0;
+	};
+
+	enum class CaptureSlotState
+	{
+		Free = 0, InFlight, Writing
+	};
+
+	struct CaptureState
+	{
+		FrameCaptureSpecification Specification;
+		uint32_t Width = 0, Height = 0;
+		bool SwapRedBlue = false;
+		bool Coherent = true;
+
+		VkImage Image = nullptr;
+		VkDeviceMemory ImageMemory = nullptr;
+		VkImageView ImageView = nullptr;
+		VkRenderPass RenderPass = nullptr;
+		VkFramebuffer Framebuffer = nullptr;
+
+		std::vector<CaptureSlot> Slots;
+		std::vector<CaptureSlotState> SlotStates; // Guarded by Mutex
+		std::vector<uint32_t> InFlight;           // Main thread only
+
+		FILE* File = nullptr;
+		std::vector<uint8_t> ConversionBuffer;    // Writer thread only
+
+		std::thread Writer;
+		std::mutex Mutex;
+		std::condition_variable Condition;
+		std::deque<uint32_t> WriteQueue;
+		bool StopWriter = false;
+
+		FrameCaptureStats Stats;                  // Guarded by Mutex
+		double TotalWriteMilliseconds = 0.0;
+	};
+
+	static CaptureState* s_Capture = nullptr;
+
+	namespace Utils {
+
+		static uint32_t GetVulkanMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits)
+		{
+			VkPhysicalDeviceMemoryProperties prop;
+			vkGetPhysicalDeviceMemoryProperties(Application::GetPhysicalDevice(), &prop);
+			for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
+			{
+				if ((prop.memoryTypes[i].propertyFlags & properties) == properties && type_bits & (1 << i))
+					return i;
+			}
+
+			return 0xffffffff;
+		}
+
+		static bool IsCapturableFormat(VkFormat format, bool& swapRedBlue)
+		{
+			switch (format)
+			{
+				case VK_FORMAT_B8G8R8A8_UNORM:
+				case VK_FORMAT_B8G8R8A8_SRGB:
+					swapRedBlue = true;
+					return true;
+				case VK_FORMAT_R8G8B8A8_UNORM:
+				case VK_FORMAT_R8G8B8A8_SRGB:
+					swapRedBlue = false;
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		// Same format, sample count and attachment as the main window's render pass, so ImGui's pipeline can be used with it
+		static VkRenderPass CreateCaptureRenderPass(VkFormat format)
+		{
+			VkAttachmentDescription attachment = {};
+			attachment.format = format;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+			VkAttachmentReference color_attachment = {};
+			color_attachment.attachment = 0;
+			color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+			VkSubpassDescription subpass = {};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = 1;
+			subpass.pColorAttachments = &color_attachment;
+
+			VkSubpassDependency dependencies[2] = {};
+			// The copy of the previous capture has to be done before this one overwrites the image
+			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[0].dstSubpass = 0;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[0].srcAccessMask = 0;
+			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			// And the copy right after has to see the rendered result
+			dependencies[1].srcSubpass = 0;
+			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+			VkRenderPassCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			info.attachmentCount = 1;
+			info.pAttachments = &attachment;
+			info.subpassCount = 1;
+			info.pSubpasses = &subpass;
+			info.dependencyCount = 2;
+			info.pDependencies = dependencies;
+
+			VkRenderPass renderPass;
+			VkResult err = vkCreateRenderPass(Application::GetDevice(), &info, Application::GetAllocator(), &renderPass);
+			check_vk_result(err);
+			return renderPass;
+		}
+
+		static void CreateCaptureTarget(CaptureState& capture, VkFormat format)
+		{
+			VkDevice device = Application::GetDevice();
+			VkResult err;
+
+			{
+				VkImageCreateInfo info = {};
+				info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+				info.imageType = VK_IMAGE_TYPE_2D;
+				info.format = format;
+				info.extent.width = capture.Width;
+				info.extent.height = capture.Height;
+				info.extent.depth = 1;
+				info.mipLevels = 1;
+				info.arrayLayers = 1;
+				info.samples = VK_SAMPLE_COUNT_1_BIT;
+				info.tiling = VK_IMAGE_TILING_OPTIMAL;
+				info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+				info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				err = vkCreateImage(device, &info, Application::GetAllocator(), &capture.Image);
+				check_vk_result(err);
+
+				VkMemoryRequirements req;
+				vkGetImageMemoryRequirements(device, capture.Image, &req);
+				VkMemoryAllocateInfo alloc_info = {};
+				alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+				alloc_info.allocationSize = req.size;
+				alloc_info.memoryTypeIndex = GetVulkanMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, req.memoryTypeBits);
+				err = vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &capture.ImageMemory);
+				check_vk_result(err);
+				err = vkBindImageMemory(device, capture.Image, capture.ImageMemory, 0);
+				check_vk_result(err);
+			}
+
+			{
+				VkImageViewCreateInfo info = {};
+				info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				info.image = capture.Image;
+				info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				info.format = format;
+				info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				info.subresourceRange.levelCount = 1;
+				info.subresourceRange.layerCount = 1;
+				err = vkCreateImageView(device, &info, Application::GetAllocator(), &capture.ImageView);
+				check_vk_result(err);
+			}
+
+			capture.RenderPass = CreateCaptureRenderPass(format);
+
+			{
+				VkFramebufferCreateInfo info = {};
+				info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+				info.renderPass = capture.RenderPass;
+				info.attachmentCount = 1;
+				info.pAttachments = &capture.ImageView;
+				info.width = capture.Width;
+				info.height = capture.Height;
+				info.layers = 1;
+				err = vkCreateFramebuffer(device, &info, Application::GetAllocator(), &capture.Framebuffer);
+				check_vk_result(err);
+			}
+		}
+
+		static void CreateCaptureSlots(CaptureState& capture)
+		{
+			VkDevice device = Application::GetDevice();
+			VkResult err;
+
+			VkDeviceSize size = (VkDeviceSize)capture.Width * capture.Height * 4;
+			capture.Slots.resize(capture.Specification.RingSize < 2 ? 2 : capture.Specification.RingSize);
+			capture.SlotStates.assign(capture.Slots.size(), CaptureSlotState::Free);
+
+			for (CaptureSlot& slot : capture.Slots)
+			{
+				VkBufferCreateInfo buffer_info = {};
+				buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				buffer_info.size = size;
+				buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+				buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				err = vkCreateBuffer(device, &buffer_info, Application::GetAllocator(), &slot.Buffer);
+				check_vk_result(err);
+
+				VkMemoryRequirements req;
+				vkGetBufferMemoryRequirements(device, slot.Buffer, &req);
+
+				// Cached memory for fast CPU reads
+				uint32_t memoryType = GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, req.memoryTypeBits);
+				if (memoryType == 0xffffffff)
+					memoryType = GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
+
+				VkPhysicalDeviceMemoryProperties prop;
+				vkGetPhysicalDeviceMemoryProperties(Application::GetPhysicalDevice(), &prop);
+				capture.Coherent = (prop.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+				VkMemoryAllocateInfo alloc_info = {};
+				alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+				alloc_info.allocationSize = req.size;
+				alloc_info.memoryTypeIndex = memoryType;
+				err = vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &slot.Memory);
+				check_vk_result(err);
+				err = vkBindBufferMemory(device, slot.Buffer, slot.Memory, 0);
+				check_vk_result(err);
+				err = vkMapMemory(device, slot.Memory, 0, VK_WHOLE_SIZE, 0, &slot.Mapped);
+				check_vk_result(err);
+			}
+		}
+
+		static void DestroyCaptureResources(CaptureState& capture)
+		{
+			VkDevice device = Application::GetDevice();
+
+			for (CaptureSlot& slot : capture.Slots)
+			{
+				vkDestroyBuffer(device, slot.Buffer, Application::GetAllocator());
+				vkFreeMemory(device, slot.Memory, Application::GetAllocator());
+			}
+			capture.Slots.clear();
+
+			vkDestroyFramebuffer(device, capture.Framebuffer, Application::GetAllocator());
+			vkDestroyRenderPass(device, capture.RenderPass, Application::GetAllocator());
+			vkDestroyImageView(device, capture.ImageView, Application::GetAllocator());
+			vkDestroyImage(device, capture.Image, Application::GetAllocator());
+			vkFreeMemory(device, capture.ImageMemory, Application::GetAllocator());
+		}
+
+		static inline uint8_t ClampToByte(int32_t value)
+		{
+			return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+		}
+
+		// Full range BT.601 (JFIF) in 16.16 fixed point, chroma averaged over 2x2 blocks
+		static void ConvertToYUV420(const uint8_t* rgba, uint32_t width, uint32_t height, bool swapRedBlue, uint8_t* y, uint8_t* u, uint8_t* v)
+		{
+			const uint32_t r = swapRedBlue ? 2 : 0, b = swapRedBlue ? 0 : 2;
+
+			for (uint32_t row = 0; row < height; row++)
+			{
+				const uint8_t* src = rgba + (size_t)row * width * 4;
+				uint8_t* dst = y + (size_t)row * width;
+				for (uint32_t x = 0; x < width; x++, src += 4)
+					dst[x] = ClampToByte((19595 * src[r] + 38470 * src[1] + 7471 * src[b] + 32768) >> 16);
+			}
+
+			uint32_t chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+			for (uint32_t row = 0; row < chromaHeight; row++)
+			{
+				uint32_t row0 = row * 2, row1 = row0 + 1 < height ? row0 + 1 : row0;
+				for (uint32_t x = 0; x < chromaWidth; x++)
+				{
+					uint32_t x0 = x * 2, x1 = x0 + 1 < width ? x0 + 1 : x0;
+					const uint8_t* p[4] =
+					{
+						rgba + ((size_t)row0 * width + x0) * 4, rgba + ((size_t)row0 * width + x1) * 4,
+						rgba + ((size_t)row1 * width + x0) * 4, rgba + ((size_t)row1 * width + x1) * 4
+					};
+					int32_t sumR = p[0][r] + p[1][r] + p[2][r] + p[3][r];
+					int32_t sumG = p[0][1] + p[1][1] + p[2][1] + p[3][1];
+					int32_t sumB = p[0][b] + p[1][b] + p[2][b] + p[3][b];
+
+					// Sums are 4x the average, so the coefficients are divided by 4 via the extra shift
+					u[(size_t)row * chromaWidth + x] = ClampToByte(128 + ((-11059 * sumR - 21709 * sumG + 32768 * sumB + (1 << 17)) >> 18));
+					v[(size_t)row * chromaWidth + x] = ClampToByte(128 + ((32768 * sumR - 27439 * sumG - 5329 * sumB + (1 << 17)) >> 18));
+				}
+			}
+		}
+
+		static size_t WriteFrame(CaptureState& capture, const uint8_t* pixels)
+		{
+			uint32_t width = capture.Width, height = capture.Height;
+
+			if (capture.Specification.Format == FrameCaptureFormat::Y4M)
+			{
+				size_t lumaSize = (size_t)width * height;
+				size_t chromaSize = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+				capture.ConversionBuffer.resize(lumaSize + chromaSize * 2);
+				uint8_t* y = capture.ConversionBuffer.data();
+				ConvertToYUV420(pixels, width, height, capture.SwapRedBlue, y, y + lumaSize, y + lumaSize + chromaSize);
+
+				fputs("FRAME\n", capture.File);
+				return fwrite(capture.ConversionBuffer.data(), 1, capture.ConversionBuffer.size(), capture.File) + 6;
+			}
+
+			size_t size = (size_t)width * height * 4;
+			if (capture.SwapRedBlue)
+			{
+				capture.ConversionBuffer.resize(size);
+				for (size_t i = 0; i < size; i += 4)
+				{
+					capture.ConversionBuffer[i + 0] = pixels[i + 2];
+					capture.ConversionBuffer[i + 1] = pixels[i + 1];
+					capture.ConversionBuffer[i + 2] = pixels[i + 0];
+					capture.ConversionBuffer[i + 3] = pixels[i + 3];
+				}
+				pixels = capture.ConversionBuffer.data();
+			}
+			return fwrite(pixels, 1, size, capture.File);
+		}
+
+		static void WriterThread(CaptureState* capture)
+		{
+			while (true)
+			{
+				uint32_t slotIndex;
+				{
+					std::unique_lock<std::mutex> lock(capture->Mutex);
+					capture->Condition.wait(lock, [capture]() { return !capture->WriteQueue.empty() || capture->StopWriter; });
+
+					// Drain everything before stopping
+					if (capture->WriteQueue.empty())
+						return;
+
+					slotIndex = capture->WriteQueue.front();
+					capture->WriteQueue.pop_front();
+				}
+
+				Timer timer;
+				CaptureSlot& slot = capture->Slots[slotIndex];
+				if (!capture->Coherent)
+				{
+					VkMappedMemoryRange range = {};
+					range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+					range.memory = slot.Memory;
+					range.size = VK_WHOLE_SIZE;
+					VkResult err = vkInvalidateMappedMemoryRanges(Application::GetDevice(), 1, &range);
+					check_vk_result(err);
+				}
+				size_t written = WriteFrame(*capture, (const uint8_t*)slot.Mapped);
+				float milliseconds = timer.ElapsedMillis();
+
+				std::scoped_lock<std::mutex> lock(capture->Mutex);
+				capture->SlotStates[slotIndex] = CaptureSlotState::Free;
+				capture->Stats.FramesWritten++;
+				capture->Stats.BytesWritten += written;
+				capture->TotalWriteMilliseconds += milliseconds;
+			}
+		}
+
+	}
+
+	bool FrameCapture::Start(const FrameCaptureSpecification& specification, VkFormat surfaceFormat, uint32_t width, uint32_t height)
+	{
+		if (s_Capture || width == 0 || height == 0)
+			return false;
+
+		bool swapRedBlue;
+		if (!Utils::IsCapturableFormat(surfaceFormat, swapRedBlue))
+		{
+			std::cerr << "[FrameCapture] Unsupported surface format " << surfaceFormat << "\n";
+			return false;
+		}
+
+		FILE* file = fopen(specification.OutputPath.c_str(), "wb");
+		if (!file)
+		{
+			std::cerr << "[FrameCapture] Could not open " << specification.OutputPath << "\n";
+			return false;
+		}
+
+		s_Capture = new CaptureState();
+		CaptureState& capture = *s_Capture;
+		capture.Specification = specification;
+		capture.Width = width;
+		capture.Height = height;
+		capture.SwapRedBlue = swapRedBlue;
+		capture.File = file;
+
+		// Frames are large, let the OS do the buffering
+		setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+		if (specification.Format == FrameCaptureFormat::Y4M)
+			fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, specification.FrameRate);
+
+		Utils::CreateCaptureTarget(capture, surfaceFormat);
+		Utils::CreateCaptureSlots(capture);
+
+		capture.Writer = std::thread(Utils::WriterThread, s_Capture);
+		return true;
+	}
+
+	void FrameCapture::Stop()
+	{
+		if (!s_Capture)
+			return;
+
+		CaptureState& capture = *s_Capture;
+		ProcessCompleted(UINT64_MAX);
+
+		{
+			std::scoped_lock<std::mutex> lock(capture.Mutex);
+			capture.StopWriter = true;
+		}
+		capture.Condition.notify_one();
+		capture.Writer.join();
+
+		fclose(capture.File);
+		Utils::DestroyCaptureResources(capture);
+
+		delete s_Capture;
+		s_Capture = nullptr;
+	}
+
+	bool FrameCapture::IsActive()
+	{
+		return s_Capture != nullptr;
+	}
+
+	FrameCaptureStats FrameCapture::GetStats()
+	{
+		if (!s_Capture)
+			return FrameCaptureStats();
+
+		std::scoped_lock<std::mutex> lock(s_Capture->Mutex);
+		FrameCaptureStats stats = s_Capture->Stats;
+		stats.WriterQueueDepth = (uint32_t)s_Capture->WriteQueue.size();
+		if (stats.FramesWritten)
+			stats.AverageWriteMilliseconds = (float)(s_Capture->TotalWriteMilliseconds / stats.FramesWritten);
+		return stats;
+	}
+
+	void FrameCapture::Record(VkCommandBuffer commandBuffer, ImDrawData* drawData, const VkClearValue& clearValue, uint32_t width, uint32_t height, uint64_t frameNumber)
+	{
+		if (!s_Capture)
+			return;
+
+		CaptureState& capture = *s_Capture;
+
+		// The output has a fixed size, frames of a resized window are left out
+		if (width != capture.Width || height != capture.Height)
+		{
+			std::scoped_lock<std::mutex> lock(capture.Mutex);
+			capture.Stats.FramesSkipped++;
+			return;
+		}
+
+		uint32_t slotIndex = (uint32_t)capture.Slots.size();
+		{
+			std::scoped_lock<std::mutex> lock(capture.Mutex);
+			for (uint32_t i = 0; i < (uint32_t)capture.SlotStates.size(); i++)
+			{
+				if (capture.SlotStates[i] == CaptureSlotState::Free)
+				{
+					capture.SlotStates[i] = CaptureSlotState::InFlight;
+					slotIndex = i;
+					break;
+				}
+			}
+
+			// Backpressure: never wait for the writer
+			if (slotIndex == (uint32_t)capture.Slots.size())
+			{
+				capture.Stats.FramesDropped++;
+				return;
+			}
+			capture.Stats.FramesCaptured++;
+		}
+
+		CaptureSlot& slot = capture.Slots[slotIndex];
+		slot.Frame = frameNumber;
+		capture.InFlight.push_back(slotIndex);
+
+		{
+			VkRenderPassBeginInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			info.renderPass = capture.RenderPass;
+			info.framebuffer = capture.Framebuffer;
+			info.renderArea.extent.width = width;
+			info.renderArea.extent.height = height;
+			info.clearValueCount = 1;
+			info.pClearValues = &clearValue;
+			vkCmdBeginRenderPass(commandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
+		}
+
+		ImGui_ImplVulkan_RenderDrawData(drawData, commandBuffer);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		VkBufferImageCopy region = {};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent.width = width;
+		region.imageExtent.height = height;
+		region.imageExtent.depth = 1;
+		vkCmdCopyImageToBuffer(commandBuffer, capture.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.Buffer, 1, &region);
+
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	}
+
+	void FrameCapture::ProcessCompleted(uint64_t completedFrame)
+	{
+		if (!s_Capture || s_Capture->InFlight.empty())
+			return;
+
+		CaptureState& capture = *s_Capture;
+		{
+			std::scoped_lock<std::mutex> lock(capture.Mutex);
+
+			// Recorded in frame order, so they complete in order as well
+			size_t completed = 0;
+			while (completed < capture.InFlight.size() && capture.Slots[capture.InFlight[completed]].Frame <= completedFrame)
+			{
+				uint32_t slotIndex = capture.InFlight[completed++];
+				capture.SlotStates[slotIndex] = CaptureSlotState::Writing;
+				capture.WriteQueue.push_back(slotIndex);
+			}
+			capture.InFlight.erase(capture.InFlight.begin(), capture.InFlight.begin() + completed);
+		}
+		capture.Condition.notify_one();
+	}
+
+}
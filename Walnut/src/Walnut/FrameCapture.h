@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include "vulkan/vulkan.h"
+
+struct ImDrawData;
+
+namespace Walnut {
+
+	enum class FrameCaptureFormat
+	{
+		// Tightly packed RGBA8 frames back to back, e.g.
+		// ffmpeg -f rawvideo -pixel_format rgba -video_size WxH -framerate 60 -i capture.raw
+		Raw = 0,
+		// YUV4MPEG2, 4:2:0 full range (C420jpeg), playable and convertible by most video tools
+		Y4M
+	};
+
+	struct FrameCaptureSpecification
+	{
+		std::string OutputPath = "capture.y4m";
+		FrameCaptureFormat Format = FrameCaptureFormat::Y4M;
+		// Only written into the Y4M header
+		uint32_t FrameRate = 60;
+		// Readback buffers shared by the GPU copies and the writer thread. When all of them are busy the
+		// frame is dropped instead of stalling the render loop.
+		uint32_t RingSize = 4;
+	};
+
+	struct FrameCaptureStats
+	{
+		uint64_t FramesCaptured = 0; // Copies recorded on the GPU
+		uint64_t FramesWritten = 0;
+		uint64_t FramesDropped = 0;  // No free ring buffer, the writer can't keep up
+		uint64_t FramesSkipped = 0;  // Window size differs from the size the capture started with
+		uint64_t BytesWritten = 0;
+		uint32_t WriterQueueDepth = 0;
+		float AverageWriteMilliseconds = 0.0f;
+	};
+
+	// Records the main window to disk. The swapchain images can't be copied from (the ImGui helpers create
+	// them as color attachments only), so the UI is rendered a second time into an offscreen image of the
+	// same format, which is copied into a ring of host-visible buffers and encoded by a writer thread.
+	// Driven by Application, see Application::StartCapture.
+	class FrameCapture
+	{
+	public:
+		static bool Start(const FrameCaptureSpecification& specification, VkFormat surfaceFormat, uint32_t width, uint32_t height);
+		// Device must be idle, waits for the writer to finish
+		static void Stop();
+		static bool IsActive();
+		static FrameCaptureStats GetStats();
+
+		// After the main render pass of the frame
+		static void Record(VkCommandBuffer commandBuffer, ImDrawData* drawData, const VkClearValue& clearValue, uint32_t width, uint32_t height, uint64_t frameNumber);
+		static void ProcessCompleted(uint64_t completedFrame);
+	};
+
+}
@@ -0,0 +1,211 @@
+#include "FrameStatistics.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace Walnut {
+
+	// Hitch detection needs a meaningful median first, and refreshes it this often
+	static constexpr uint32_t s_MedianRefreshFrames = 30;
+
+	namespace Utils {
+
+		static double Percentile(const std::vector<double>& sorted, double percentile)
+		{
+			if (sorted.empty())
+				return 0.0;
+
+			double rank = percentile * (double)(sorted.size() - 1);
+			size_t lower = (size_t)rank;
+			size_t upper = std::min(lower + 1, sorted.size() - 1);
+			return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - (double)lower);
+		}
+
+	}
+
+	FrameStatistics::FrameStatistics(const FrameStatisticsSpecification& specification)
+		: m_Specification(specification)
+	{
+		m_Specification.WindowSize = std::max(m_Specification.WindowSize, 1u);
+		m_Specification.HistogramBucketCount = std::max(m_Specification.HistogramBucketCount, 1u);
+		if (m_Specification.HistogramBucketMilliseconds <= 0.0f)
+			m_Specification.HistogramBucketMilliseconds = 1.0f;
+
+		m_Window.reserve(m_Specification.WindowSize);
+		m_MedianScratch.reserve(m_Specification.WindowSize);
+		m_Histogram.resize(m_Specification.HistogramBucketCount);
+		m_RecentHitches.reserve(m_Specification.MaxRecentHitches);
+	}
+
+	void FrameStatistics::AddFrame(uint64_t frameNanoseconds, uint64_t endTimeNanoseconds)
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		double milliseconds = (double)frameNanoseconds * 1e-6;
+
+		if (++m_FramesSinceMedian >= s_MedianRefreshFrames)
+		{
+			m_CachedMedianMilliseconds = GetMedianLocked();
+			m_FramesSinceMedian = 0;
+		}
+
+		bool hitch = m_Window.size() >= s_MedianRefreshFrames && m_CachedMedianMilliseconds > 0.0 &&
+			milliseconds >= m_CachedMedianMilliseconds * m_Specification.HitchFactor && milliseconds >= m_Specification.HitchMinimumMilliseconds;
+
+		Frame frame = { m_FrameCount++, endTimeNanoseconds, frameNanoseconds, hitch };
+		if (m_Window.size() < m_Specification.WindowSize)
+		{
+			m_Window.push_back(frame);
+		}
+		else
+		{
+			m_Window[m_WindowStart] = frame;
+			m_WindowStart = (m_WindowStart + 1) % m_Window.size();
+		}
+
+		size_t bucket = (size_t)(milliseconds / m_Specification.HistogramBucketMilliseconds);
+		m_Histogram[std::min(bucket, m_Histogram.size() - 1)]++;
+
+		if (hitch)
+		{
+			m_HitchCount++;
+			if (m_Specification.MaxRecentHitches > 0)
+			{
+				if (m_RecentHitches.size() >= m_Specification.MaxRecentHitches)
+					m_RecentHitches.erase(m_RecentHitches.begin());
+				m_RecentHitches.push_back({ frame.Index, endTimeNanoseconds, milliseconds, m_CachedMedianMilliseconds });
+			}
+		}
+	}
+
+	void FrameStatistics::Reset()
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		m_Window.clear();
+		m_WindowStart = 0;
+		std::fill(m_Histogram.begin(), m_Histogram.end(), 0);
+		m_RecentHitches.clear();
+		m_FrameCount = 0;
+		m_HitchCount = 0;
+		m_CachedMedianMilliseconds = 0.0;
+		m_FramesSinceMedian = 0;
+	}
+
+	double FrameStatistics::GetMedianLocked() const
+	{
+		if (m_Window.empty())
+			return 0.0;
+
+		std::vector<uint64_t>& nanoseconds = m_MedianScratch;
+		nanoseconds.clear();
+		for (const Frame& frame : m_Window)
+			nanoseconds.push_back(frame.Nanoseconds);
+
+		auto middle = nanoseconds.begin() + nanoseconds.size() / 2;
+		std::nth_element(nanoseconds.begin(), middle, nanoseconds.end());
+		return (double)*middle * 1e-6;
+	}
+
+	FrameStatisticsSummary FrameStatistics::GetSummary() const
+	{
+		FrameStatisticsSummary summary;
+		// Per thread, so repeated queries only allocate the first time
+		thread_local std::vector<double> milliseconds;
+		milliseconds.clear();
+		{
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+
+			summary.FrameCount = m_FrameCount;
+			summary.HitchCount = m_HitchCount;
+			summary.WindowFrames = (uint32_t)m_Window.size();
+			if (m_Window.empty())
+				return summary;
+
+			// Oldest first, jitter depends on the order
+			milliseconds.reserve(m_Window.size());
+			for (size_t i = 0; i < m_Window.size(); i++)
+				milliseconds.push_back((double)m_Window[(m_WindowStart + i) % m_Window.size()].Nanoseconds * 1e-6);
+		}
+
+		double sum = 0.0, jitter = 0.0;
+		for (size_t i = 0; i < milliseconds.size(); i++)
+		{
+			sum += milliseconds[i];
+			if (i > 0)
+				jitter += fabs(milliseconds[i] - milliseconds[i - 1]);
+		}
+		summary.MeanMilliseconds = sum / (double)milliseconds.size();
+		summary.JitterMilliseconds = milliseconds.size() > 1 ? jitter / (double)(milliseconds.size() - 1) : 0.0;
+
+		double squares = 0.0;
+		for (double value : milliseconds)
+			squares += (value - summary.MeanMilliseconds) * (value - summary.MeanMilliseconds);
+		summary.StdDevMilliseconds = sqrt(squares / (double)milliseconds.size());
+
+		std::sort(milliseconds.begin(), milliseconds.end());
+		summary.MinMilliseconds = milliseconds.front();
+		summary.MaxMilliseconds = milliseconds.back();
+		summary.P50Milliseconds = Utils::Percentile(milliseconds, 0.50);
+		summary.P95Milliseconds = Utils::Percentile(milliseconds, 0.95);
+		summary.P99Milliseconds = Utils::Percentile(milliseconds, 0.99);
+		return summary;
+	}
+
+	std::vector<uint64_t> FrameStatistics::GetHistogram() const
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+		return m_Histogram;
+	}
+
+	std::vector<FrameHitch> FrameStatistics::GetRecentHitches() const
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+		return m_RecentHitches;
+	}
+
+	std::vector<float> FrameStatistics::GetFrameTimesMilliseconds() const
+	{
+		std::vector<float> milliseconds;
+		GetFrameTimesMilliseconds(milliseconds);
+		return milliseconds;
+	}
+
+	void FrameStatistics::GetFrameTimesMilliseconds(std::vector<float>& milliseconds) const
+	{
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		milliseconds.resize(m_Window.size());
+		for (size_t i = 0; i < m_Window.size(); i++)
+			milliseconds[i] = (float)((double)m_Window[(m_WindowStart + i) % m_Window.size()].Nanoseconds * 1e-6);
+	}
+
+	bool FrameStatistics::ExportCSV(const std::string& path) const
+	{
+		std::vector<Frame> frames;
+		{
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+			frames.reserve(m_Window.size());
+			for (size_t i = 0; i < m_Window.size(); i++)
+				frames.push_back(m_Window[(m_WindowStart + i) % m_Window.size()]);
+		}
+
+		std::ofstream stream(path, std::ios::trunc);
+		if (!stream)
+		{
+			std::cerr << "[FRAME STATISTICS] Could not write " << path << "\n";
+			return false;
+		}
+
+		stream << "frame,end_time_ns,frame_ms,hitch\n";
+		stream.precision(6);
+		stream << std::fixed;
+		for (const Frame& frame : frames)
+			stream << frame.Index << "," << frame.EndTimeNanoseconds << "," << (double)frame.Nanoseconds * 1e-6 << "," << (frame.Hitch ? 1 : 0) << "\n";
+		return true;
+	}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Walnut {
+
+	struct FrameStatisticsSpecification
+	{
+		// Frames the rolling percentiles, jitter and CSV export cover
+		uint32_t WindowSize = 600;
+
+		// A frame is a hitch when it takes this many times the rolling median, and at least HitchMinimumMilliseconds
+		float HitchFactor = 2.0f;
+		float HitchMinimumMilliseconds = 8.0f;
+		uint32_t MaxRecentHitches = 64;
+
+		// Histogram over all frames since the last Reset, the last bucket collects everything above
+		float HistogramBucketMilliseconds = 1.0f;
+		uint32_t HistogramBucketCount = 100;
+	};
+
+	struct FrameStatisticsSummary
+	{
+		uint64_t FrameCount = 0;   // Since the last Reset
+		uint32_t WindowFrames = 0; // Frames the values below are computed from
+
+		double MeanMilliseconds = 0.0;
+		double MinMilliseconds = 0.0, MaxMilliseconds = 0.0;
+		double P50Milliseconds = 0.0, P95Milliseconds = 0.0, P99Milliseconds = 0.0;
+		double StdDevMilliseconds = 0.0;
+		// Mean absolute difference between consecutive frame times
+		double JitterMilliseconds = 0.0;
+
+		uint64_t HitchCount = 0;   // Since the last Reset
+	};
+
+	struct FrameHitch
+	{
+		uint64_t Frame = 0;
+		uint64_t TimeNanoseconds = 0; // Clock::GetNanoseconds() at the end of the frame
+		double Milliseconds = 0.0;
+		double MedianMilliseconds = 0.0;
+	};
+
+	// Rolling frame-time statistics, fed once per frame by Application (see Application::GetFrameStatistics).
+	// Queries copy under a lock, so they can come from any thread.
+	class FrameStatistics
+	{
+	public:
+		FrameStatistics(const FrameStatisticsSpecification& specification = FrameStatisticsSpecification());
+
+		void AddFrame(uint64_t frameNanoseconds, uint64_t endTimeNanoseconds);
+		void Reset();
+
+		// Sorts a copy of the window, so not free; once per frame for an overlay is fine
+		FrameStatisticsSummary GetSummary() const;
+		std::vector<uint64_t> GetHistogram() const;
+		std::vector<FrameHitch> GetRecentHitches() const;
+		// Oldest first
+		std::vector<float> GetFrameTimesMilliseconds() const;
+		// Reuses the caller's vector, so a UI drawing it every frame doesn't allocate
+		void GetFrameTimesMilliseconds(std::vector<float>& milliseconds) const;
+
+		// One row per frame of the window: frame, end time, milliseconds, whether it was a hitch
+		bool ExportCSV(const std::string& path) const;
+
+		const FrameStatisticsSpecification& GetSpecification() const { return m_Specification; }
+	private:
+		double GetMedianLocked() const;
+	private:
+		FrameStatisticsSpecification m_Specification;
+
+		struct Frame
+		{
+			uint64_t Index;
+			uint64_t EndTimeNanoseconds;
+			uint64_t Nanoseconds;
+			bool Hitch;
+		};
+
+		// Ring buffer of the last WindowSize frames
+		std::vector<Frame> m_Window;
+		size_t m_WindowStart = 0;
+
+		std::vector<uint64_t> m_Histogram;
+		std::vector<FrameHitch> m_RecentHitches;
+		uint64_t m_FrameCount = 0;
+		uint64_t m_HitchCount = 0;
+
+		// Median used for hitch detection, refreshed every few frames rather than sorted every frame
+		double m_CachedMedianMilliseconds = 0.0;
+		uint32_t m_FramesSinceMedian = 0;
+		// AddFrame runs in the zero-allocation part of the frame
+		mutable std::vector<uint64_t> m_MedianScratch;
+
+		mutable std::mutex m_Mutex;
+	};
+
+}
@@ -4,14 +4,52 @@
 #include "backends/imgui_impl_vulkan.h"
 
 #include "Application.h"
+#include "AsyncFileReader.h"
+#include "DescriptorAllocator.h"
+#include "Metrics.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
+#include <iostream>
+#include <limits.h>
+
 namespace Walnut {
 
+	// Images with KeepCapacity waiting to shrink, main thread only
+	static std::vector<Image*> s_ShrinkPending;
+
 	namespace Utils {
 
+		struct ImageMetrics
+		{
+			MetricCounter& UploadBytes;
+			MetricCounter& Uploads;
+			MetricHistogram& UploadSeconds;
+			MetricGauge& MemoryBytes;
+		};
+
+		static ImageMetrics& GetImageMetrics()
+		{
+			static ImageMetrics s_Metrics = {
+				Metrics::GetCounter("walnut_image_upload_bytes_total", "Bytes uploaded by Image::SetData"),
+				Metrics::GetCounter("walnut_image_uploads_total", "Calls to Image::SetData"),
+				Metrics::GetHistogram("walnut_image_upload_seconds", "Duration of Image::SetData, including the wait for the GPU copy",
+					{ 0.0001, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1 }),
+				Metrics::GetGauge("walnut_image_memory_bytes", "Device memory of live images and their staging buffers")
+			};
+			return s_Metrics;
+		}
+
+		static void RecordUpload(size_t bytes, uint64_t startNanoseconds)
+		{
+			ImageMetrics& metrics = GetImageMetrics();
+			metrics.UploadBytes.Increment(bytes);
+			metrics.Uploads.Increment();
+			metrics.UploadSeconds.Observe((double)(Clock::GetNanoseconds() - startNanoseconds) * 1e-9);
+		}
+
 		static uint32_t GetVulkanMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits)
 		{
 			VkPhysicalDeviceMemoryProperties prop;
@@ -25,24 +63,89 @@ namespace Walnut {
 			return 0xffffffff;
 		}
 
-		static uint32_t BytesPerPixel(ImageFormat format)
+		// Memory that is both device-local and host-visible, and not just a small BAR window
+		static bool HasHostVisibleDeviceMemory()
 		{
-			switch (format)
+			static int s_HasHostVisibleDeviceMemory = -1;
+			if (s_HasHostVisibleDeviceMemory < 0)
 			{
-				case ImageFormat::RGBA:    return 4;
-				case ImageFormat::RGBA32F: return 16;
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(Application::GetPhysicalDevice(), &properties);
+				VkPhysicalDeviceMemoryProperties memoryProperties;
+				vkGetPhysicalDeviceMemoryProperties(Application::GetPhysicalDevice(), &memoryProperties);
+
+				VkDeviceSize largestDeviceLocalHeap = 0, largestHostVisibleHeap = 0;
+				for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+				{
+					VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+					VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+					if (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+						largestDeviceLocalHeap = glm::max(largestDeviceLocalHeap, heapSize);
+					if ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+						largestHostVisibleHeap = glm::max(largestHostVisibleHeap, heapSize);
+				}
+
+				bool unified = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+				s_HasHostVisibleDeviceMemory = largestHostVisibleHeap > 0 && (unified || largestHostVisibleHeap == largestDeviceLocalHeap);
 			}
-			return 0;
+			return s_HasHostVisibleDeviceMemory;
 		}
-		
-		static VkFormat WalnutFormatToVulkanFormat(ImageFormat format)
+
+		static uint32_t GetMaxImageDimension2D()
+		{
+			static uint32_t s_MaxImageDimension2D = 0;
+			if (!s_MaxImageDimension2D)
+			{
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(Application::GetPhysicalDevice(), &properties);
+				s_MaxImageDimension2D = properties.limits.maxImageDimension2D;
+			}
+			return s_MaxImageDimension2D;
+		}
+
+		static VkImageUsageFlags WalnutUsageToVulkanUsage(ImageUsageFlags usage)
+		{
+			VkImageUsageFlags flags = 0;
+			if (usage & ImageUsage_Sampled) flags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+			if (usage & ImageUsage_Storage) flags |= VK_IMAGE_USAGE_STORAGE_BIT;
+			if (usage & ImageUsage_ColorAttachment) flags |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+			return flags;
+		}
+
+		// Accesses that have to complete before leaving, or wait after entering, a layout
+		static void GetLayoutAccess(VkImageLayout layout, VkAccessFlags& access, VkPipelineStageFlags& stage)
 		{
-			switch (format)
+			switch (layout)
 			{
-				case ImageFormat::RGBA:    return VK_FORMAT_R8G8B8A8_UNORM;
-				case ImageFormat::RGBA32F: return VK_FORMAT_R32G32B32A32_SFLOAT;
+				case VK_IMAGE_LAYOUT_UNDEFINED:
+					access = 0;
+					stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+					return;
+				case VK_IMAGE_LAYOUT_PREINITIALIZED:
+					access = VK_ACCESS_HOST_WRITE_BIT;
+					stage = VK_PIPELINE_STAGE_HOST_BIT;
+					return;
+				case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+					access = VK_ACCESS_TRANSFER_WRITE_BIT;
+					stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+					return;
+				case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+					access = VK_ACCESS_TRANSFER_READ_BIT;
+					stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+					return;
+				case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+					access = VK_ACCESS_SHADER_READ_BIT;
+					stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+					return;
+				case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+					access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+					stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+					return;
+				default:
+					access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+					stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+					return;
 			}
-			return (VkFormat)0;
 		}
 
 	}
@@ -64,52 +167,111 @@ namespace Walnut {
 			m_Format = ImageFormat::RGBA;
 		}
 
-		m_Width = width;
-		m_Height = height;
+		m_Width = m_AllocatedWidth = width;
+		m_Height = m_AllocatedHeight = height;
 		
-		AllocateMemory(m_Width * m_Height * Utils::BytesPerPixel(m_Format));
+		AllocateMemory();
 		SetData(data);
 		stbi_image_free(data);
 	}
 
+	void Image::LoadAsync(std::string_view path, std::function<void(std::shared_ptr<Image>)>&& callback)
+	{
+		auto completion = std::make_shared<std::function<void(std::shared_ptr<Image>)>>(std::move(callback));
+		AsyncFileReader::Read(path, [completion](FileReadResult&& file)
+		{
+			// Worker thread: decode
+			int width = 0, height = 0, channels;
+			void* data = nullptr;
+			ImageFormat format = ImageFormat::RGBA;
+			if (file.Success && file.Data.size() <= INT_MAX)
+			{
+				const stbi_uc* buffer = file.Data.data();
+				int size = (int)file.Data.size();
+				if (stbi_is_hdr_from_memory(buffer, size))
+				{
+					data = stbi_loadf_from_memory(buffer, size, &width, &height, &channels, 4);
+					format = ImageFormat::RGBA32F;
+				}
+				else
+				{
+					data = stbi_load_from_memory(buffer, size, &width, &height, &channels, 4);
+				}
+			}
+
+			if (!data)
+				std::cerr << "[Image] Could not load " << file.Path << (file.Success ? "" : ": " + file.Error) << std::endl;
+
+			// Main thread: upload
+			std::shared_ptr<void> pixels(data, [](void* pixels) { stbi_image_free(pixels); });
+			std::string filepath = std::move(file.Path);
+			Application::SubmitToMainThread([completion, pixels, width, height, format, filepath]()
+			{
+				if (!pixels)
+				{
+					(*completion)(nullptr);
+					return;
+				}
+
+				auto image = std::make_shared<Image>(width, height, format, pixels.get());
+				image->m_Filepath = filepath;
+				(*completion)(image);
+			});
+		});
+	}
+
 	Image::Image(uint32_t width, uint32_t height, ImageFormat format, const void* data)
-		: m_Width(width), m_Height(height), m_Format(format)
+		: m_Width(width), m_Height(height), m_AllocatedWidth(width), m_AllocatedHeight(height), m_Format(format)
 	{
-		AllocateMemory(m_Width * m_Height * Utils::BytesPerPixel(m_Format));
+		AllocateMemory();
+		if (data)
+			SetData(data);
+	}
+
+	Image::Image(const ImageSpecification& specification, const void* data)
+		: m_Width(specification.Width), m_Height(specification.Height), m_AllocatedWidth(specification.Width), m_AllocatedHeight(specification.Height),
+		m_Format(specification.Format), m_Usage(specification.Usage), m_PreferHostVisible(specification.PreferHostVisible)
+	{
+		AllocateMemory();
 		if (data)
 			SetData(data);
 	}
 
 	Image::~Image()
 	{
+		SetShrinkPending(false);
 		Release();
 	}
 
-	void Image::AllocateMemory(uint64_t size)
+	void Image::AllocateMemory()
 	{
 		VkDevice device = Application::GetDevice();
 
 		VkResult err;
 		
-		VkFormat vulkanFormat = Utils::WalnutFormatToVulkanFormat(m_Format);
+		VkFormat vulkanFormat = GetVulkanFormat(m_Format);
 
 		// Create the Image
+		if (!m_PreferHostVisible || !AllocateHostVisibleMemory(vulkanFormat))
 		{
+			m_Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			m_ShaderReadLayout = (m_Usage & ImageUsage_Storage) ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
 			VkImageCreateInfo info = {};
 			info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 			info.imageType = VK_IMAGE_TYPE_2D;
 			info.format = vulkanFormat;
-			info.extent.width = m_Width;
-			info.extent.height = m_Height;
+			info.extent.width = m_AllocatedWidth;
+			info.extent.height = m_AllocatedHeight;
 			info.extent.depth = 1;
 			info.mipLevels = 1;
 			info.arrayLayers = 1;
 			info.samples = VK_SAMPLE_COUNT_1_BIT;
 			info.tiling = VK_IMAGE_TILING_OPTIMAL;
-			info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			info.usage = Utils::WalnutUsageToVulkanUsage(m_Usage) | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 			info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			err = vkCreateImage(device, &info, nullptr, &m_Image);
+			err = vkCreateImage(device, &info, Application::GetAllocator(), &m_Image);
 			check_vk_result(err);
 			VkMemoryRequirements req;
 			vkGetImageMemoryRequirements(device, m_Image, &req);
@@ -117,10 +279,21 @@ namespace Walnut {
 			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 			alloc_info.allocationSize = req.size;
 			alloc_info.memoryTypeIndex = Utils::GetVulkanMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, req.memoryTypeBits);
-			err = vkAllocateMemory(device, &alloc_info, nullptr, &m_Memory);
+			err = vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &m_Memory);
 			check_vk_result(err);
 			err = vkBindImageMemory(device, m_Image, m_Memory, 0);
 			check_vk_result(err);
+			m_MemorySize = req.size;
+			Utils::GetImageMetrics().MemoryBytes.Add((double)req.size);
+
+			// Storage images have to be in GENERAL before the first dispatch writes them, and render targets
+			// have to be in their sampled layout in case ImGui shows them before anything was rendered
+			if (m_Usage & (ImageUsage_Storage | ImageUsage_ColorAttachment))
+			{
+				VkCommandBuffer command_buffer = Application::GetCommandBuffer(true);
+				TransitionLayout(command_buffer, m_ShaderReadLayout);
+				Application::FlushCommandBuffer(command_buffer);
+			}
 		}
 
 		// Create the Image View:
@@ -133,7 +306,7 @@ namespace Walnut {
 			info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			info.subresourceRange.levelCount = 1;
 			info.subresourceRange.layerCount = 1;
-			err = vkCreateImageView(device, &info, nullptr, &m_ImageView);
+			err = vkCreateImageView(device, &info, Application::GetAllocator(), &m_ImageView);
 			check_vk_result(err);
 		}
 
@@ -150,55 +323,332 @@ namespace Walnut {
 			info.minLod = -1000;
 			info.maxLod = 1000;
 			info.maxAnisotropy = 1.0f;
-			VkResult err = vkCreateSampler(device, &info, nullptr, &m_Sampler);
+			VkResult err = vkCreateSampler(device, &info, Application::GetAllocator(), &m_Sampler);
 			check_vk_result(err);
 		}
 
+		if (m_Usage & ImageUsage_ColorAttachment)
+			CreateRenderTarget(vulkanFormat);
+
 		// Create the Descriptor Set:
-		m_DescriptorSet = (VkDescriptorSet)ImGui_ImplVulkan_AddTexture(m_Sampler, m_ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		m_DescriptorSet = DescriptorAllocator::AllocateTexture(m_Sampler, m_ImageView, m_ShaderReadLayout);
 	}
 
-	void Image::Release()
+	void Image::CreateRenderTarget(VkFormat format)
 	{
-		Application::SubmitResourceFree([sampler = m_Sampler, imageView = m_ImageView, image = m_Image,
-			memory = m_Memory, stagingBuffer = m_StagingBuffer, stagingBufferMemory = m_StagingBufferMemory]()
+		VkDevice device = Application::GetDevice();
+
+		VkResult err;
+
+		// Create the Render Passes:
+		for (VkAttachmentLoadOp loadOp : { VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_LOAD_OP_LOAD })
 		{
-			VkDevice device = Application::GetDevice();
-
-			vkDestroySampler(device, sampler, nullptr);
-			vkDestroyImageView(device, imageView, nullptr);
-			vkDestroyImage(device, image, nullptr);
-			vkFreeMemory(device, memory, nullptr);
-			vkDestroyBuffer(device, stagingBuffer, nullptr);
-			vkFreeMemory(device, stagingBufferMemory, nullptr);
-		});
+			VkAttachmentDescription attachment = {};
+			attachment.format = format;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = loadOp;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR ? VK_IMAGE_LAYOUT_UNDEFINED : m_ShaderReadLayout;
+			attachment.finalLayout = m_ShaderReadLayout;
+
+			VkAttachmentReference color_attachment = {};
+			color_attachment.attachment = 0;
+			color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			VkSubpassDescription subpass = {};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = 1;
+			subpass.pColorAttachments = &color_attachment;
+
+			// Wait for earlier writes and reads of the image (uploads, compute, last frame's sampling), and make the
+			// output visible to everything that reads it later in the frame
+			VkSubpassDependency dependencies[2] = {};
+			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[0].dstSubpass = 0;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].srcSubpass = 0;
+			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+			VkRenderPassCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			info.attachmentCount = 1;
+			info.pAttachments = &attachment;
+			info.subpassCount = 1;
+			info.pSubpasses = &subpass;
+			info.dependencyCount = 2;
+			info.pDependencies = dependencies;
+			err = vkCreateRenderPass(device, &info, Application::GetAllocator(), loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR ? &m_RenderPass : &m_LoadRenderPass);
+			check_vk_result(err);
+		}
+
+		// Create the Framebuffer:
+		{
+			VkFramebufferCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			info.renderPass = m_RenderPass;
+			info.attachmentCount = 1;
+			info.pAttachments = &m_ImageView;
+			info.width = m_AllocatedWidth;
+			info.height = m_AllocatedHeight;
+			info.layers = 1;
+			err = vkCreateFramebuffer(device, &info, Application::GetAllocator(), &m_Framebuffer);
+			check_vk_result(err);
+		}
+	}
+
+	bool Image::AllocateHostVisibleMemory(VkFormat format)
+	{
+		if (!Utils::HasHostVisibleDeviceMemory())
+			return false;
+
+		VkDevice device = Application::GetDevice();
+
+		// Linear tiling is what makes the memory layout known to the CPU, not every format/size supports it
+		VkImageUsageFlags usage = Utils::WalnutUsageToVulkanUsage(m_Usage) | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		VkImageFormatProperties formatProperties;
+		VkResult err = vkGetPhysicalDeviceImageFormatProperties(Application::GetPhysicalDevice(), format, VK_IMAGE_TYPE_2D,
+			VK_IMAGE_TILING_LINEAR, usage, 0, &formatProperties);
+		if (err != VK_SUCCESS || formatProperties.maxExtent.width < m_AllocatedWidth || formatProperties.maxExtent.height < m_AllocatedHeight)
+			return false;
+
+		VkImageCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		info.imageType = VK_IMAGE_TYPE_2D;
+		info.format = format;
+		info.extent.width = m_AllocatedWidth;
+		info.extent.height = m_AllocatedHeight;
+		info.extent.depth = 1;
+		info.mipLevels = 1;
+		info.arrayLayers = 1;
+		info.samples = VK_SAMPLE_COUNT_1_BIT;
+		info.tiling = VK_IMAGE_TILING_LINEAR;
+		info.usage = usage;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		info.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+		err = vkCreateImage(device, &info, Application::GetAllocator(), &m_Image);
+		if (err != VK_SUCCESS)
+			return false;
+
+		VkMemoryRequirements req;
+		vkGetImageMemoryRequirements(device, m_Image, &req);
+
+		VkMemoryPropertyFlags hostVisibleDeviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		m_MemoryCoherent = true;
+		uint32_t memoryType = Utils::GetVulkanMemoryType(hostVisibleDeviceLocal | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+		if (memoryType == 0xffffffff)
+		{
+			m_MemoryCoherent = false;
+			memoryType = Utils::GetVulkanMemoryType(hostVisibleDeviceLocal, req.memoryTypeBits);
+		}
+
+		VkMemoryAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = req.size;
+		alloc_info.memoryTypeIndex = memoryType;
+		if (memoryType == 0xffffffff || vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &m_Memory) != VK_SUCCESS)
+		{
+			vkDestroyImage(device, m_Image, Application::GetAllocator());
+			m_Image = nullptr;
+			return false;
+		}
+
+		err = vkBindImageMemory(device, m_Image, m_Memory, 0);
+		check_vk_result(err);
+		m_MemorySize = req.size;
+		Utils::GetImageMetrics().MemoryBytes.Add((double)req.size);
+		err = vkMapMemory(device, m_Memory, 0, VK_WHOLE_SIZE, 0, &m_MappedData);
+		check_vk_result(err);
+
+		VkImageSubresource subresource = {};
+		subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		VkSubresourceLayout layout;
+		vkGetImageSubresourceLayout(device, m_Image, &subresource, &layout);
+		m_MappedData = (uint8_t*)m_MappedData + layout.offset;
+		m_RowPitch = layout.rowPitch;
+
+		// GENERAL allows both host writes and sampling, so this is the only transition the image ever needs
+		m_Layout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+		m_ShaderReadLayout = VK_IMAGE_LAYOUT_GENERAL;
+		{
+			VkCommandBuffer command_buffer = Application::GetCommandBuffer(true);
+			TransitionLayout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
+			Application::FlushCommandBuffer(command_buffer);
+		}
+
+		return true;
+	}
+
+	void Image::FlushMappedData()
+	{
+		if (!m_MappedData || m_MemoryCoherent)
+			return;
+
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = m_Memory;
+		range.size = VK_WHOLE_SIZE;
+		VkResult err = vkFlushMappedMemoryRanges(Application::GetDevice(), 1, &range);
+		check_vk_result(err);
+	}
 
+	void Image::Release()
+	{
+		DescriptorAllocator::FreeTexture(m_DescriptorSet);
+
+		// Counted as freed right away, the deletion queue reports what is still pending
+		Utils::GetImageMetrics().MemoryBytes.Add(-(double)(m_MemorySize + (m_StagingBufferMemory ? m_AlignedSize : 0)));
+		m_MemorySize = 0;
+
+		DeletionQueue& deletionQueue = Application::GetDeletionQueue();
+		deletionQueue.Push(m_Framebuffer);
+		deletionQueue.Push(m_RenderPass);
+		deletionQueue.Push(m_LoadRenderPass);
+		deletionQueue.Push(m_Sampler);
+		deletionQueue.Push(m_ImageView);
+		deletionQueue.Push(m_Image);
+		deletionQueue.Push(m_Memory);
+		deletionQueue.Push(m_StagingBuffer);
+		deletionQueue.Push(m_StagingBufferMemory);
+
+		m_Framebuffer = nullptr;
+		m_RenderPass = nullptr;
+		m_LoadRenderPass = nullptr;
 		m_Sampler = nullptr;
 		m_ImageView = nullptr;
 		m_Image = nullptr;
 		m_Memory = nullptr;
 		m_StagingBuffer = nullptr;
 		m_StagingBufferMemory = nullptr;
+		m_DescriptorSet = nullptr;
+
+		// Freeing the memory implicitly unmaps it
+		m_MappedData = nullptr;
+		m_RowPitch = 0;
+		m_Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+
+	void Image::TransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout newLayout)
+	{
+		if (newLayout == m_Layout && newLayout != VK_IMAGE_LAYOUT_GENERAL)
+			return;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = m_Layout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = m_Image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+
+		VkPipelineStageFlags srcStage, dstStage;
+		Utils::GetLayoutAccess(m_Layout, barrier.srcAccessMask, srcStage);
+		Utils::GetLayoutAccess(newLayout, barrier.dstAccessMask, dstStage);
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+		m_Layout = newLayout;
+	}
+
+	void Image::BeginRenderPass(VkCommandBuffer commandBuffer, const glm::vec4& clearColor)
+	{
+		VkClearValue clearValue = {};
+		clearValue.color.float32[0] = clearColor.r;
+		clearValue.color.float32[1] = clearColor.g;
+		clearValue.color.float32[2] = clearColor.b;
+		clearValue.color.float32[3] = clearColor.a;
+		BeginRenderPass(commandBuffer, m_RenderPass, &clearValue);
+	}
+
+	void Image::BeginRenderPass(VkCommandBuffer commandBuffer)
+	{
+		// The load variant expects the image in the layout the last pass left it in
+		TransitionLayout(commandBuffer, m_ShaderReadLayout);
+		BeginRenderPass(commandBuffer, m_LoadRenderPass, nullptr);
+	}
+
+	void Image::BeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, const VkClearValue* clearValue)
+	{
+		IM_ASSERT(m_Framebuffer && "Image was not created with ImageUsage_ColorAttachment");
+
+		VkRenderPassBeginInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		info.renderPass = renderPass;
+		info.framebuffer = m_Framebuffer;
+		info.renderArea.extent.width = m_Width;
+		info.renderArea.extent.height = m_Height;
+		info.clearValueCount = clearValue ? 1 : 0;
+		info.pClearValues = clearValue;
+		vkCmdBeginRenderPass(commandBuffer, &info, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = {};
+		viewport.width = (float)m_Width;
+		viewport.height = (float)m_Height;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = {};
+		scissor.extent.width = m_Width;
+		scissor.extent.height = m_Height;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	void Image::EndRenderPass(VkCommandBuffer commandBuffer)
+	{
+		vkCmdEndRenderPass(commandBuffer);
+		m_Layout = m_ShaderReadLayout;
 	}
 
 	void Image::SetData(const void* data)
 	{
-		VkDevice device = Application::GetDevice();
+		VisitPixelFormat(m_Format, [&](auto traits)
+		{
+			using Pixel = typename decltype(traits)::Pixel;
+			SetData(ImageView<const Pixel>((const Pixel*)data, m_Width, m_Height));
+		});
+	}
+
+	bool Image::BeginUpload(uint32_t width, uint32_t height, UploadTarget& target)
+	{
+		if (width != m_Width || height != m_Height)
+		{
+			std::cerr << "[Image] SetData with " << width << "x" << height << " pixels for a " << m_Width << "x" << m_Height << " image, skipped" << std::endl;
+			return false;
+		}
 
-		size_t upload_size = m_Width * m_Height * Utils::BytesPerPixel(m_Format);
+		target.StartTime = Clock::GetNanoseconds();
 
+		if (m_MappedData)
+		{
+			// Zero-copy: write straight into the image
+			target.Data = (uint8_t*)m_MappedData;
+			target.RowPitch = m_RowPitch;
+			return true;
+		}
+
+		VkDevice device = Application::GetDevice();
 		VkResult err;
 
 		if (!m_StagingBuffer)
 		{
 			// Create the Upload Buffer
 			{
+				// Sized for the whole allocation so it survives resizes within capacity
 				VkBufferCreateInfo buffer_info = {};
 				buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-				buffer_info.size = upload_size;
+				buffer_info.size = (VkDeviceSize)m_AllocatedWidth * m_AllocatedHeight * GetBytesPerPixel(m_Format);
 				buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 				buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-				err = vkCreateBuffer(device, &buffer_info, nullptr, &m_StagingBuffer);
+				err = vkCreateBuffer(device, &buffer_info, Application::GetAllocator(), &m_StagingBuffer);
 				check_vk_result(err);
 				VkMemoryRequirements req;
 				vkGetBufferMemoryRequirements(device, m_StagingBuffer, &req);
@@ -207,20 +657,38 @@ namespace Walnut {
 				alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 				alloc_info.allocationSize = req.size;
 				alloc_info.memoryTypeIndex = Utils::GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
-				err = vkAllocateMemory(device, &alloc_info, nullptr, &m_StagingBufferMemory);
+				err = vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &m_StagingBufferMemory);
 				check_vk_result(err);
 				err = vkBindBufferMemory(device, m_StagingBuffer, m_StagingBufferMemory, 0);
 				check_vk_result(err);
+				Utils::GetImageMetrics().MemoryBytes.Add((double)m_AlignedSize);
 			}
 
 		}
 
+		// Tightly packed rows, as the copy to the image expects
+		err = vkMapMemory(device, m_StagingBufferMemory, 0, m_AlignedSize, 0, (void**)&target.Data);
+		check_vk_result(err);
+		target.RowPitch = (uint64_t)m_Width * GetBytesPerPixel(m_Format);
+		return true;
+	}
+
+	void Image::EndUpload(const UploadTarget& target)
+	{
+		size_t upload_size = (size_t)m_Width * m_Height * GetBytesPerPixel(m_Format);
+
+		if (m_MappedData)
+		{
+			FlushMappedData();
+			Utils::RecordUpload(upload_size, target.StartTime);
+			return;
+		}
+
+		VkDevice device = Application::GetDevice();
+		VkResult err;
+
 		// Upload to Buffer
 		{
-			char* map = NULL;
-			err = vkMapMemory(device, m_StagingBufferMemory, 0, m_AlignedSize, 0, (void**)(&map));
-			check_vk_result(err);
-			memcpy(map, data, upload_size);
 			VkMappedMemoryRange range[1] = {};
 			range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 			range[0].memory = m_StagingBufferMemory;
@@ -235,18 +703,7 @@ namespace Walnut {
 		{
 			VkCommandBuffer command_buffer = Application::GetCommandBuffer(true);
 
-			VkImageMemoryBarrier copy_barrier = {};
-			copy_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			copy_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			copy_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			copy_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			copy_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			copy_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			copy_barrier.image = m_Image;
-			copy_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copy_barrier.subresourceRange.levelCount = 1;
-			copy_barrier.subresourceRange.layerCount = 1;
-			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &copy_barrier);
+			TransitionLayout(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
 			VkBufferImageCopy region = {};
 			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -256,36 +713,86 @@ namespace Walnut {
 			region.imageExtent.depth = 1;
 			vkCmdCopyBufferToImage(command_buffer, m_StagingBuffer, m_Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-			VkImageMemoryBarrier use_barrier = {};
-			use_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			use_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			use_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			use_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			use_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			use_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			use_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			use_barrier.image = m_Image;
-			use_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			use_barrier.subresourceRange.levelCount = 1;
-			use_barrier.subresourceRange.layerCount = 1;
-			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &use_barrier);
+			TransitionLayout(command_buffer, m_ShaderReadLayout);
 
 			Application::FlushCommandBuffer(command_buffer);
 		}
+
+		Utils::RecordUpload(upload_size, target.StartTime);
 	}
 
 	void Image::Resize(uint32_t width, uint32_t height)
 	{
-		if (m_Image && m_Width == width && m_Height == height)
-			return;
+		uint32_t maxWidth = m_ResizePolicy.MaxWidth ? m_ResizePolicy.MaxWidth : Utils::GetMaxImageDimension2D();
+		uint32_t maxHeight = m_ResizePolicy.MaxHeight ? m_ResizePolicy.MaxHeight : Utils::GetMaxImageDimension2D();
 
-		// TODO: max size?
+		width = glm::clamp(width, 1u, maxWidth);
+		height = glm::clamp(height, 1u, maxHeight);
+
+		if (m_Image && width == m_Width && height == m_Height)
+			return;
 
 		m_Width = width;
 		m_Height = height;
 
+		if (m_ResizePolicy.KeepCapacity && m_Image && width <= m_AllocatedWidth && height <= m_AllocatedHeight)
+		{
+			// Fits, ProcessPendingShrinks shrinks once most of the allocation has been unused for a while
+			bool wasteful = (uint64_t)width * height * 4 <= (uint64_t)m_AllocatedWidth * m_AllocatedHeight;
+			SetShrinkPending(wasteful);
+			return;
+		}
+
+		Reallocate();
+	}
+
+	void Image::Reallocate()
+	{
+		uint32_t maxWidth = m_ResizePolicy.MaxWidth ? m_ResizePolicy.MaxWidth : Utils::GetMaxImageDimension2D();
+		uint32_t maxHeight = m_ResizePolicy.MaxHeight ? m_ResizePolicy.MaxHeight : Utils::GetMaxImageDimension2D();
+
+		// Headroom so that continuous growth doesn't reallocate every frame
+		float growthFactor = m_ResizePolicy.KeepCapacity ? glm::max(m_ResizePolicy.GrowthFactor, 1.0f) : 1.0f;
+		m_AllocatedWidth = glm::min((uint32_t)(m_Width * growthFactor), maxWidth);
+		m_AllocatedHeight = glm::min((uint32_t)(m_Height * growthFactor), maxHeight);
+		SetShrinkPending(false);
+
 		Release();
-		AllocateMemory(m_Width * m_Height * Utils::BytesPerPixel(m_Format));
+		AllocateMemory();
+	}
+
+	void Image::SetShrinkPending(bool pending)
+	{
+		if (pending == m_ShrinkPending)
+			return;
+
+		m_ShrinkPending = pending;
+		if (pending)
+		{
+			m_ShrinkTimer.Reset();
+			s_ShrinkPending.push_back(this);
+		}
+		else
+		{
+			s_ShrinkPending.erase(std::find(s_ShrinkPending.begin(), s_ShrinkPending.end(), this));
+		}
+	}
+
+	void Image::ProcessPendingShrinks()
+	{
+		for (size_t i = 0; i < s_ShrinkPending.size();)
+		{
+			Image* image = s_ShrinkPending[i];
+			if (image->m_ShrinkTimer.Elapsed() < image->m_ResizePolicy.ShrinkDelay)
+			{
+				i++;
+				continue;
+			}
+
+			// Rare, removes the image from the list
+			ScopedAllowAllocations allow;
+			image->Reallocate();
+		}
 	}
 
 }
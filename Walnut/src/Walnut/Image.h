@@ -1,16 +1,53 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 
 #include "vulkan/vulkan.h"
 
+#include "PixelFormat.h"
+#include "Timer.h"
+
+#include <glm/glm.hpp>
+
 namespace Walnut {
 
-	enum class ImageFormat
+	enum ImageUsageFlagBits : uint32_t
+	{
+		ImageUsage_Sampled = 1 << 0,
+		// Writable from compute shaders, the image then always stays in VK_IMAGE_LAYOUT_GENERAL
+		ImageUsage_Storage = 1 << 1,
+		// Render target for Layer::OnRender, see Image::BeginRenderPass
+		ImageUsage_ColorAttachment = 1 << 2,
+	};
+	using ImageUsageFlags = uint32_t;
+
+	struct ImageSpecification
+	{
+		uint32_t Width = 1;
+		uint32_t Height = 1;
+		ImageFormat Format = ImageFormat::RGBA;
+		ImageUsageFlags Usage = ImageUsage_Sampled;
+
+		// For images the CPU rewrites every frame: on devices with host-visible device-local memory
+		// (integrated GPUs, software rasterizers, ReBAR) the image is linear and persistently mapped,
+		// so SetData/GetMappedData write it directly without a staging copy. Falls back to staging otherwise.
+		bool PreferHostVisible = false;
+	};
+
+	// Controls how Image::Resize manages the allocated capacity
+	struct ImageResizePolicy
 	{
-		None = 0,
-		RGBA,
-		RGBA32F
+		// Off by default: every size change reallocates at exactly the new size, so the whole image is valid.
+		// When on, sizes that fit keep the allocation and only a sub-rectangle is valid, see Image::GetUVScale().
+		bool KeepCapacity = false;
+		// With KeepCapacity, the capacity allocated when growing, relative to the requested size
+		float GrowthFactor = 1.5f;
+		// With KeepCapacity, shrink once the size has stayed below a quarter of the capacity for this long
+		float ShrinkDelay = 2.0f;
+		// Requested sizes are clamped to this (0 = device limit)
+		uint32_t MaxWidth = 0, MaxHeight = 0;
 	};
 
 	class Image
@@ -18,28 +55,139 @@ namespace Walnut {
 	public:
 		Image(std::string_view path);
 		Image(uint32_t width, uint32_t height, ImageFormat format, const void* data = nullptr);
+		Image(const ImageSpecification& specification, const void* data = nullptr);
 		~Image();
 
+		// Reads the file with AsyncFileReader and decodes it on a worker thread, so many images load in parallel.
+		// The callback runs on the main thread (see Application::SubmitToMainThread) with the image, nullptr on failure.
+		// It is dropped, not called, for loads that finish while the Application shuts down.
+		static void LoadAsync(std::string_view path, std::function<void(std::shared_ptr<Image>)>&& callback);
+
+		// Tightly packed pixels of the image's format and size, prefer the typed overloads which check both
 		void SetData(const void* data);
 
-		VkDescriptorSet GetDescriptorSet() const { return m_DescriptorSet; }
+		// Converted to the image's format while being written into the staging buffer (or the mapped image),
+		// the conversion for each pair of formats is chosen at compile time. Must match the image's size.
+		template<typename Pixel>
+		void SetData(const ImageView<Pixel>& pixels)
+		{
+			UploadTarget target;
+			if (!BeginUpload(pixels.Width, pixels.Height, target))
+				return;
+
+			VisitPixelFormat(m_Format, [&](auto traits)
+			{
+				using Destination = typename decltype(traits)::Pixel;
+				ConvertPixels(pixels, ImageView<Destination>((Destination*)target.Data, m_Width, m_Height, target.RowPitch));
+			});
+			EndUpload(target);
+		}
+
+		template<typename Pixel, size_t Alignment>
+		void SetData(const ImageBuffer<Pixel, Alignment>& pixels) { SetData(pixels.GetView()); }
+
+		// Only for host-visible images (see ImageSpecification::PreferHostVisible), nullptr otherwise.
+		// Rows are GetRowPitch() bytes apart; call FlushMappedData() after writing. Frames still in
+		// flight may sample the image while it is being written.
+		bool IsHostVisible() const { return m_MappedData != nullptr; }
+		void* GetMappedData() const { return m_MappedData; }
+		uint64_t GetRowPitch() const { return m_RowPitch; }
+		void FlushMappedData();
+		// Typed GetMappedData(), empty unless the image is host-visible and Pixel matches its format
+		template<typename Pixel>
+		ImageView<Pixel> GetMappedView() const
+		{
+			if (!m_MappedData || PixelTraits<Pixel>::Format != m_Format)
+				return ImageView<Pixel>();
+			return ImageView<Pixel>((Pixel*)m_MappedData, m_Width, m_Height, m_RowPitch);
+		}
 
+		VkDescriptorSet GetDescriptorSet() const { return m_DescriptorSet; }
+		VkImage GetImage() const { return m_Image; }
+		VkImageView GetImageView() const { return m_ImageView; }
+		VkSampler GetSampler() const { return m_Sampler; }
+		ImageUsageFlags GetUsage() const { return m_Usage; }
+
+		// Tracked layout, only valid if every transition goes through TransitionLayout
+		VkImageLayout GetLayout() const { return m_Layout; }
+		// The layout the image is sampled in by ImGui and the descriptor set
+		VkImageLayout GetShaderReadLayout() const { return m_ShaderReadLayout; }
+		void TransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout newLayout);
+
+		// Only for ImageUsage_ColorAttachment images. The render pass has a single color attachment and ends in
+		// GetShaderReadLayout(), with dependencies that make the output visible to ImGui, OnCompute and readbacks.
+		// Pipelines created with GetRenderPass() are compatible with both Begin variants and survive Resize.
+		VkRenderPass GetRenderPass() const { return m_RenderPass; }
+		VkFramebuffer GetFramebuffer() const { return m_Framebuffer; }
+		// Clears the image, or keeps its contents. Render area, viewport and scissor cover [0, width] x [0, height].
+		void BeginRenderPass(VkCommandBuffer commandBuffer, const glm::vec4& clearColor);
+		void BeginRenderPass(VkCommandBuffer commandBuffer);
+		void EndRenderPass(VkCommandBuffer commandBuffer);
+
+		// Reallocating discards the contents and replaces the image, view and descriptor set, see ImageResizePolicy.
+		// With KeepCapacity the shrink happens later, at the start of a frame before Layer::OnUpdate.
 		void Resize(uint32_t width, uint32_t height);
+		void SetResizePolicy(const ImageResizePolicy& policy) { m_ResizePolicy = policy; }
 
+		ImageFormat GetFormat() const { return m_Format; }
 		uint32_t GetWidth() const { return m_Width; }
 		uint32_t GetHeight() const { return m_Height; }
+		uint32_t GetAllocatedWidth() const { return m_AllocatedWidth; }
+		uint32_t GetAllocatedHeight() const { return m_AllocatedHeight; }
+
+		// Max UV of the valid sub-rectangle, pass as uv1 (or flipped uv0/uv1) to ImGui::Image
+		glm::vec2 GetUVScale() const { return { (float)m_Width / (float)m_AllocatedWidth, (float)m_Height / (float)m_AllocatedHeight }; }
+
+		// Called by Application, main thread
+		static void ProcessPendingShrinks();
 	private:
-		void AllocateMemory(uint64_t size);
+		struct UploadTarget
+		{
+			uint8_t* Data = nullptr;
+			uint64_t RowPitch = 0;
+			uint64_t StartTime = 0;
+		};
+
+		// The mapped image or the staging buffer, false if width x height doesn't match the image
+		bool BeginUpload(uint32_t width, uint32_t height, UploadTarget& target);
+		void EndUpload(const UploadTarget& target);
+
+		void Reallocate();
+		void SetShrinkPending(bool pending);
+
+		void AllocateMemory();
+		bool AllocateHostVisibleMemory(VkFormat format);
+		void CreateRenderTarget(VkFormat format);
+		void BeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, const VkClearValue* clearValue);
 		void Release();
 	private:
 		uint32_t m_Width = 0, m_Height = 0;
+		uint32_t m_AllocatedWidth = 0, m_AllocatedHeight = 0;
+
+		ImageResizePolicy m_ResizePolicy;
+		Timer m_ShrinkTimer;
+		bool m_ShrinkPending = false;
 
 		VkImage m_Image = nullptr;
 		VkImageView m_ImageView = nullptr;
 		VkDeviceMemory m_Memory = nullptr;
+		VkDeviceSize m_MemorySize = 0;
 		VkSampler m_Sampler = nullptr;
+		VkImageLayout m_Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout m_ShaderReadLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		// Both compatible, they only differ in the load op
+		VkRenderPass m_RenderPass = nullptr;
+		VkRenderPass m_LoadRenderPass = nullptr;
+		VkFramebuffer m_Framebuffer = nullptr;
 
 		ImageFormat m_Format = ImageFormat::None;
+		ImageUsageFlags m_Usage = ImageUsage_Sampled;
+
+		bool m_PreferHostVisible = false;
+		void* m_MappedData = nullptr;
+		uint64_t m_RowPitch = 0;
+		bool m_MemoryCoherent = true;
 
 		VkBuffer m_StagingBuffer = nullptr;
 		VkDeviceMemory m_StagingBufferMemory = nullptr;
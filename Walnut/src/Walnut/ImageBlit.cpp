@@ -0,0 +1,172 @@
+#include "ImageBlit.h"
+
+#include "Application.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace Walnut {
+
+	namespace Utils {
+
+		// Host-visible images are linear, everything else optimal
+		static VkFormatFeatureFlags GetFormatFeatures(const Image& image)
+		{
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(Application::GetPhysicalDevice(), GetVulkanFormat(image.GetFormat()), &properties);
+			return image.IsHostVisible() ? properties.linearTilingFeatures : properties.optimalTilingFeatures;
+		}
+
+		static ImageRegion ResolveRegion(const ImageRegion& region, const Image& image)
+		{
+			ImageRegion resolved = region;
+			if (resolved.Width == 0)
+				resolved.Width = image.GetWidth() > region.X ? image.GetWidth() - region.X : 0;
+			if (resolved.Height == 0)
+				resolved.Height = image.GetHeight() > region.Y ? image.GetHeight() - region.Y : 0;
+			return resolved;
+		}
+
+		static bool FitsImage(const ImageRegion& region, const Image& image)
+		{
+			return region.Width > 0 && region.Height > 0 &&
+				(uint64_t)region.X + region.Width <= image.GetAllocatedWidth() && (uint64_t)region.Y + region.Height <= image.GetAllocatedHeight();
+		}
+
+	}
+
+	void ImageBlitBatch::Copy(const std::shared_ptr<Image>& source, const std::shared_ptr<Image>& destination)
+	{
+		Copy(source, ImageRegion(), destination, 0, 0);
+	}
+
+	void ImageBlitBatch::Copy(const std::shared_ptr<Image>& source, const ImageRegion& sourceRegion, const std::shared_ptr<Image>& destination, uint32_t x, uint32_t y)
+	{
+		ImageRegion destinationRegion;
+		destinationRegion.X = x;
+		destinationRegion.Y = y;
+		m_Operations.push_back({ source, destination, sourceRegion, destinationRegion, VK_FILTER_NEAREST, false });
+	}
+
+	void ImageBlitBatch::Blit(const std::shared_ptr<Image>& source, const std::shared_ptr<Image>& destination, VkFilter filter)
+	{
+		Blit(source, ImageRegion(), destination, ImageRegion(), filter);
+	}
+
+	void ImageBlitBatch::Blit(const std::shared_ptr<Image>& source, const ImageRegion& sourceRegion, const std::shared_ptr<Image>& destination,
+		const ImageRegion& destinationRegion, VkFilter filter)
+	{
+		m_Operations.push_back({ source, destination, sourceRegion, destinationRegion, filter, true });
+	}
+
+	void ImageBlitBatch::Record(VkCommandBuffer commandBuffer)
+	{
+		m_Touched.clear();
+
+		for (Operation& operation : m_Operations)
+		{
+			Image& source = *operation.Source;
+			Image& destination = *operation.Destination;
+			if (&source == &destination)
+			{
+				std::cerr << "[ImageBlit] Source and destination are the same image, skipped" << std::endl;
+				continue;
+			}
+
+			ImageRegion sourceRegion = Utils::ResolveRegion(operation.SourceRegion, source);
+			ImageRegion destinationRegion = operation.DestinationRegion;
+			if (!operation.Scaled)
+			{
+				// Copies keep the size of the source region
+				destinationRegion.Width = sourceRegion.Width;
+				destinationRegion.Height = sourceRegion.Height;
+			}
+			destinationRegion = Utils::ResolveRegion(destinationRegion, destination);
+			if (!Utils::FitsImage(sourceRegion, source) || !Utils::FitsImage(destinationRegion, destination))
+			{
+				std::cerr << "[ImageBlit] Region outside of the image, skipped" << std::endl;
+				continue;
+			}
+
+			// Host-visible images are created without TRANSFER_DST
+			if (destination.IsHostVisible())
+			{
+				std::cerr << "[ImageBlit] Host-visible images can't be written by the GPU, skipped" << std::endl;
+				continue;
+			}
+
+			VkFilter filter = operation.Filter;
+			if (operation.Scaled)
+			{
+				VkFormatFeatureFlags sourceFeatures = Utils::GetFormatFeatures(source);
+				if (!(sourceFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) || !(Utils::GetFormatFeatures(destination) & VK_FORMAT_FEATURE_BLIT_DST_BIT))
+				{
+					std::cerr << "[ImageBlit] Format doesn't support blits, skipped" << std::endl;
+					continue;
+				}
+				if (!(sourceFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+					filter = VK_FILTER_NEAREST;
+			}
+			else if (source.GetFormat() != destination.GetFormat())
+			{
+				std::cerr << "[ImageBlit] Copies need matching formats, use a blit to convert, skipped" << std::endl;
+				continue;
+			}
+
+			// No-ops while an image keeps its role, so reading a source twice or filling one destination needs no barrier
+			source.TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+			destination.TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+			VkImageSubresourceLayers subresource = {};
+			subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresource.layerCount = 1;
+
+			if (operation.Scaled)
+			{
+				VkImageBlit region = {};
+				region.srcSubresource = subresource;
+				region.srcOffsets[0] = { (int32_t)sourceRegion.X, (int32_t)sourceRegion.Y, 0 };
+				region.srcOffsets[1] = { (int32_t)(sourceRegion.X + sourceRegion.Width), (int32_t)(sourceRegion.Y + sourceRegion.Height), 1 };
+				region.dstSubresource = subresource;
+				region.dstOffsets[0] = { (int32_t)destinationRegion.X, (int32_t)destinationRegion.Y, 0 };
+				region.dstOffsets[1] = { (int32_t)(destinationRegion.X + destinationRegion.Width), (int32_t)(destinationRegion.Y + destinationRegion.Height), 1 };
+				vkCmdBlitImage(commandBuffer, source.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					1, &region, filter);
+			}
+			else
+			{
+				VkImageCopy region = {};
+				region.srcSubresource = subresource;
+				region.srcOffset = { (int32_t)sourceRegion.X, (int32_t)sourceRegion.Y, 0 };
+				region.dstSubresource = subresource;
+				region.dstOffset = { (int32_t)destinationRegion.X, (int32_t)destinationRegion.Y, 0 };
+				region.extent = { sourceRegion.Width, sourceRegion.Height, 1 };
+				vkCmdCopyImage(commandBuffer, source.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					1, &region);
+			}
+
+			for (Image* image : { &source, &destination })
+			{
+				if (std::find(m_Touched.begin(), m_Touched.end(), image) == m_Touched.end())
+					m_Touched.push_back(image);
+			}
+		}
+
+		for (Image* image : m_Touched)
+			image->TransitionLayout(commandBuffer, image->GetShaderReadLayout());
+
+		m_Touched.clear();
+		m_Operations.clear();
+	}
+
+	void ImageBlitBatch::Submit()
+	{
+		if (m_Operations.empty())
+			return;
+
+		VkCommandBuffer commandBuffer = Application::GetCommandBuffer(true);
+		Record(commandBuffer);
+		Application::FlushCommandBuffer(commandBuffer);
+	}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "Image.h"
+
+namespace Walnut {
+
+	// Pixel rectangle of an Image, Width or Height 0 extends it to the valid region (Image::GetWidth/GetHeight)
+	struct ImageRegion
+	{
+		uint32_t X = 0, Y = 0;
+		uint32_t Width = 0, Height = 0;
+	};
+
+	// Image to image copies (same format, no scaling) and blits (scaling and format conversion) on the GPU, recorded
+	// into one command buffer. Layouts are transitioned only where an image changes roles, and every image touched is
+	// back in its shader read layout at the end. Destination regions of one batch must not overlap.
+	// Images are kept alive until the batch is recorded, later destruction goes through the deletion queue.
+	class ImageBlitBatch
+	{
+	public:
+		void Copy(const std::shared_ptr<Image>& source, const std::shared_ptr<Image>& destination);
+		void Copy(const std::shared_ptr<Image>& source, const ImageRegion& sourceRegion, const std::shared_ptr<Image>& destination, uint32_t x, uint32_t y);
+
+		// Linear filtering falls back to nearest for formats that don't support it (RGBA32F on some devices)
+		void Blit(const std::shared_ptr<Image>& source, const std::shared_ptr<Image>& destination, VkFilter filter = VK_FILTER_LINEAR);
+		void Blit(const std::shared_ptr<Image>& source, const ImageRegion& sourceRegion, const std::shared_ptr<Image>& destination,
+			const ImageRegion& destinationRegion, VkFilter filter = VK_FILTER_LINEAR);
+
+		// Records and clears the batch, e.g. in Layer::OnRender to use the results in the same frame
+		void Record(VkCommandBuffer commandBuffer);
+		// Records into a one-time command buffer and waits for it
+		void Submit();
+
+		bool IsEmpty() const { return m_Operations.empty(); }
+		size_t GetOperationCount() const { return m_Operations.size(); }
+	private:
+		struct Operation
+		{
+			std::shared_ptr<Image> Source;
+			std::shared_ptr<Image> Destination;
+			ImageRegion SourceRegion;
+			ImageRegion DestinationRegion;
+			VkFilter Filter;
+			bool Scaled;
+		};
+
+		std::vector<Operation> m_Operations;
+		std::vector<Image*> m_Touched;
+	};
+
+}
@@ -0,0 +1,330 @@
+#include "ImageReadback.h"
+
+#include "Application.h"
+#include "PixelKernels.h"
+
+#include <string.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace Walnut {
+
+	struct ReadbackBuffer
+	{
+		VkBuffer Buffer = nullptr;
+		VkDeviceMemory Memory = nullptr;
+		VkDeviceSize Size = 0;
+		void* Mapped = nullptr;
+		bool Coherent = true;
+	};
+
+	struct ReadbackJob
+	{
+		std::shared_ptr<Image> Source; // Only until the copy is recorded
+		ReadbackOptions Options;
+		ReadbackCallback Callback;
+
+		uint32_t Width = 0, Height = 0;
+		ImageFormat Format = ImageFormat::None;
+		ReadbackBuffer Buffer;
+		uint64_t Frame = 0;
+	};
+
+	// Requested, recorded but not finished on the GPU, finished and waiting for the worker
+	static std::vector<ReadbackJob> s_Pending;
+	static std::vector<ReadbackJob> s_InFlight;
+	static std::deque<ReadbackJob> s_Ready;
+
+	static std::mutex s_ReadyMutex;
+	static std::condition_variable s_ReadyCondition;
+	static std::thread s_Worker;
+	static bool s_StopWorker = false;
+
+	// Free buffers, reused for any request that fits within twice their size
+	static std::vector<ReadbackBuffer> s_BufferPool;
+	static std::mutex s_BufferPoolMutex;
+	static constexpr size_t MaxPooledBuffers = 8;
+
+	namespace Utils {
+
+		static uint32_t GetVulkanMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits)
+		{
+			VkPhysicalDeviceMemoryProperties prop;
+			vkGetPhysicalDeviceMemoryProperties(Application::GetPhysicalDevice(), &prop);
+			for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
+			{
+				if ((prop.memoryTypes[i].propertyFlags & properties) == properties && type_bits & (1 << i))
+					return i;
+			}
+
+			return 0xffffffff;
+		}
+
+		static ReadbackBuffer CreateReadbackBuffer(VkDeviceSize size)
+		{
+			VkDevice device = Application::GetDevice();
+
+			ReadbackBuffer buffer;
+			// Round up so slightly different sizes share buffers
+			buffer.Size = (size + 0xffff) & ~(VkDeviceSize)0xffff;
+
+			VkBufferCreateInfo buffer_info = {};
+			buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_info.size = buffer.Size;
+			buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			VkResult err = vkCreateBuffer(device, &buffer_info, Application::GetAllocator(), &buffer.Buffer);
+			check_vk_result(err);
+
+			VkMemoryRequirements req;
+			vkGetBufferMemoryRequirements(device, buffer.Buffer, &req);
+
+			// Cached memory makes the CPU reads fast, but is often not coherent
+			VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			uint32_t memoryType = GetVulkanMemoryType(flags, req.memoryTypeBits);
+			if (memoryType == 0xffffffff)
+			{
+				flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+				memoryType = GetVulkanMemoryType(flags, req.memoryTypeBits);
+			}
+
+			VkPhysicalDeviceMemoryProperties prop;
+			vkGetPhysicalDeviceMemoryProperties(Application::GetPhysicalDevice(), &prop);
+			buffer.Coherent = (prop.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+			VkMemoryAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			alloc_info.allocationSize = req.size;
+			alloc_info.memoryTypeIndex = memoryType;
+			err = vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &buffer.Memory);
+			check_vk_result(err);
+			err = vkBindBufferMemory(device, buffer.Buffer, buffer.Memory, 0);
+			check_vk_result(err);
+			err = vkMapMemory(device, buffer.Memory, 0, VK_WHOLE_SIZE, 0, &buffer.Mapped);
+			check_vk_result(err);
+
+			return buffer;
+		}
+
+		static void DestroyReadbackBuffer(const ReadbackBuffer& buffer)
+		{
+			VkDevice device = Application::GetDevice();
+			vkDestroyBuffer(device, buffer.Buffer, Application::GetAllocator());
+			vkFreeMemory(device, buffer.Memory, Application::GetAllocator());
+		}
+
+		static ReadbackBuffer AcquireBuffer(VkDeviceSize size)
+		{
+			{
+				std::scoped_lock<std::mutex> lock(s_BufferPoolMutex);
+				for (size_t i = 0; i < s_BufferPool.size(); i++)
+				{
+					if (s_BufferPool[i].Size >= size && s_BufferPool[i].Size <= size * 2)
+					{
+						ReadbackBuffer buffer = s_BufferPool[i];
+						s_BufferPool.erase(s_BufferPool.begin() + i);
+						return buffer;
+					}
+				}
+			}
+
+			return CreateReadbackBuffer(size);
+		}
+
+		static void ReleaseBuffer(const ReadbackBuffer& buffer)
+		{
+			{
+				std::scoped_lock<std::mutex> lock(s_BufferPoolMutex);
+				if (s_BufferPool.size() < MaxPooledBuffers)
+				{
+					s_BufferPool.push_back(buffer);
+					return;
+				}
+			}
+
+			// Not referenced by the GPU anymore, no need to defer
+			DestroyReadbackBuffer(buffer);
+		}
+
+		static void CompleteJob(ReadbackJob& job)
+		{
+			if (!job.Buffer.Coherent)
+			{
+				VkMappedMemoryRange range = {};
+				range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory = job.Buffer.Memory;
+				range.size = VK_WHOLE_SIZE;
+				VkResult err = vkInvalidateMappedMemoryRanges(Application::GetDevice(), 1, &range);
+				check_vk_result(err);
+			}
+
+			ReadbackResult result;
+			result.Width = job.Width;
+			result.Height = job.Height;
+
+			size_t pixelCount = (size_t)job.Width * job.Height;
+			const void* src = job.Buffer.Mapped;
+
+			if (job.Format == ImageFormat::RGBA32F && job.Options.Format == ImageFormat::RGBA)
+			{
+				result.Format = ImageFormat::RGBA;
+				result.Data.resize(pixelCount * GetBytesPerPixel(result.Format));
+				PixelKernels::ConvertRGBA32FToRGBA8((const float*)src, (uint32_t*)result.Data.data(), pixelCount, job.Options.Gamma);
+			}
+			else if (job.Format == ImageFormat::RGBA32F && job.Options.Format == ImageFormat::RGBA16F)
+			{
+				result.Format = ImageFormat::RGBA16F;
+				result.Data.resize(pixelCount * GetBytesPerPixel(result.Format));
+				PixelKernels::ConvertFloatToHalf((const float*)src, (uint16_t*)result.Data.data(), pixelCount * 4);
+			}
+			else
+			{
+				result.Format = job.Format;
+				result.Data.resize(pixelCount * GetBytesPerPixel(result.Format));
+				memcpy(result.Data.data(), src, result.Data.size());
+			}
+
+			ReleaseBuffer(job.Buffer);
+			job.Callback(std::move(result));
+		}
+
+		static void WorkerThread()
+		{
+			while (true)
+			{
+				ReadbackJob job;
+				{
+					std::unique_lock<std::mutex> lock(s_ReadyMutex);
+					s_ReadyCondition.wait(lock, []() { return !s_Ready.empty() || s_StopWorker; });
+
+					// Drain everything before stopping
+					if (s_Ready.empty())
+						return;
+
+					job = std::move(s_Ready.front());
+					s_Ready.pop_front();
+				}
+
+				CompleteJob(job);
+			}
+		}
+
+	}
+
+	std::future<ReadbackResult> ImageReadback::Read(const std::shared_ptr<Image>& image, const ReadbackOptions& options)
+	{
+		auto promise = std::make_shared<std::promise<ReadbackResult>>();
+		std::future<ReadbackResult> future = promise->get_future();
+		Read(image, [promise](ReadbackResult&& result) { promise->set_value(std::move(result)); }, options);
+		return future;
+	}
+
+	void ImageReadback::Read(const std::shared_ptr<Image>& image, ReadbackCallback&& callback, const ReadbackOptions& options)
+	{
+		ReadbackJob& job = s_Pending.emplace_back();
+		job.Source = image;
+		job.Options = options;
+		job.Callback = std::move(callback);
+	}
+
+	uint32_t ImageReadback::GetPendingCount()
+	{
+		std::scoped_lock<std::mutex> lock(s_ReadyMutex);
+		return (uint32_t)(s_Pending.size() + s_InFlight.size() + s_Ready.size());
+	}
+
+	void ImageReadback::RecordPendingCopies(VkCommandBuffer commandBuffer, uint64_t frameNumber)
+	{
+		if (s_Pending.empty())
+			return;
+
+		if (!s_Worker.joinable())
+		{
+			s_StopWorker = false;
+			s_Worker = std::thread(Utils::WorkerThread);
+		}
+
+		for (ReadbackJob& job : s_Pending)
+		{
+			Image& image = *job.Source;
+			job.Width = image.GetWidth();
+			job.Height = image.GetHeight();
+			job.Format = image.GetFormat();
+			job.Buffer = Utils::AcquireBuffer((VkDeviceSize)job.Width * job.Height * GetBytesPerPixel(job.Format));
+			job.Frame = frameNumber;
+
+			image.TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+			// Only the valid sub-rectangle, not the whole allocation
+			VkBufferImageCopy region = {};
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent.width = job.Width;
+			region.imageExtent.height = job.Height;
+			region.imageExtent.depth = 1;
+			vkCmdCopyImageToBuffer(commandBuffer, image.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, job.Buffer.Buffer, 1, &region);
+
+			image.TransitionLayout(commandBuffer, image.GetShaderReadLayout());
+
+			job.Source.reset();
+			s_InFlight.push_back(std::move(job));
+		}
+		s_Pending.clear();
+
+		// Make the copies visible to the host once the frame fence has signaled
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	}
+
+	void ImageReadback::ProcessCompleted(uint64_t completedFrame)
+	{
+		if (s_InFlight.empty())
+			return;
+
+		{
+			std::scoped_lock<std::mutex> lock(s_ReadyMutex);
+
+			size_t kept = 0;
+			for (size_t i = 0; i < s_InFlight.size(); i++)
+			{
+				if (s_InFlight[i].Frame <= completedFrame)
+					s_Ready.push_back(std::move(s_InFlight[i]));
+				else
+					s_InFlight[kept++] = std::move(s_InFlight[i]);
+			}
+			s_InFlight.resize(kept);
+		}
+		s_ReadyCondition.notify_one();
+	}
+
+	void ImageReadback::Shutdown()
+	{
+		// Never recorded, complete them empty so nobody waits forever
+		for (ReadbackJob& job : s_Pending)
+			job.Callback(ReadbackResult());
+		s_Pending.clear();
+
+		ProcessCompleted(UINT64_MAX);
+
+		if (s_Worker.joinable())
+		{
+			{
+				std::scoped_lock<std::mutex> lock(s_ReadyMutex);
+				s_StopWorker = true;
+			}
+			s_ReadyCondition.notify_one();
+			s_Worker.join();
+		}
+
+		for (const ReadbackBuffer& buffer : s_BufferPool)
+			Utils::DestroyReadbackBuffer(buffer);
+		s_BufferPool.clear();
+	}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "Image.h"
+
+namespace Walnut {
+
+	struct ReadbackOptions
+	{
+		// None keeps the image's format. RGBA32F images can also be read as RGBA8 or RGBA16F,
+		// any other conversion falls back to the image's format (see ReadbackResult::Format).
+		ImageFormat Format = ImageFormat::None;
+		// Gamma 2.0 when converting RGBA32F to RGBA8
+		bool Gamma = false;
+	};
+
+	struct ReadbackResult
+	{
+		uint32_t Width = 0, Height = 0;
+		ImageFormat Format = ImageFormat::None;
+		// Tightly packed rows, empty if the readback was never executed (e.g. on shutdown)
+		std::vector<uint8_t> Data;
+
+		// Typed view of Data, empty if Pixel doesn't match Format
+		template<typename Pixel>
+		ImageView<const Pixel> GetView() const
+		{
+			if (Data.empty() || PixelTraits<Pixel>::Format != Format)
+				return ImageView<const Pixel>();
+			return ImageView<const Pixel>((const Pixel*)Data.data(), Width, Height);
+		}
+	};
+
+	using ReadbackCallback = std::function<void(ReadbackResult&&)>;
+
+	// Asynchronous GPU -> CPU copies of an Image. The copy is recorded into the next rendered frame
+	// (after Layer::OnCompute) into a pooled host-visible buffer; once that frame's fence has signaled,
+	// a worker thread converts the data and completes the future / runs the callback.
+	// Requests must come from the main thread, the image is kept alive until the copy is recorded.
+	class ImageReadback
+	{
+	public:
+		static std::future<ReadbackResult> Read(const std::shared_ptr<Image>& image, const ReadbackOptions& options = ReadbackOptions());
+		// The callback runs on the readback worker thread
+		static void Read(const std::shared_ptr<Image>& image, ReadbackCallback&& callback, const ReadbackOptions& options = ReadbackOptions());
+
+		static uint32_t GetPendingCount();
+
+		// Called by Application
+		static void RecordPendingCopies(VkCommandBuffer commandBuffer, uint64_t frameNumber);
+		static void ProcessCompleted(uint64_t completedFrame);
+		// Device must be idle
+		static void Shutdown();
+	};
+
+}
@@ -1,32 +1,265 @@
 #include "Input.h"
 
+#include "InputRecording.h"
+#include "SPSCQueue.h"
+
 #include "Walnut/Application.h"
+#include "Walnut/Clock.h"
 
 #include <GLFW/glfw3.h>
 
+#include <string.h>
+
+#include <atomic>
+
 namespace Walnut {
 
+	static_assert(InputSnapshot::KeyWordCount * 64 > GLFW_KEY_LAST, "InputSnapshot key bits don't cover GLFW_KEY_LAST");
+
+	// Live state, only touched by the main thread from the GLFW callbacks and Input::Update
+	static InputSnapshot s_LiveState;
+	static uint64_t s_LiveFrame = 0;
+
+	// Published state. Every word is atomic so single queries need no lock, the sequence counter
+	// (odd while a publish is in progress) makes GetSnapshot consistent across words.
+	static std::atomic<uint32_t> s_Sequence = 0;
+	static std::atomic<uint64_t> s_Frame = 0;
+	static std::atomic<uint64_t> s_Time = 0;
+	static std::atomic<uint64_t> s_Keys[InputSnapshot::KeyWordCount] = {};
+	static std::atomic<uint32_t> s_MouseButtons = 0;
+	static std::atomic<uint64_t> s_MousePosition = 0;
+	static std::atomic<uint64_t> s_ScrollDelta = 0;
+
+	static SPSCQueue<InputEvent, 1024> s_EventQueue;
+	static std::atomic<uint64_t> s_DroppedEvents = 0;
+
+	namespace Utils {
+
+		static uint64_t PackVec2(glm::vec2 value)
+		{
+			uint32_t x, y;
+			memcpy(&x, &value.x, sizeof(float));
+			memcpy(&y, &value.y, sizeof(float));
+			return (uint64_t)x | ((uint64_t)y << 32);
+		}
+
+		static glm::vec2 UnpackVec2(uint64_t packed)
+		{
+			uint32_t x = (uint32_t)packed, y = (uint32_t)(packed >> 32);
+			glm::vec2 value;
+			memcpy(&value.x, &x, sizeof(float));
+			memcpy(&value.y, &y, sizeof(float));
+			return value;
+		}
+
+		static uint64_t PackDouble(double value)
+		{
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(double));
+			return bits;
+		}
+
+		static double UnpackDouble(uint64_t bits)
+		{
+			double value;
+			memcpy(&value, &bits, sizeof(double));
+			return value;
+		}
+
+		static void PushEvent(InputEvent event)
+		{
+			event.Time = InputRecording::IsReplaying() ? InputRecording::GetReplayEventTime() : Clock::GetSeconds();
+			event.Frame = s_LiveFrame + 1;
+			if (InputRecording::IsRecording())
+				InputRecording::RecordEvent(event);
+
+			if (!s_EventQueue.Push(event))
+				s_DroppedEvents.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		static void SetBit(uint64_t* words, int bit, bool set)
+		{
+			if (set)
+				words[bit / 64] |= 1ull << (bit % 64);
+			else
+				words[bit / 64] &= ~(1ull << (bit % 64));
+		}
+
+	}
+
+	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+	{
+		if (key >= 0 && key <= GLFW_KEY_LAST)
+			Utils::SetBit(s_LiveState.Keys, key, action != GLFW_RELEASE);
+
+		InputEvent event;
+		event.Type = InputEventType::Key;
+		event.Code = key;
+		event.Scancode = scancode;
+		event.Action = action;
+		event.Mods = mods;
+		Utils::PushEvent(event);
+	}
+
+	static void CharCallback(GLFWwindow* window, unsigned int codepoint)
+	{
+		InputEvent event;
+		event.Type = InputEventType::Char;
+		event.Code = (int32_t)codepoint;
+		Utils::PushEvent(event);
+	}
+
+	static void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+	{
+		if (button >= 0 && button < 32)
+		{
+			if (action == GLFW_PRESS)
+				s_LiveState.MouseButtons |= 1u << button;
+			else
+				s_LiveState.MouseButtons &= ~(1u << button);
+		}
+
+		InputEvent event;
+		event.Type = InputEventType::MouseButton;
+		event.Code = button;
+		event.Action = action;
+		event.Mods = mods;
+		Utils::PushEvent(event);
+	}
+
+	static void CursorPosCallback(GLFWwindow* window, double x, double y)
+	{
+		s_LiveState.MousePosition = { (float)x, (float)y };
+
+		InputEvent event;
+		event.Type = InputEventType::MouseMove;
+		event.X = x;
+		event.Y = y;
+		Utils::PushEvent(event);
+	}
+
+	static void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+	{
+		s_LiveState.ScrollDelta += glm::vec2((float)xoffset, (float)yoffset);
+
+		InputEvent event;
+		event.Type = InputEventType::Scroll;
+		event.X = xoffset;
+		event.Y = yoffset;
+		Utils::PushEvent(event);
+	}
+
+	static void WindowFocusCallback(GLFWwindow* window, int focused)
+	{
+		// Releases are not delivered to an unfocused window, don't leave keys stuck down
+		if (!focused)
+		{
+			memset(s_LiveState.Keys, 0, sizeof(s_LiveState.Keys));
+			s_LiveState.MouseButtons = 0;
+		}
+
+		InputEvent event;
+		event.Type = InputEventType::WindowFocus;
+		event.Code = focused;
+		Utils::PushEvent(event);
+	}
+
+	static void CursorEnterCallback(GLFWwindow* window, int entered)
+	{
+		InputEvent event;
+		event.Type = InputEventType::CursorEnter;
+		event.Code = entered;
+		Utils::PushEvent(event);
+	}
+
+	void Input::Init(GLFWwindow* windowHandle)
+	{
+		glfwSetKeyCallback(windowHandle, KeyCallback);
+		glfwSetCharCallback(windowHandle, CharCallback);
+		glfwSetMouseButtonCallback(windowHandle, MouseButtonCallback);
+		glfwSetCursorPosCallback(windowHandle, CursorPosCallback);
+		glfwSetScrollCallback(windowHandle, ScrollCallback);
+		glfwSetWindowFocusCallback(windowHandle, WindowFocusCallback);
+		glfwSetCursorEnterCallback(windowHandle, CursorEnterCallback);
+
+		double x, y;
+		glfwGetCursorPos(windowHandle, &x, &y);
+		s_LiveState.MousePosition = { (float)x, (float)y };
+		Update();
+	}
+
+	void Input::Update()
+	{
+		s_LiveState.Frame = ++s_LiveFrame;
+		s_LiveState.Time = Clock::GetSeconds();
+
+		uint32_t sequence = s_Sequence.load(std::memory_order_relaxed);
+		s_Sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		s_Frame.store(s_LiveState.Frame, std::memory_order_relaxed);
+		s_Time.store(Utils::PackDouble(s_LiveState.Time), std::memory_order_relaxed);
+		for (uint32_t i = 0; i < InputSnapshot::KeyWordCount; i++)
+			s_Keys[i].store(s_LiveState.Keys[i], std::memory_order_relaxed);
+		s_MouseButtons.store(s_LiveState.MouseButtons, std::memory_order_relaxed);
+		s_MousePosition.store(Utils::PackVec2(s_LiveState.MousePosition), std::memory_order_relaxed);
+		s_ScrollDelta.store(Utils::PackVec2(s_LiveState.ScrollDelta), std::memory_order_relaxed);
+
+		s_Sequence.store(sequence + 2, std::memory_order_release);
+
+		s_LiveState.ScrollDelta = { 0.0f, 0.0f };
+	}
+
 	bool Input::IsKeyDown(KeyCode keycode)
 	{
-		GLFWwindow* windowHandle = Application::Get().GetWindowHandle();
-		int state = glfwGetKey(windowHandle, (int)keycode);
-		return state == GLFW_PRESS || state == GLFW_REPEAT;
+		uint32_t key = (uint32_t)keycode;
+		if (key >= InputSnapshot::KeyWordCount * 64)
+			return false;
+
+		return (s_Keys[key / 64].load(std::memory_order_relaxed) >> (key % 64)) & 1;
 	}
 
 	bool Input::IsMouseButtonDown(MouseButton button)
 	{
-		GLFWwindow* windowHandle = Application::Get().GetWindowHandle();
-		int state = glfwGetMouseButton(windowHandle, (int)button);
-		return state == GLFW_PRESS;
+		return (s_MouseButtons.load(std::memory_order_relaxed) >> (uint32_t)button) & 1;
 	}
 
 	glm::vec2 Input::GetMousePosition()
 	{
-		GLFWwindow* windowHandle = Application::Get().GetWindowHandle();
+		return Utils::UnpackVec2(s_MousePosition.load(std::memory_order_relaxed));
+	}
 
-		double x, y;
-		glfwGetCursorPos(windowHandle, &x, &y);
-		return { (float)x, (float)y };
+	InputSnapshot Input::GetSnapshot()
+	{
+		InputSnapshot snapshot;
+		uint32_t begin, end;
+		do
+		{
+			begin = s_Sequence.load(std::memory_order_acquire);
+
+			snapshot.Frame = s_Frame.load(std::memory_order_relaxed);
+			snapshot.Time = Utils::UnpackDouble(s_Time.load(std::memory_order_relaxed));
+			for (uint32_t i = 0; i < InputSnapshot::KeyWordCount; i++)
+				snapshot.Keys[i] = s_Keys[i].load(std::memory_order_relaxed);
+			snapshot.MouseButtons = s_MouseButtons.load(std::memory_order_relaxed);
+			snapshot.MousePosition = Utils::UnpackVec2(s_MousePosition.load(std::memory_order_relaxed));
+			snapshot.ScrollDelta = Utils::UnpackVec2(s_ScrollDelta.load(std::memory_order_relaxed));
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			end = s_Sequence.load(std::memory_order_relaxed);
+		} while ((begin & 1) || begin != end);
+
+		return snapshot;
+	}
+
+	bool Input::PollEvent(InputEvent& event)
+	{
+		return s_EventQueue.Pop(event);
+	}
+
+	uint64_t Input::GetDroppedEventCount()
+	{
+		return s_DroppedEvents.load(std::memory_order_relaxed);
 	}
 
 	void Input::SetCursorMode(CursorMode mode)
@@ -35,4 +268,4 @@ namespace Walnut {
 		glfwSetInputMode(windowHandle, GLFW_CURSOR, GLFW_CURSOR_NORMAL + (int)mode);
 	}
 
-}
\ No newline at end of file
+}
@@ -4,8 +4,64 @@
 
 #include <glm/glm.hpp>
 
+struct GLFWwindow;
+
 namespace Walnut {
 
+	enum class InputEventType : uint8_t
+	{
+		None = 0,
+		Key,
+		Char,
+		MouseButton,
+		MouseMove,
+		Scroll,
+		WindowFocus,
+		CursorEnter
+	};
+
+	struct InputEvent
+	{
+		// Clock::GetSeconds() when GLFW delivered the event, GLFW has no OS timestamps
+		double Time = 0.0;
+		// Snapshot frame the event is part of
+		uint64_t Frame = 0;
+
+		InputEventType Type = InputEventType::None;
+		// Key: GLFW key, MouseButton: button, Char: codepoint, WindowFocus/CursorEnter: 0 or 1
+		int32_t Code = 0;
+		int32_t Scancode = 0;
+		// GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+		int32_t Action = 0;
+		int32_t Mods = 0;
+		// MouseMove: cursor position, Scroll: offsets
+		double X = 0.0, Y = 0.0;
+	};
+
+	// Key, button and cursor state of the main window as of the last glfwPollEvents
+	struct InputSnapshot
+	{
+		static constexpr uint32_t KeyWordCount = (348 + 64) / 64; // GLFW_KEY_LAST
+
+		uint64_t Frame = 0;
+		double Time = 0.0;
+		uint64_t Keys[KeyWordCount] = {};
+		uint32_t MouseButtons = 0;
+		glm::vec2 MousePosition = { 0.0f, 0.0f };
+		// Accumulated over the frame
+		glm::vec2 ScrollDelta = { 0.0f, 0.0f };
+
+		bool IsKeyDown(KeyCode keycode) const
+		{
+			uint32_t key = (uint32_t)keycode;
+			return key < KeyWordCount * 64 && (Keys[key / 64] >> (key % 64)) & 1;
+		}
+
+		bool IsMouseButtonDown(MouseButton button) const { return (MouseButtons >> (uint32_t)button) & 1; }
+	};
+
+	// Queries read a snapshot taken once per frame after glfwPollEvents, so they are consistent within a
+	// frame and can be called from any thread. Events in between are available in order through PollEvent.
 	class Input
 	{
 	public:
@@ -14,7 +70,18 @@ namespace Walnut {
 
 		static glm::vec2 GetMousePosition();
 
+		// Consistent copy of the whole snapshot, from any thread
+		static InputSnapshot GetSnapshot();
+
+		// Single consumer: only one thread may poll events. Events are dropped if nobody polls.
+		static bool PollEvent(InputEvent& event);
+		static uint64_t GetDroppedEventCount();
+
 		static void SetCursorMode(CursorMode mode);
+
+		// Called by Application. Init installs the GLFW callbacks before ImGui's backend, which chains to them.
+		static void Init(GLFWwindow* windowHandle);
+		static void Update();
 	};
 
 }
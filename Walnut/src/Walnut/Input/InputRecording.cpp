@@ -0,0 +1,531 @@
+#include "InputRecording.h"
+
+#include "Walnut/Clock.h"
+
+#include "backends/imgui_impl_glfw.h"
+
+#include <GLFW/glfw3.h>
+
+#include <float.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace Walnut {
+
+	static constexpr char s_Magic[4] = { 'W', 'L', 'I', 'R' };
+	static constexpr uint32_t s_Version = 1;
+	// Offset of the frame count in the header, patched when the recording stops
+	static constexpr std::streamoff s_FrameCountOffset = 16;
+
+	struct RecordingState
+	{
+		std::ofstream Stream;
+		uint64_t BaseFrame = 0;
+		uint64_t LastFrame = 0;
+		double StartTime = 0.0;
+		uint64_t LastMicroseconds = 0;
+		uint64_t EventCount = 0;
+	};
+
+	struct ReplayState
+	{
+		GLFWwindow* WindowHandle = nullptr;
+		std::string Path;
+		// Frame and Time of the events are relative to the start of the recording
+		std::vector<InputEvent> Events;
+		size_t NextEvent = 0;
+		uint64_t FrameCount = 0;
+		uint64_t NextFrame = 0;
+
+		double StartTime = 0.0;
+		double EventTime = 0.0;
+		glm::vec2 MousePosition = { -FLT_MAX, -FLT_MAX };
+		bool MouseInside = false;
+
+		GLFWkeyfun KeyCallback = nullptr;
+		GLFWcharfun CharCallback = nullptr;
+		GLFWmousebuttonfun MouseButtonCallback = nullptr;
+		GLFWcursorposfun CursorPosCallback = nullptr;
+		GLFWscrollfun ScrollCallback = nullptr;
+		GLFWwindowfocusfun WindowFocusCallback = nullptr;
+		GLFWcursorenterfun CursorEnterCallback = nullptr;
+
+		std::vector<float> FrameMilliseconds;
+		std::vector<float> CPUMilliseconds;
+	};
+
+	static RecordingState* s_Recording = nullptr;
+	static ReplayState* s_Replay = nullptr;
+
+	namespace Utils {
+
+		static void WriteVarint(std::ostream& stream, uint64_t value)
+		{
+			uint8_t bytes[10];
+			uint32_t count = 0;
+			do
+			{
+				uint8_t byte = value & 0x7f;
+				value >>= 7;
+				bytes[count++] = byte | (value ? 0x80 : 0);
+			} while (value);
+			stream.write((const char*)bytes, count);
+		}
+
+		static uint64_t ZigZag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+		static int64_t UnZigZag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+		template<typename T>
+		static void Write(std::ostream& stream, T value)
+		{
+			stream.write((const char*)&value, sizeof(T));
+		}
+
+		class Reader
+		{
+		public:
+			Reader(const std::vector<uint8_t>& data)
+				: m_Data(data) {}
+
+			bool IsAtEnd() const { return m_Offset >= m_Data.size(); }
+			bool HasFailed() const { return m_Failed; }
+
+			template<typename T>
+			T Read()
+			{
+				T value{};
+				if (m_Offset + sizeof(T) > m_Data.size())
+				{
+					m_Failed = true;
+					return value;
+				}
+				memcpy(&value, m_Data.data() + m_Offset, sizeof(T));
+				m_Offset += sizeof(T);
+				return value;
+			}
+
+			uint64_t ReadVarint()
+			{
+				uint64_t value = 0;
+				for (uint32_t shift = 0; shift < 64; shift += 7)
+				{
+					uint8_t byte = Read<uint8_t>();
+					if (m_Failed)
+						return 0;
+					value |= (uint64_t)(byte & 0x7f) << shift;
+					if (!(byte & 0x80))
+						return value;
+				}
+				m_Failed = true;
+				return 0;
+			}
+		private:
+			const std::vector<uint8_t>& m_Data;
+			size_t m_Offset = 0;
+			bool m_Failed = false;
+		};
+
+		static float Percentile(const std::vector<float>& sorted, float percentile)
+		{
+			if (sorted.empty())
+				return 0.0f;
+			size_t index = (size_t)(percentile * (float)(sorted.size() - 1) + 0.5f);
+			return sorted[std::min(index, sorted.size() - 1)];
+		}
+
+		static void WriteSummary(std::ostream& stream, const char* name, std::vector<float> values)
+		{
+			std::sort(values.begin(), values.end());
+			double sum = 0.0;
+			for (float value : values)
+				sum += value;
+			float mean = values.empty() ? 0.0f : (float)(sum / values.size());
+
+			stream << "\t\"" << name << "\": { \"mean\": " << mean
+				<< ", \"min\": " << (values.empty() ? 0.0f : values.front())
+				<< ", \"p50\": " << Percentile(values, 0.50f)
+				<< ", \"p95\": " << Percentile(values, 0.95f)
+				<< ", \"p99\": " << Percentile(values, 0.99f)
+				<< ", \"max\": " << (values.empty() ? 0.0f : values.back()) << " },\n";
+		}
+
+		static std::string EscapeJSON(const std::string& text)
+		{
+			std::string result;
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\')
+					result += '\\';
+				result += c;
+			}
+			return result;
+		}
+
+	}
+
+	bool InputRecording::StartRecording(const std::string& path, GLFWwindow* windowHandle)
+	{
+		if (s_Recording || s_Replay)
+			return false;
+
+		RecordingState* recording = new RecordingState();
+		recording->Stream.open(path, std::ios::binary | std::ios::trunc);
+		if (!recording->Stream)
+		{
+			std::cerr << "[INPUT] Could not open " << path << " for recording\n";
+			delete recording;
+			return false;
+		}
+
+		int width, height;
+		glfwGetWindowSize(windowHandle, &width, &height);
+
+		recording->Stream.write(s_Magic, sizeof(s_Magic));
+		Utils::Write<uint32_t>(recording->Stream, s_Version);
+		Utils::Write<uint32_t>(recording->Stream, (uint32_t)width);
+		Utils::Write<uint32_t>(recording->Stream, (uint32_t)height);
+		Utils::Write<uint64_t>(recording->Stream, 0);
+
+		// Events are numbered with the frame Input::Update publishes them in
+		recording->BaseFrame = Input::GetSnapshot().Frame + 1;
+		recording->LastFrame = recording->BaseFrame;
+		recording->StartTime = Clock::GetSeconds();
+		s_Recording = recording;
+
+		// The state at the start of the recording, so replay doesn't depend on where the real cursor is
+		InputEvent event;
+		event.Time = recording->StartTime;
+		event.Frame = recording->BaseFrame;
+
+		event.Type = InputEventType::WindowFocus;
+		event.Code = glfwGetWindowAttrib(windowHandle, GLFW_FOCUSED);
+		RecordEvent(event);
+
+		event.Type = InputEventType::CursorEnter;
+		event.Code = glfwGetWindowAttrib(windowHandle, GLFW_HOVERED);
+		RecordEvent(event);
+
+		event.Type = InputEventType::MouseMove;
+		event.Code = 0;
+		glfwGetCursorPos(windowHandle, &event.X, &event.Y);
+		RecordEvent(event);
+
+		return true;
+	}
+
+	void InputRecording::StopRecording()
+	{
+		if (!s_Recording)
+			return;
+
+		uint64_t frameCount = Input::GetSnapshot().Frame + 1 - s_Recording->BaseFrame;
+		s_Recording->Stream.seekp(s_FrameCountOffset);
+		Utils::Write<uint64_t>(s_Recording->Stream, frameCount);
+		s_Recording->Stream.close();
+
+#ifndef WL_DIST
+		std::cout << "[INPUT] Recorded " << s_Recording->EventCount << " events over " << frameCount << " frames\n";
+#endif
+
+		delete s_Recording;
+		s_Recording = nullptr;
+	}
+
+	bool InputRecording::IsRecording()
+	{
+		return s_Recording != nullptr;
+	}
+
+	void InputRecording::RecordEvent(const InputEvent& event)
+	{
+		if (!s_Recording)
+			return;
+
+		RecordingState& recording = *s_Recording;
+		std::ostream& stream = recording.Stream;
+
+		uint64_t frame = std::max(event.Frame, recording.LastFrame);
+		uint64_t microseconds = std::max((uint64_t)(std::max(event.Time - recording.StartTime, 0.0) * 1e6), recording.LastMicroseconds);
+		Utils::WriteVarint(stream, frame - recording.LastFrame);
+		Utils::WriteVarint(stream, microseconds - recording.LastMicroseconds);
+		Utils::Write<uint8_t>(stream, (uint8_t)event.Type);
+		recording.LastFrame = frame;
+		recording.LastMicroseconds = microseconds;
+
+		switch (event.Type)
+		{
+			case InputEventType::Key:
+				Utils::WriteVarint(stream, Utils::ZigZag(event.Code));
+				Utils::WriteVarint(stream, Utils::ZigZag(event.Scancode));
+				Utils::Write<uint8_t>(stream, (uint8_t)event.Action);
+				Utils::Write<uint8_t>(stream, (uint8_t)event.Mods);
+				break;
+			case InputEventType::Char:
+				Utils::WriteVarint(stream, (uint32_t)event.Code);
+				break;
+			case InputEventType::MouseButton:
+				Utils::Write<uint8_t>(stream, (uint8_t)event.Code);
+				Utils::Write<uint8_t>(stream, (uint8_t)event.Action);
+				Utils::Write<uint8_t>(stream, (uint8_t)event.Mods);
+				break;
+			case InputEventType::MouseMove:
+			case InputEventType::Scroll:
+				Utils::Write<float>(stream, (float)event.X);
+				Utils::Write<float>(stream, (float)event.Y);
+				break;
+			case InputEventType::WindowFocus:
+			case InputEventType::CursorEnter:
+				Utils::Write<uint8_t>(stream, (uint8_t)event.Code);
+				break;
+			default:
+				break;
+		}
+
+		recording.EventCount++;
+	}
+
+	bool InputRecording::StartReplay(const std::string& path, GLFWwindow* windowHandle)
+	{
+		if (s_Recording || s_Replay)
+			return false;
+
+		std::ifstream stream(path, std::ios::binary | std::ios::ate);
+		if (!stream)
+		{
+			std::cerr << "[INPUT] Could not open recording " << path << "\n";
+			return false;
+		}
+
+		std::vector<uint8_t> data((size_t)stream.tellg());
+		stream.seekg(0);
+		stream.read((char*)data.data(), data.size());
+
+		Utils::Reader reader(data);
+		char magic[4];
+		for (char& c : magic)
+			c = reader.Read<char>();
+		uint32_t version = reader.Read<uint32_t>();
+		uint32_t width = reader.Read<uint32_t>();
+		uint32_t height = reader.Read<uint32_t>();
+		uint64_t frameCount = reader.Read<uint64_t>();
+		if (reader.HasFailed() || memcmp(magic, s_Magic, sizeof(s_Magic)) != 0 || version != s_Version)
+		{
+			std::cerr << "[INPUT] " << path << " is not a Walnut input recording\n";
+			return false;
+		}
+
+		ReplayState* replay = new ReplayState();
+		uint64_t frame = 0, microseconds = 0;
+		while (!reader.IsAtEnd())
+		{
+			InputEvent event;
+			frame += reader.ReadVarint();
+			microseconds += reader.ReadVarint();
+			event.Frame = frame;
+			event.Time = (double)microseconds * 1e-6;
+			event.Type = (InputEventType)reader.Read<uint8_t>();
+
+			switch (event.Type)
+			{
+				case InputEventType::Key:
+					event.Code = (int32_t)Utils::UnZigZag(reader.ReadVarint());
+					event.Scancode = (int32_t)Utils::UnZigZag(reader.ReadVarint());
+					event.Action = reader.Read<uint8_t>();
+					event.Mods = reader.Read<uint8_t>();
+					break;
+				case InputEventType::Char:
+					event.Code = (int32_t)reader.ReadVarint();
+					break;
+				case InputEventType::MouseButton:
+					event.Code = reader.Read<uint8_t>();
+					event.Action = reader.Read<uint8_t>();
+					event.Mods = reader.Read<uint8_t>();
+					break;
+				case InputEventType::MouseMove:
+				case InputEventType::Scroll:
+					event.X = reader.Read<float>();
+					event.Y = reader.Read<float>();
+					break;
+				case InputEventType::WindowFocus:
+				case InputEventType::CursorEnter:
+					event.Code = reader.Read<uint8_t>();
+					break;
+				default:
+					reader.Read<uint8_t>(); // Unknown type, the payload size isn't known either
+					break;
+			}
+
+			if (reader.HasFailed() || event.Type == InputEventType::None || event.Type > InputEventType::CursorEnter)
+			{
+				std::cerr << "[INPUT] " << path << " is truncated or corrupt, replaying " << replay->Events.size() << " events\n";
+				break;
+			}
+
+			replay->Events.push_back(event);
+		}
+
+		// Not patched if the recording application didn't shut down cleanly
+		if (frameCount == 0 && !replay->Events.empty())
+			frameCount = replay->Events.back().Frame + 1;
+
+		replay->WindowHandle = windowHandle;
+		replay->Path = path;
+		replay->FrameCount = frameCount;
+		replay->StartTime = Clock::GetSeconds();
+
+		int currentWidth, currentHeight;
+		glfwGetWindowSize(windowHandle, &currentWidth, &currentHeight);
+		if (width > 0 && height > 0 && ((uint32_t)currentWidth != width || (uint32_t)currentHeight != height))
+			glfwSetWindowSize(windowHandle, (int)width, (int)height);
+
+		// The ImGui callbacks installed on the window are called directly from ReplayNextFrame instead
+		replay->KeyCallback = glfwSetKeyCallback(windowHandle, nullptr);
+		replay->CharCallback = glfwSetCharCallback(windowHandle, nullptr);
+		replay->MouseButtonCallback = glfwSetMouseButtonCallback(windowHandle, nullptr);
+		replay->CursorPosCallback = glfwSetCursorPosCallback(windowHandle, nullptr);
+		replay->ScrollCallback = glfwSetScrollCallback(windowHandle, nullptr);
+		replay->WindowFocusCallback = glfwSetWindowFocusCallback(windowHandle, nullptr);
+		replay->CursorEnterCallback = glfwSetCursorEnterCallback(windowHandle, nullptr);
+
+		replay->FrameMilliseconds.reserve((size_t)frameCount);
+		replay->CPUMilliseconds.reserve((size_t)frameCount);
+		s_Replay = replay;
+
+#ifndef WL_DIST
+		std::cout << "[INPUT] Replaying " << replay->Events.size() << " events over " << frameCount << " frames from " << path << "\n";
+#endif
+		return true;
+	}
+
+	void InputRecording::StopReplay()
+	{
+		if (!s_Replay)
+			return;
+
+		GLFWwindow* windowHandle = s_Replay->WindowHandle;
+		glfwSetKeyCallback(windowHandle, s_Replay->KeyCallback);
+		glfwSetCharCallback(windowHandle, s_Replay->CharCallback);
+		glfwSetMouseButtonCallback(windowHandle, s_Replay->MouseButtonCallback);
+		glfwSetCursorPosCallback(windowHandle, s_Replay->CursorPosCallback);
+		glfwSetScrollCallback(windowHandle, s_Replay->ScrollCallback);
+		glfwSetWindowFocusCallback(windowHandle, s_Replay->WindowFocusCallback);
+		glfwSetCursorEnterCallback(windowHandle, s_Replay->CursorEnterCallback);
+
+		delete s_Replay;
+		s_Replay = nullptr;
+	}
+
+	bool InputRecording::IsReplaying()
+	{
+		return s_Replay != nullptr;
+	}
+
+	bool InputRecording::ReplayNextFrame()
+	{
+		if (!s_Replay)
+			return false;
+
+		ReplayState& replay = *s_Replay;
+		if (replay.NextFrame >= replay.FrameCount)
+			return false;
+
+		GLFWwindow* window = replay.WindowHandle;
+		while (replay.NextEvent < replay.Events.size() && replay.Events[replay.NextEvent].Frame <= replay.NextFrame)
+		{
+			const InputEvent& event = replay.Events[replay.NextEvent++];
+			replay.EventTime = replay.StartTime + event.Time;
+
+			switch (event.Type)
+			{
+				case InputEventType::Key:
+					ImGui_ImplGlfw_KeyCallback(window, event.Code, event.Scancode, event.Action, event.Mods);
+					break;
+				case InputEventType::Char:
+					ImGui_ImplGlfw_CharCallback(window, (unsigned int)event.Code);
+					break;
+				case InputEventType::MouseButton:
+					ImGui_ImplGlfw_MouseButtonCallback(window, event.Code, event.Action, event.Mods);
+					break;
+				case InputEventType::MouseMove:
+					replay.MousePosition = { (float)event.X, (float)event.Y };
+					ImGui_ImplGlfw_CursorPosCallback(window, event.X, event.Y);
+					break;
+				case InputEventType::Scroll:
+					ImGui_ImplGlfw_ScrollCallback(window, event.X, event.Y);
+					break;
+				case InputEventType::WindowFocus:
+					ImGui_ImplGlfw_WindowFocusCallback(window, event.Code);
+					break;
+				case InputEventType::CursorEnter:
+					replay.MouseInside = event.Code != 0;
+					ImGui_ImplGlfw_CursorEnterCallback(window, event.Code);
+					break;
+				default:
+					break;
+			}
+		}
+
+		replay.NextFrame++;
+		return true;
+	}
+
+	glm::vec2 InputRecording::GetReplayMousePosition()
+	{
+		if (!s_Replay || !s_Replay->MouseInside)
+			return { -FLT_MAX, -FLT_MAX };
+
+		return s_Replay->MousePosition;
+	}
+
+	double InputRecording::GetReplayEventTime()
+	{
+		return s_Replay ? s_Replay->EventTime : 0.0;
+	}
+
+	void InputRecording::AddReplayFrameTiming(float frameMilliseconds, float cpuMilliseconds)
+	{
+		if (!s_Replay)
+			return;
+
+		s_Replay->FrameMilliseconds.push_back(frameMilliseconds);
+		s_Replay->CPUMilliseconds.push_back(cpuMilliseconds);
+	}
+
+	bool InputRecording::WriteReplayStatistics(const std::string& path, float timeStep)
+	{
+		if (!s_Replay)
+			return false;
+
+		const std::vector<float>& frameMilliseconds = s_Replay->FrameMilliseconds;
+		const std::vector<float>& cpuMilliseconds = s_Replay->CPUMilliseconds;
+		size_t skip = std::min<size_t>(1, frameMilliseconds.size());
+
+		std::ofstream stream(path, std::ios::trunc);
+		if (!stream)
+		{
+			std::cerr << "[INPUT] Could not write replay statistics to " << path << "\n";
+			return false;
+		}
+
+		stream << "{\n";
+		stream << "\t\"recording\": \"" << Utils::EscapeJSON(s_Replay->Path) << "\",\n";
+		stream << "\t\"frames\": " << frameMilliseconds.size() << ",\n";
+		stream << "\t\"time_step_ms\": " << timeStep * 1000.0f << ",\n";
+		Utils::WriteSummary(stream, "frame_ms", std::vector<float>(frameMilliseconds.begin() + skip, frameMilliseconds.end()));
+		Utils::WriteSummary(stream, "cpu_ms", std::vector<float>(cpuMilliseconds.begin() + skip, cpuMilliseconds.end()));
+		stream << "\t\"per_frame\": [";
+		for (size_t i = 0; i < frameMilliseconds.size(); i++)
+			stream << (i ? ", " : "") << "[" << frameMilliseconds[i] << ", " << cpuMilliseconds[i] << "]";
+		stream << "]\n}\n";
+
+#ifndef WL_DIST
+		std::cout << "[INPUT] Replay statistics for " << frameMilliseconds.size() << " frames written to " << path << "\n";
+#endif
+		return true;
+	}
+
+}
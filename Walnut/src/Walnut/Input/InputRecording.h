@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Input.h"
+
+#include <string>
+
+struct GLFWwindow;
+
+namespace Walnut {
+
+	// Records the input events of the main window to a compact binary file and plays them back frame by frame,
+	// so UI-heavy layers can be benchmarked with the exact same interaction every run. Driven by Application,
+	// see ApplicationSpecification::InputRecordPath and InputReplayPath.
+	//
+	// File layout: "WLIR", uint32 version, uint32 window width and height, uint64 frame count, then one entry per
+	// event: varint frame delta, varint time delta in microseconds, uint8 InputEventType and a per-type payload.
+	class InputRecording
+	{
+	public:
+		static bool StartRecording(const std::string& path, GLFWwindow* windowHandle);
+		static void StopRecording();
+		static bool IsRecording();
+
+		// Resizes the window to the recorded size and disconnects the real input of the main window until StopReplay
+		static bool StartReplay(const std::string& path, GLFWwindow* windowHandle);
+		static void StopReplay();
+		static bool IsReplaying();
+		// Dispatches the events recorded for the next frame through the ImGui GLFW callbacks, which chain to
+		// Input. Returns false once all recorded frames have been replayed.
+		static bool ReplayNextFrame();
+		// Replayed cursor in window coordinates, -FLT_MAX while it is outside the window
+		static glm::vec2 GetReplayMousePosition();
+		// Recorded time of the event being dispatched, on the Clock::GetSeconds() time base of this run
+		static double GetReplayEventTime();
+
+		// Wall time since the previous frame, and from the start of the frame to its submission
+		static void AddReplayFrameTiming(float frameMilliseconds, float cpuMilliseconds);
+		// JSON summary plus every frame's timings. The first frame includes startup and is left out of the summary.
+		static bool WriteReplayStatistics(const std::string& path, float timeStep);
+
+		// Called by Input for every event of the main window while recording
+		static void RecordEvent(const InputEvent& event);
+	};
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+namespace Walnut {
+
+	// Bounded lock-free queue for exactly one producer and one consumer thread.
+	// Capacity must be a power of two; Push fails instead of blocking when full.
+	template<typename T, size_t Capacity>
+	class SPSCQueue
+	{
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+	public:
+		bool Push(const T& value)
+		{
+			size_t tail = m_Tail.load(std::memory_order_relaxed);
+			if (tail - m_Head.load(std::memory_order_acquire) == Capacity)
+				return false;
+
+			m_Buffer[tail & (Capacity - 1)] = value;
+			m_Tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool Pop(T& value)
+		{
+			size_t head = m_Head.load(std::memory_order_relaxed);
+			if (head == m_Tail.load(std::memory_order_acquire))
+				return false;
+
+			value = m_Buffer[head & (Capacity - 1)];
+			m_Head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Approximate unless called from the producer or consumer thread
+		size_t Size() const { return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire); }
+	private:
+		T m_Buffer[Capacity];
+
+		// On separate cache lines so producer and consumer don't false-share
+		alignas(64) std::atomic<size_t> m_Head{ 0 };
+		alignas(64) std::atomic<size_t> m_Tail{ 0 };
+	};
+
+}
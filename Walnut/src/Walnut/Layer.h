@@ -1,5 +1,7 @@
 #pragma once
 
+#include "vulkan/vulkan.h"
+
 namespace Walnut {
 
 	class Layer
@@ -12,6 +14,15 @@ namespace Walnut {
 
 		virtual void OnUpdate(float ts) {}
 		virtual void OnUIRender() {}
+
+		// Recorded into the frame's command buffer before OnCompute and the UI render pass, after OnUIRender.
+		// Draw into ImageUsage_ColorAttachment images between Image::BeginRenderPass and EndRenderPass, the
+		// result can be shown with ImGui::Image in the same frame. Not called for minimized frames.
+		virtual void OnRender(VkCommandBuffer commandBuffer) {}
+
+		// Recorded into the frame's command buffer before the UI render pass, after OnRender.
+		// Shader writes are visible to ImGui::Image in the same frame. Not called for minimized frames.
+		virtual void OnCompute(VkCommandBuffer commandBuffer) {}
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace Walnut {
+
+	// Bounded lock-free queue, any number of producer threads and a single consumer thread. Each slot carries a
+	// sequence number telling whether it is free for the producer at that position or filled for the consumer,
+	// so producers only contend on one atomic and the consumer on none (Vyukov's bounded queue).
+	template<typename T>
+	class MPSCQueue
+	{
+	public:
+		// Rounded up to a power of two
+		explicit MPSCQueue(size_t capacity)
+		{
+			m_Capacity = 2;
+			while (m_Capacity < capacity)
+				m_Capacity *= 2;
+			m_Mask = m_Capacity - 1;
+
+			m_Cells = std::make_unique<Cell[]>(m_Capacity);
+			for (size_t i = 0; i < m_Capacity; i++)
+				m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+
+		MPSCQueue(const MPSCQueue&) = delete;
+		MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+		// Any thread. False if the queue is full, value is then left untouched.
+		bool TryPush(T&& value)
+		{
+			size_t position = m_Tail.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true)
+			{
+				cell = &m_Cells[position & m_Mask];
+				size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+				if (difference == 0)
+				{
+					if (m_Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+				{
+					// The consumer hasn't freed this slot since the last lap
+					return false;
+				}
+				else
+				{
+					// Another producer claimed it
+					position = m_Tail.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->Value = std::move(value);
+			cell->Sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer thread only. False if empty, or if the oldest slot is claimed but still being written.
+		bool TryPop(T& value)
+		{
+			size_t position = m_Head.load(std::memory_order_relaxed);
+			Cell& cell = m_Cells[position & m_Mask];
+			if (cell.Sequence.load(std::memory_order_acquire) != position + 1)
+				return false;
+
+			value = std::move(cell.Value);
+			// Releases whatever the moved-from value still holds before the slot is reused
+			cell.Value = T();
+			cell.Sequence.store(position + m_Capacity, std::memory_order_release);
+			m_Head.store(position + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// Approximate while producers are pushing
+		size_t GetSize() const
+		{
+			size_t head = m_Head.load(std::memory_order_relaxed);
+			size_t tail = m_Tail.load(std::memory_order_relaxed);
+			return tail > head ? tail - head : 0;
+		}
+		size_t GetCapacity() const { return m_Capacity; }
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> Sequence{ 0 };
+			T Value{};
+		};
+
+		std::unique_ptr<Cell[]> m_Cells;
+		size_t m_Capacity = 0;
+		size_t m_Mask = 0;
+
+		// On separate cache lines, producers hammer the tail while the consumer advances the head
+		alignas(64) std::atomic<size_t> m_Tail{ 0 };
+		alignas(64) std::atomic<size_t> m_Head{ 0 };
+	};
+
+}
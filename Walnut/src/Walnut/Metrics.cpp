@@ -0,0 +1,570 @@
+#include "Metrics.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef WL_PLATFORM_WINDOWS
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <winsock2.h>
+	#include <afunix.h>
+	#include <windows.h>
+	#include <psapi.h>
+	#pragma comment(lib, "Ws2_32.lib")
+#else
+	#include <errno.h>
+	#include <poll.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/time.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+namespace Walnut {
+
+#ifdef WL_PLATFORM_WINDOWS
+	using SocketHandle = SOCKET;
+	static constexpr SocketHandle s_InvalidSocket = INVALID_SOCKET;
+#else
+	using SocketHandle = int;
+	static constexpr SocketHandle s_InvalidSocket = -1;
+#endif
+
+	enum class MetricType
+	{
+		Counter, Gauge, Histogram
+	};
+
+	struct MetricEntry
+	{
+		std::string Name;
+		std::string Help;
+		MetricType Type;
+		// Mismatched re-registrations get a working metric that is not exported
+		bool Exported = true;
+
+		std::unique_ptr<MetricCounter> Counter;
+		std::unique_ptr<MetricGauge> Gauge;
+		std::unique_ptr<MetricHistogram> Histogram;
+	};
+
+	struct MetricsServer
+	{
+		SocketHandle Socket = s_InvalidSocket;
+		std::string Path;
+		std::thread Thread;
+		std::atomic<bool> Running{ false };
+	};
+
+	static std::mutex s_RegistryMutex;
+	static std::vector<std::unique_ptr<MetricEntry>> s_Registry;
+	static std::string s_ApplicationName;
+	static MetricsServer s_Server;
+
+	// How long the server waits for a request line before answering with the plain text anyway,
+	// so both HTTP scrapers and `socat - UNIX-CONNECT:path` work
+	static constexpr int s_RequestTimeoutMilliseconds = 100;
+	static constexpr int s_AcceptPollMilliseconds = 200;
+
+	namespace Utils {
+
+		static uint64_t DoubleToBits(double value)
+		{
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		static double BitsToDouble(uint64_t bits)
+		{
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		static void AtomicAdd(std::atomic<uint64_t>& bits, double value)
+		{
+			uint64_t expected = bits.load(std::memory_order_relaxed);
+			while (!bits.compare_exchange_weak(expected, DoubleToBits(BitsToDouble(expected) + value), std::memory_order_relaxed))
+				;
+		}
+
+		static void AppendValue(std::string& out, double value)
+		{
+			if (isnan(value))
+			{
+				out += "NaN";
+				return;
+			}
+			if (isinf(value))
+			{
+				out += value > 0.0 ? "+Inf" : "-Inf";
+				return;
+			}
+
+			// Shortest of the two that round-trips, so 0.1 stays 0.1
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%.15g", value);
+			if (strtod(buffer, nullptr) != value)
+				snprintf(buffer, sizeof(buffer), "%.17g", value);
+			out += buffer;
+		}
+
+		static void AppendLabelValue(std::string& out, const std::string& value)
+		{
+			for (char c : value)
+			{
+				if (c == '\\' || c == '"')
+					out += '\\';
+				if (c == '\n')
+				{
+					out += "\\n";
+					continue;
+				}
+				out += c;
+			}
+		}
+
+		static void AppendHeader(std::string& out, const MetricEntry& entry, const char* type)
+		{
+			out += "# HELP " + entry.Name + " ";
+			for (char c : entry.Help)
+				out += c == '\n' ? ' ' : c;
+			out += "\n# TYPE " + entry.Name + " " + type + "\n";
+		}
+
+		static bool GetResidentMemoryBytes(uint64_t& bytes)
+		{
+#if defined(WL_PLATFORM_WINDOWS)
+			PROCESS_MEMORY_COUNTERS counters = {};
+			if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+				return false;
+			bytes = counters.WorkingSetSize;
+			return true;
+#elif defined(__linux__)
+			std::ifstream stream("/proc/self/statm");
+			uint64_t totalPages, residentPages;
+			if (!(stream >> totalPages >> residentPages))
+				return false;
+			bytes = residentPages * (uint64_t)sysconf(_SC_PAGESIZE);
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		static uint64_t GetProcessId()
+		{
+#ifdef WL_PLATFORM_WINDOWS
+			return GetCurrentProcessId();
+#else
+			return (uint64_t)getpid();
+#endif
+		}
+
+		static void CloseSocket(SocketHandle socket)
+		{
+#ifdef WL_PLATFORM_WINDOWS
+			closesocket(socket);
+#else
+			close(socket);
+#endif
+		}
+
+		static void RemoveSocketFile(const std::string& path)
+		{
+#ifdef WL_PLATFORM_WINDOWS
+			DeleteFileA(path.c_str());
+#else
+			unlink(path.c_str());
+#endif
+		}
+
+		// A previous run that crashed leaves its socket file behind, which makes bind fail. Only removes
+		// the path if it is a socket nobody accepts connections on, false if something else is there.
+		static bool RemoveStaleSocketFile(const std::string& path, const sockaddr_un& address)
+		{
+#ifdef WL_PLATFORM_WINDOWS
+			DWORD attributes = GetFileAttributesA(path.c_str());
+			if (attributes == INVALID_FILE_ATTRIBUTES)
+				return true;
+			// Unix-domain sockets are reparse points on Windows
+			if (!(attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+				return false;
+#else
+			struct stat status;
+			if (lstat(path.c_str(), &status) != 0)
+				return errno == ENOENT;
+			if (!S_ISSOCK(status.st_mode))
+				return false;
+#endif
+
+			SocketHandle probe = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (probe == s_InvalidSocket)
+				return false;
+
+			bool listening = connect(probe, (const sockaddr*)&address, sizeof(address)) == 0;
+			CloseSocket(probe);
+			if (listening)
+				return false;
+
+			RemoveSocketFile(path);
+			return true;
+		}
+
+		static bool WaitReadable(SocketHandle socket, int timeoutMilliseconds)
+		{
+#ifdef WL_PLATFORM_WINDOWS
+			WSAPOLLFD fd = { socket, POLLRDNORM, 0 };
+			return WSAPoll(&fd, 1, timeoutMilliseconds) > 0;
+#else
+			pollfd fd = { socket, POLLIN, 0 };
+			return poll(&fd, 1, timeoutMilliseconds) > 0;
+#endif
+		}
+
+		static void SetSendTimeout(SocketHandle socket, int milliseconds)
+		{
+#ifdef WL_PLATFORM_WINDOWS
+			DWORD timeout = (DWORD)milliseconds;
+			setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+			timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+			setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#endif
+		}
+
+		static bool SendAll(SocketHandle socket, const std::string& data)
+		{
+#ifdef MSG_NOSIGNAL
+			constexpr int flags = MSG_NOSIGNAL;
+#else
+			constexpr int flags = 0;
+#endif
+			size_t sent = 0;
+			while (sent < data.size())
+			{
+				int chunk = (int)std::min<size_t>(data.size() - sent, 1 << 20);
+				auto result = send(socket, data.data() + sent, chunk, flags);
+				if (result <= 0)
+					return false;
+				sent += (size_t)result;
+			}
+			return true;
+		}
+
+	}
+
+	void MetricGauge::Set(double value)
+	{
+		m_Bits.store(Utils::DoubleToBits(value), std::memory_order_relaxed);
+	}
+
+	void MetricGauge::Add(double value)
+	{
+		Utils::AtomicAdd(m_Bits, value);
+	}
+
+	double MetricGauge::GetValue() const
+	{
+		return Utils::BitsToDouble(m_Bits.load(std::memory_order_relaxed));
+	}
+
+	MetricHistogram::MetricHistogram(const std::vector<double>& bounds)
+		: m_Bounds(bounds)
+	{
+		m_Buckets = std::make_unique<std::atomic<uint64_t>[]>(m_Bounds.size() + 1);
+		for (size_t i = 0; i <= m_Bounds.size(); i++)
+			m_Buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	void MetricHistogram::Observe(double value)
+	{
+		// Few buckets, a linear scan beats a binary search
+		size_t bucket = 0;
+		while (bucket < m_Bounds.size() && value > m_Bounds[bucket])
+			bucket++;
+
+		m_Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		m_Count.fetch_add(1, std::memory_order_relaxed);
+		Utils::AtomicAdd(m_SumBits, value);
+	}
+
+	std::vector<uint64_t> MetricHistogram::GetBucketCounts() const
+	{
+		std::vector<uint64_t> counts(m_Bounds.size() + 1);
+		for (size_t i = 0; i < counts.size(); i++)
+			counts[i] = m_Buckets[i].load(std::memory_order_relaxed);
+		return counts;
+	}
+
+	double MetricHistogram::GetSum() const
+	{
+		return Utils::BitsToDouble(m_SumBits.load(std::memory_order_relaxed));
+	}
+
+	static MetricEntry& Register(const std::string& name, const std::string& help, MetricType type, const std::vector<double>* bounds)
+	{
+		std::scoped_lock<std::mutex> lock(s_RegistryMutex);
+
+		bool exported = true;
+		for (auto& entry : s_Registry)
+		{
+			if (entry->Name != name || !entry->Exported)
+				continue;
+
+			if (entry->Type == type)
+				return *entry;
+
+			std::cerr << "[METRICS] " << name << " is already registered with a different type, the new one is not exported\n";
+			exported = false;
+			break;
+		}
+
+		auto entry = std::make_unique<MetricEntry>();
+		entry->Name = name;
+		entry->Help = help;
+		entry->Type = type;
+		entry->Exported = exported;
+		switch (type)
+		{
+			case MetricType::Counter: entry->Counter = std::make_unique<MetricCounter>(); break;
+			case MetricType::Gauge: entry->Gauge = std::make_unique<MetricGauge>(); break;
+			case MetricType::Histogram: entry->Histogram = std::make_unique<MetricHistogram>(*bounds); break;
+		}
+
+		s_Registry.push_back(std::move(entry));
+		return *s_Registry.back();
+	}
+
+	MetricCounter& Metrics::GetCounter(const std::string& name, const std::string& help)
+	{
+		return *Register(name, help, MetricType::Counter, nullptr).Counter;
+	}
+
+	MetricGauge& Metrics::GetGauge(const std::string& name, const std::string& help)
+	{
+		return *Register(name, help, MetricType::Gauge, nullptr).Gauge;
+	}
+
+	MetricHistogram& Metrics::GetHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds)
+	{
+		return *Register(name, help, MetricType::Histogram, &bounds).Histogram;
+	}
+
+	std::string Metrics::Serialize()
+	{
+		// Entries are never removed, so the values can be read after the lock is dropped
+		std::vector<const MetricEntry*> entries;
+		std::string applicationName;
+		{
+			std::scoped_lock<std::mutex> lock(s_RegistryMutex);
+			entries.reserve(s_Registry.size());
+			for (auto& entry : s_Registry)
+			{
+				if (entry->Exported)
+					entries.push_back(entry.get());
+			}
+			applicationName = s_ApplicationName;
+		}
+
+		std::string out;
+		out.reserve(4096);
+
+		out += "# HELP walnut_info Walnut application identity\n# TYPE walnut_info gauge\nwalnut_info{application=\"";
+		Utils::AppendLabelValue(out, applicationName);
+		out += "\",pid=\"" + std::to_string(Utils::GetProcessId()) + "\"} 1\n";
+
+		uint64_t residentBytes = 0;
+		if (Utils::GetResidentMemoryBytes(residentBytes))
+		{
+			out += "# HELP walnut_process_resident_memory_bytes Resident memory of the process\n";
+			out += "# TYPE walnut_process_resident_memory_bytes gauge\n";
+			out += "walnut_process_resident_memory_bytes " + std::to_string(residentBytes) + "\n";
+		}
+
+		for (const MetricEntry* entry : entries)
+		{
+			switch (entry->Type)
+			{
+				case MetricType::Counter:
+				{
+					Utils::AppendHeader(out, *entry, "counter");
+					out += entry->Name + " " + std::to_string(entry->Counter->GetValue()) + "\n";
+					break;
+				}
+				case MetricType::Gauge:
+				{
+					Utils::AppendHeader(out, *entry, "gauge");
+					out += entry->Name + " ";
+					Utils::AppendValue(out, entry->Gauge->GetValue());
+					out += "\n";
+					break;
+				}
+				case MetricType::Histogram:
+				{
+					Utils::AppendHeader(out, *entry, "histogram");
+
+					// Buckets are read one by one while others may observe, so make the total consistent with them
+					const MetricHistogram& histogram = *entry->Histogram;
+					std::vector<uint64_t> counts = histogram.GetBucketCounts();
+					uint64_t cumulative = 0;
+					for (size_t i = 0; i < counts.size(); i++)
+					{
+						cumulative += counts[i];
+						out += entry->Name + "_bucket{le=\"";
+						if (i < histogram.GetBounds().size())
+							Utils::AppendValue(out, histogram.GetBounds()[i]);
+						else
+							out += "+Inf";
+						out += "\"} " + std::to_string(cumulative) + "\n";
+					}
+					out += entry->Name + "_sum ";
+					Utils::AppendValue(out, histogram.GetSum());
+					out += "\n" + entry->Name + "_count " + std::to_string(cumulative) + "\n";
+					break;
+				}
+			}
+		}
+
+		return out;
+	}
+
+	static void ServeClient(SocketHandle client)
+	{
+		Utils::SetSendTimeout(client, 1000);
+
+		// Only the request line matters, anything that looks like HTTP gets an HTTP response
+		std::string request;
+		char buffer[1024];
+		while (request.size() < 8192 && request.find("\r\n\r\n") == std::string::npos && Utils::WaitReadable(client, s_RequestTimeoutMilliseconds))
+		{
+			auto received = recv(client, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+				break;
+			request.append(buffer, (size_t)received);
+		}
+
+		std::string body = Metrics::Serialize();
+		if (request.compare(0, 4, "GET ") == 0)
+		{
+			std::string header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+				std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+			Utils::SendAll(client, header);
+		}
+		Utils::SendAll(client, body);
+		Utils::CloseSocket(client);
+	}
+
+	static void ServerThread()
+	{
+		while (s_Server.Running.load(std::memory_order_relaxed))
+		{
+			// Polling with a timeout lets StopServer end the thread without closing the socket under it
+			if (!Utils::WaitReadable(s_Server.Socket, s_AcceptPollMilliseconds))
+				continue;
+
+			SocketHandle client = accept(s_Server.Socket, nullptr, nullptr);
+			if (client == s_InvalidSocket)
+				continue;
+
+			ServeClient(client);
+		}
+	}
+
+	bool Metrics::StartServer(const std::string& socketPath, const std::string& applicationName)
+	{
+		if (s_Server.Running)
+			StopServer();
+
+		{
+			std::scoped_lock<std::mutex> lock(s_RegistryMutex);
+			s_ApplicationName = applicationName;
+		}
+
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+		{
+			std::cerr << "[METRICS] Invalid socket path " << socketPath << "\n";
+			return false;
+		}
+		memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+#ifdef WL_PLATFORM_WINDOWS
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		{
+			std::cerr << "[METRICS] WSAStartup failed\n";
+			return false;
+		}
+#endif
+
+		SocketHandle listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		// Every failure from here on also undoes WSAStartup
+		auto fail = [&](const std::string& message)
+		{
+			std::cerr << "[METRICS] " << message << "\n";
+			if (listenSocket != s_InvalidSocket)
+				Utils::CloseSocket(listenSocket);
+#ifdef WL_PLATFORM_WINDOWS
+			WSACleanup();
+#endif
+			return false;
+		};
+
+		if (listenSocket == s_InvalidSocket)
+			return fail("Could not create a Unix-domain socket");
+
+		if (!Utils::RemoveStaleSocketFile(socketPath, address))
+			return fail(socketPath + " is in use or not a socket, not replacing it");
+
+		if (bind(listenSocket, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, 8) != 0)
+			return fail("Could not listen on " + socketPath);
+
+		s_Server.Socket = listenSocket;
+		s_Server.Path = socketPath;
+		s_Server.Running = true;
+		s_Server.Thread = std::thread(ServerThread);
+
+#ifndef WL_DIST
+		std::cout << "[METRICS] Serving metrics on " << socketPath << "\n";
+#endif
+		return true;
+	}
+
+	void Metrics::StopServer()
+	{
+		if (!s_Server.Running)
+			return;
+
+		s_Server.Running = false;
+		if (s_Server.Thread.joinable())
+			s_Server.Thread.join();
+
+		Utils::CloseSocket(s_Server.Socket);
+		Utils::RemoveSocketFile(s_Server.Path);
+		s_Server.Socket = s_InvalidSocket;
+		s_Server.Path.clear();
+
+#ifdef WL_PLATFORM_WINDOWS
+		WSACleanup();
+#endif
+	}
+
+	bool Metrics::IsServerRunning()
+	{
+		return s_Server.Running;
+	}
+
+}
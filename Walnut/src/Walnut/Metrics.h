@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Walnut {
+
+	// Monotonically increasing value, e.g. bytes uploaded
+	class MetricCounter
+	{
+	public:
+		void Increment(uint64_t value = 1) { m_Value.fetch_add(value, std::memory_order_relaxed); }
+		uint64_t GetValue() const { return m_Value.load(std::memory_order_relaxed); }
+	private:
+		std::atomic<uint64_t> m_Value{ 0 };
+	};
+
+	// Value that goes up and down, e.g. bytes of image memory
+	class MetricGauge
+	{
+	public:
+		void Set(double value);
+		void Add(double value);
+		double GetValue() const;
+	private:
+		// Bits of a double, atomic<double> has no fetch_add before C++20
+		std::atomic<uint64_t> m_Bits{ 0 };
+	};
+
+	// Counts of observations per bucket, the bounds are inclusive upper bounds in ascending order
+	class MetricHistogram
+	{
+	public:
+		MetricHistogram(const std::vector<double>& bounds);
+
+		void Observe(double value);
+
+		const std::vector<double>& GetBounds() const { return m_Bounds; }
+		// Non-cumulative, one more than the bounds for everything above the last one
+		std::vector<uint64_t> GetBucketCounts() const;
+		uint64_t GetCount() const { return m_Count.load(std::memory_order_relaxed); }
+		double GetSum() const;
+	private:
+		std::vector<double> m_Bounds;
+		std::unique_ptr<std::atomic<uint64_t>[]> m_Buckets;
+		std::atomic<uint64_t> m_Count{ 0 };
+		std::atomic<uint64_t> m_SumBits{ 0 };
+	};
+
+	// Process-wide registry of named metrics. Registering takes a lock, so look metrics up once and keep the
+	// reference (they live until exit); updating them is lock-free from any thread. Names follow the Prometheus
+	// conventions (walnut_frame_time_seconds), registering an existing name returns the existing metric.
+	//
+	// StartServer exposes the registry on a local Unix-domain socket in the Prometheus text format, served by a
+	// background thread so scraping never touches the frame loop:
+	//     curl --unix-socket /tmp/walnut.sock http://localhost/metrics
+	class Metrics
+	{
+	public:
+		static MetricCounter& GetCounter(const std::string& name, const std::string& help);
+		static MetricGauge& GetGauge(const std::string& name, const std::string& help);
+		// The bounds only apply when the histogram is first registered
+		static MetricHistogram& GetHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds);
+
+		// Prometheus text exposition format, version 0.0.4
+		static std::string Serialize();
+
+		// Replaces a stale socket file left at path. The application name is exported as a label of walnut_info.
+		static bool StartServer(const std::string& socketPath, const std::string& applicationName);
+		static void StopServer();
+		static bool IsServerRunning();
+	};
+
+}
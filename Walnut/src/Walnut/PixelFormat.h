@@ -0,0 +1,349 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "vulkan/vulkan.h"
+
+#include "PixelKernels.h"
+
+namespace Walnut {
+
+	enum class ImageFormat
+	{
+		None = 0,
+		RGBA,
+		RGBA16F, // See PixelKernels::ConvertFloatToHalf
+		RGBA32F
+	};
+
+	// CPU-side pixels, laid out exactly like the matching VkFormat
+	struct PixelRGBA8
+	{
+		uint8_t R, G, B, A;
+	};
+
+	// IEEE half floats, as raw bits
+	struct PixelRGBA16F
+	{
+		uint16_t R, G, B, A;
+	};
+
+	struct PixelRGBA32F
+	{
+		float R, G, B, A;
+	};
+
+	static_assert(sizeof(PixelRGBA8) == 4 && sizeof(PixelRGBA16F) == 8 && sizeof(PixelRGBA32F) == 16, "Pixels must be tightly packed");
+
+	// Everything known about an ImageFormat at compile time
+	template<ImageFormat Format>
+	struct PixelFormatTraits;
+
+	template<>
+	struct PixelFormatTraits<ImageFormat::RGBA>
+	{
+		using Pixel = PixelRGBA8;
+		static constexpr ImageFormat Format = ImageFormat::RGBA;
+		static constexpr VkFormat VulkanFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		static constexpr uint32_t BytesPerPixel = sizeof(Pixel);
+		static constexpr bool IsFloat = false;
+		static constexpr const char* Name = "RGBA";
+	};
+
+	template<>
+	struct PixelFormatTraits<ImageFormat::RGBA16F>
+	{
+		using Pixel = PixelRGBA16F;
+		static constexpr ImageFormat Format = ImageFormat::RGBA16F;
+		static constexpr VkFormat VulkanFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		static constexpr uint32_t BytesPerPixel = sizeof(Pixel);
+		static constexpr bool IsFloat = true;
+		static constexpr const char* Name = "RGBA16F";
+	};
+
+	template<>
+	struct PixelFormatTraits<ImageFormat::RGBA32F>
+	{
+		using Pixel = PixelRGBA32F;
+		static constexpr ImageFormat Format = ImageFormat::RGBA32F;
+		static constexpr VkFormat VulkanFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+		static constexpr uint32_t BytesPerPixel = sizeof(Pixel);
+		static constexpr bool IsFloat = true;
+		static constexpr const char* Name = "RGBA32F";
+	};
+
+	// Pixel type -> format, PixelTraits<PixelRGBA8>::Format == ImageFormat::RGBA
+	template<typename Pixel>
+	struct PixelTraits;
+
+	template<> struct PixelTraits<PixelRGBA8> : PixelFormatTraits<ImageFormat::RGBA> {};
+	template<> struct PixelTraits<PixelRGBA16F> : PixelFormatTraits<ImageFormat::RGBA16F> {};
+	template<> struct PixelTraits<PixelRGBA32F> : PixelFormatTraits<ImageFormat::RGBA32F> {};
+	template<typename Pixel> struct PixelTraits<const Pixel> : PixelTraits<Pixel> {};
+
+	// Runtime lookup for a format only known at runtime, a table indexed by the enum
+	struct PixelFormatInfo
+	{
+		ImageFormat Format;
+		VkFormat VulkanFormat;
+		uint32_t BytesPerPixel;
+		bool IsFloat;
+		const char* Name;
+	};
+
+	namespace Utils {
+
+		template<ImageFormat Format>
+		constexpr PixelFormatInfo MakePixelFormatInfo()
+		{
+			using Traits = PixelFormatTraits<Format>;
+			return { Traits::Format, Traits::VulkanFormat, Traits::BytesPerPixel, Traits::IsFloat, Traits::Name };
+		}
+
+		inline constexpr PixelFormatInfo s_PixelFormats[] =
+		{
+			{ ImageFormat::None, VK_FORMAT_UNDEFINED, 0, false, "None" },
+			MakePixelFormatInfo<ImageFormat::RGBA>(),
+			MakePixelFormatInfo<ImageFormat::RGBA16F>(),
+			MakePixelFormatInfo<ImageFormat::RGBA32F>(),
+		};
+
+		constexpr bool PixelFormatsInEnumOrder()
+		{
+			for (uint32_t i = 0; i < sizeof(s_PixelFormats) / sizeof(s_PixelFormats[0]); i++)
+			{
+				if ((uint32_t)s_PixelFormats[i].Format != i)
+					return false;
+			}
+			return true;
+		}
+
+		static_assert(PixelFormatsInEnumOrder(), "s_PixelFormats must be indexed by ImageFormat");
+
+	}
+
+	// Unknown formats map to ImageFormat::None
+	constexpr const PixelFormatInfo& GetPixelFormatInfo(ImageFormat format)
+	{
+		uint32_t index = (uint32_t)format;
+		return Utils::s_PixelFormats[index < sizeof(Utils::s_PixelFormats) / sizeof(Utils::s_PixelFormats[0]) ? index : 0];
+	}
+
+	constexpr uint32_t GetBytesPerPixel(ImageFormat format) { return GetPixelFormatInfo(format).BytesPerPixel; }
+	constexpr VkFormat GetVulkanFormat(ImageFormat format) { return GetPixelFormatInfo(format).VulkanFormat; }
+
+	// Calls function(PixelFormatTraits<format>()) to enter compile-time code once per image rather than once per
+	// pixel, does nothing for ImageFormat::None. Every format is instantiated, so the function returns void.
+	template<typename Function>
+	void VisitPixelFormat(ImageFormat format, Function&& function)
+	{
+		switch (format)
+		{
+			case ImageFormat::RGBA:    function(PixelFormatTraits<ImageFormat::RGBA>()); return;
+			case ImageFormat::RGBA16F: function(PixelFormatTraits<ImageFormat::RGBA16F>()); return;
+			case ImageFormat::RGBA32F: function(PixelFormatTraits<ImageFormat::RGBA32F>()); return;
+			default: return;
+		}
+	}
+
+	// Non-owning view of pixels with rows RowPitch bytes apart. Pixel may be const.
+	template<typename Pixel>
+	struct ImageView
+	{
+		using PixelType = std::remove_const_t<Pixel>;
+		static constexpr ImageFormat Format = PixelTraits<PixelType>::Format;
+
+		Pixel* Data = nullptr;
+		uint32_t Width = 0, Height = 0;
+		size_t RowPitch = 0;
+
+		ImageView() = default;
+		// rowPitch 0 = tightly packed
+		ImageView(Pixel* data, uint32_t width, uint32_t height, size_t rowPitch = 0)
+			: Data(data), Width(width), Height(height), RowPitch(rowPitch ? rowPitch : (size_t)width * sizeof(Pixel))
+		{
+		}
+
+		// ImageView<Pixel> -> ImageView<const Pixel>
+		template<typename Other, typename = std::enable_if_t<std::is_same_v<const Other, Pixel> && !std::is_same_v<Other, Pixel>>>
+		ImageView(const ImageView<Other>& other)
+			: Data(other.Data), Width(other.Width), Height(other.Height), RowPitch(other.RowPitch)
+		{
+		}
+
+		Pixel* Row(uint32_t y) const
+		{
+			using Byte = std::conditional_t<std::is_const_v<Pixel>, const uint8_t, uint8_t>;
+			return (Pixel*)((Byte*)Data + y * RowPitch);
+		}
+		Pixel& operator()(uint32_t x, uint32_t y) const { return Row(y)[x]; }
+
+		bool IsEmpty() const { return Width == 0 || Height == 0; }
+		bool IsContiguous() const { return RowPitch == (size_t)Width * sizeof(Pixel); }
+
+		// Clamped to the view
+		ImageView SubView(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+		{
+			x = std::min(x, Width);
+			y = std::min(y, Height);
+			return ImageView(Row(y) + x, std::min(width, Width - x), std::min(height, Height - y), RowPitch);
+		}
+	};
+
+	// Owning CPU image. Every row starts at an Alignment boundary, so loops over a row vectorize without peeling
+	// and rows can be handed to the SIMD kernels directly. Move-only.
+	template<typename Pixel, size_t Alignment = 64>
+	class ImageBuffer
+	{
+		static_assert(std::is_trivially_copyable_v<Pixel>, "Pixels are copied with memcpy");
+		static_assert((Alignment & (Alignment - 1)) == 0 && Alignment >= alignof(Pixel), "Alignment must be a power of two");
+	public:
+		static constexpr ImageFormat Format = PixelTraits<Pixel>::Format;
+
+		ImageBuffer() = default;
+		ImageBuffer(uint32_t width, uint32_t height) { Resize(width, height); }
+		~ImageBuffer() { Release(); }
+
+		ImageBuffer(const ImageBuffer&) = delete;
+		ImageBuffer& operator=(const ImageBuffer&) = delete;
+
+		ImageBuffer(ImageBuffer&& other) noexcept { *this = std::move(other); }
+		ImageBuffer& operator=(ImageBuffer&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				m_Data = std::exchange(other.m_Data, nullptr);
+				m_Width = std::exchange(other.m_Width, 0);
+				m_Height = std::exchange(other.m_Height, 0);
+				m_RowPitch = std::exchange(other.m_RowPitch, 0);
+				m_Capacity = std::exchange(other.m_Capacity, 0);
+			}
+			return *this;
+		}
+
+		// Keeps the allocation when the new size fits, the contents are undefined afterwards
+		void Resize(uint32_t width, uint32_t height)
+		{
+			size_t rowPitch = ((size_t)width * sizeof(Pixel) + Alignment - 1) & ~(Alignment - 1);
+			size_t size = rowPitch * height;
+			if (size > m_Capacity)
+			{
+				Release();
+				m_Data = (uint8_t*)::operator new(size, std::align_val_t(Alignment));
+				m_Capacity = size;
+			}
+			m_Width = width;
+			m_Height = height;
+			m_RowPitch = rowPitch;
+		}
+
+		void Fill(const Pixel& value)
+		{
+			for (uint32_t y = 0; y < m_Height; y++)
+				std::fill_n(Row(y), m_Width, value);
+		}
+
+		Pixel* Row(uint32_t y) { return (Pixel*)(m_Data + y * m_RowPitch); }
+		const Pixel* Row(uint32_t y) const { return (const Pixel*)(m_Data + y * m_RowPitch); }
+		Pixel& operator()(uint32_t x, uint32_t y) { return Row(y)[x]; }
+		const Pixel& operator()(uint32_t x, uint32_t y) const { return Row(y)[x]; }
+
+		ImageView<Pixel> GetView() { return ImageView<Pixel>((Pixel*)m_Data, m_Width, m_Height, m_RowPitch); }
+		ImageView<const Pixel> GetView() const { return ImageView<const Pixel>((const Pixel*)m_Data, m_Width, m_Height, m_RowPitch); }
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		size_t GetRowPitch() const { return m_RowPitch; }
+		size_t GetCapacity() const { return m_Capacity; }
+	private:
+		void Release()
+		{
+			if (m_Data)
+				::operator delete(m_Data, std::align_val_t(Alignment));
+			m_Data = nullptr;
+			m_Capacity = 0;
+		}
+	private:
+		uint8_t* m_Data = nullptr;
+		uint32_t m_Width = 0, m_Height = 0;
+		size_t m_RowPitch = 0;
+		size_t m_Capacity = 0;
+	};
+
+	namespace Utils {
+
+		// One row of count pixels, the path is picked at compile time. Float to RGBA8 clamps and truncates
+		// (no gamma), like PixelKernels::ConvertRGBA32FToRGBA8.
+		template<typename Source, typename Destination>
+		void ConvertPixelRow(const Source* source, Destination* destination, size_t count)
+		{
+			if constexpr (std::is_same_v<Source, Destination>)
+			{
+				memcpy(destination, source, count * sizeof(Source));
+			}
+			else if constexpr (std::is_same_v<Source, PixelRGBA32F> && std::is_same_v<Destination, PixelRGBA8>)
+			{
+				PixelKernels::ConvertRGBA32FToRGBA8((const float*)source, (uint32_t*)destination, count, false);
+			}
+			else if constexpr (std::is_same_v<Source, PixelRGBA32F> && std::is_same_v<Destination, PixelRGBA16F>)
+			{
+				PixelKernels::ConvertFloatToHalf((const float*)source, (uint16_t*)destination, count * 4);
+			}
+			else if constexpr (std::is_same_v<Source, PixelRGBA16F> && std::is_same_v<Destination, PixelRGBA32F>)
+			{
+				PixelKernels::ConvertHalfToFloat((const uint16_t*)source, (float*)destination, count * 4);
+			}
+			else if constexpr (std::is_same_v<Source, PixelRGBA8> && std::is_same_v<Destination, PixelRGBA32F>)
+			{
+				const uint8_t* src = (const uint8_t*)source;
+				float* dst = (float*)destination;
+				for (size_t i = 0; i < count * 4; i++)
+					dst[i] = (float)src[i] * (1.0f / 255.0f);
+			}
+			else
+			{
+				// Any other pair goes through RGBA32F, in chunks that stay in L1
+				constexpr size_t ChunkSize = 256;
+				PixelRGBA32F chunk[ChunkSize];
+				for (size_t i = 0; i < count; i += ChunkSize)
+				{
+					size_t n = std::min(ChunkSize, count - i);
+					ConvertPixelRow(source + i, chunk, n);
+					ConvertPixelRow((const PixelRGBA32F*)chunk, destination + i, n);
+				}
+			}
+		}
+
+	}
+
+	// Copies or converts source into destination, which must be at least as large
+	template<typename Source, typename Destination>
+	void ConvertPixels(const ImageView<Source>& source, const ImageView<Destination>& destination)
+	{
+		static_assert(!std::is_const_v<Destination>, "Can't convert into a const view");
+		using SourcePixel = std::remove_const_t<Source>;
+
+		uint32_t width = std::min(source.Width, destination.Width);
+		uint32_t height = std::min(source.Height, destination.Height);
+		if (width == 0 || height == 0)
+			return;
+
+		// Both tightly packed with the same width: a single call over the whole image
+		if (source.IsContiguous() && destination.IsContiguous() && source.Width == destination.Width)
+		{
+			Utils::ConvertPixelRow((const SourcePixel*)source.Data, destination.Data, (size_t)width * height);
+			return;
+		}
+
+		for (uint32_t y = 0; y < height; y++)
+			Utils::ConvertPixelRow((const SourcePixel*)source.Row(y), destination.Row(y), width);
+	}
+
+}
@@ -0,0 +1,628 @@
+#include "PixelKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define WL_PIXEL_KERNELS_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		// MSVC allows any intrinsic without per-function targets
+		#define WL_TARGET_SSE41
+		#define WL_TARGET_AVX2
+	#else
+		#include <cpuid.h>
+		#define WL_TARGET_SSE41 __attribute__((target("sse4.1")))
+		#define WL_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define WL_PIXEL_KERNELS_NEON
+	#include <arm_neon.h>
+#endif
+
+namespace Walnut {
+
+	namespace Utils {
+
+		// Narkowicz 2015, "ACES Filmic Tone Mapping Curve"
+		static constexpr float ACES_A = 2.51f, ACES_B = 0.03f, ACES_C = 2.43f, ACES_D = 0.59f, ACES_E = 0.14f;
+
+		// Written so that NaN clamps to 0, like _mm_max_ps(v, 0)
+		static inline float Clamp01(float v)
+		{
+			v = v > 0.0f ? v : 0.0f;
+			return v < 1.0f ? v : 1.0f;
+		}
+
+		static inline float ToneMapScalar(float v, ToneMapOperator op)
+		{
+			switch (op)
+			{
+				case ToneMapOperator::Reinhard: return v / (1.0f + v);
+				case ToneMapOperator::ACES:     return Clamp01((v * (ACES_A * v + ACES_B)) / (v * (ACES_C * v + ACES_D) + ACES_E));
+				default:                        return v;
+			}
+		}
+
+		static uint16_t FloatToHalfScalar(float value)
+		{
+			uint32_t x;
+			memcpy(&x, &value, sizeof(x));
+
+			uint32_t sign = (x >> 16) & 0x8000;
+			uint32_t mantissa = x & 0x007fffff;
+			uint32_t biasedExponent = (x >> 23) & 0xff;
+
+			// Inf / NaN
+			if (biasedExponent == 0xff)
+				return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x0200 | (mantissa >> 13) : 0));
+
+			int32_t exponent = (int32_t)biasedExponent - 127 + 15;
+			if (exponent >= 31)
+				return (uint16_t)(sign | 0x7c00);
+
+			// Round to nearest even, in both branches a carry correctly moves into the exponent
+			if (exponent <= 0)
+			{
+				if (exponent < -10)
+					return (uint16_t)sign;
+
+				mantissa |= 0x00800000;
+				uint32_t shift = (uint32_t)(14 - exponent);
+				uint32_t half = mantissa >> shift;
+				uint32_t remainder = mantissa & ((1u << shift) - 1);
+				uint32_t halfway = 1u << (shift - 1);
+				if (remainder > halfway || (remainder == halfway && (half & 1)))
+					half++;
+				return (uint16_t)(sign | half);
+			}
+
+			uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+			uint32_t remainder = mantissa & 0x1fff;
+			if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+				half++;
+			return (uint16_t)half;
+		}
+
+		static float HalfToFloatScalar(uint16_t value)
+		{
+			uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+			uint32_t exponent = (value >> 10) & 0x1f;
+			uint32_t mantissa = value & 0x3ff;
+
+			uint32_t x;
+			if (exponent == 0x1f)
+			{
+				// Inf / NaN
+				x = sign | 0x7f800000 | (mantissa << 13);
+			}
+			else if (exponent != 0)
+			{
+				x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+			}
+			else if (mantissa == 0)
+			{
+				x = sign;
+			}
+			else
+			{
+				// Denormal half, normal float
+				exponent = 127 - 15 + 1;
+				while (!(mantissa & 0x400))
+				{
+					mantissa <<= 1;
+					exponent--;
+				}
+				x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+			}
+
+			float result;
+			memcpy(&result, &x, sizeof(result));
+			return result;
+		}
+
+		// factors = { rgb, rgb, rgb, alpha }
+		static inline uint32_t ResolvePixelScalar(const float* pixel, const float* factors, ToneMapOperator op, bool gamma)
+		{
+			uint32_t result = 0;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				float v = pixel[c] * factors[c];
+				if (c < 3)
+					v = ToneMapScalar(v, op);
+				v = Clamp01(v);
+				if (c < 3 && gamma)
+					v = sqrtf(v);
+				result |= (uint32_t)(v * 255.0f) << (c * 8);
+			}
+			return result;
+		}
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// Scalar
+	////////////////////////////////////////////////////////////////////////////////////
+
+	static void ResolveScalar(const float* src, uint32_t* dst, size_t pixelCount, const float* factors, ToneMapOperator op, bool gamma)
+	{
+		for (size_t i = 0; i < pixelCount; i++)
+			dst[i] = Utils::ResolvePixelScalar(src + i * 4, factors, op, gamma);
+	}
+
+	static void ToneMapScalar(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure)
+	{
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+				dst[i * 4 + c] = Utils::ToneMapScalar(src[i * 4 + c] * exposure, op);
+			dst[i * 4 + 3] = src[i * 4 + 3];
+		}
+	}
+
+	static void ScaleScalar(const float* src, float* dst, size_t count, float scale)
+	{
+		for (size_t i = 0; i < count; i++)
+			dst[i] = src[i] * scale;
+	}
+
+	static void FloatToHalfScalar(const float* src, uint16_t* dst, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			dst[i] = Utils::FloatToHalfScalar(src[i]);
+	}
+
+	static void HalfToFloatScalar(const uint16_t* src, float* dst, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			dst[i] = Utils::HalfToFloatScalar(src[i]);
+	}
+
+#ifdef WL_PIXEL_KERNELS_X86
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// SSE4.1, one pixel per register
+	////////////////////////////////////////////////////////////////////////////////////
+
+	WL_TARGET_SSE41 static inline __m128 ApplyToneMapSSE41(__m128 v, ToneMapOperator op)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		switch (op)
+		{
+			case ToneMapOperator::Reinhard:
+				return _mm_div_ps(v, _mm_add_ps(one, v));
+			case ToneMapOperator::ACES:
+			{
+				__m128 numerator = _mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Utils::ACES_A), v), _mm_set1_ps(Utils::ACES_B)));
+				__m128 denominator = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Utils::ACES_C), v), _mm_set1_ps(Utils::ACES_D))), _mm_set1_ps(Utils::ACES_E));
+				return _mm_min_ps(_mm_max_ps(_mm_div_ps(numerator, denominator), _mm_setzero_ps()), one);
+			}
+			default:
+				return v;
+		}
+	}
+
+	WL_TARGET_SSE41 static inline __m128i ResolvePixelSSE41(const float* pixel, __m128 factors, ToneMapOperator op, bool gamma)
+	{
+		__m128 v = _mm_mul_ps(_mm_loadu_ps(pixel), factors);
+		v = _mm_blend_ps(ApplyToneMapSSE41(v, op), v, 0x8);
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		if (gamma)
+			v = _mm_blend_ps(_mm_sqrt_ps(v), v, 0x8);
+		return _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+	}
+
+	WL_TARGET_SSE41 static void ResolveSSE41(const float* src, uint32_t* dst, size_t pixelCount, const float* factors, ToneMapOperator op, bool gamma)
+	{
+		__m128 f = _mm_loadu_ps(factors);
+
+		size_t i = 0;
+		for (; i + 4 <= pixelCount; i += 4)
+		{
+			__m128i p0 = ResolvePixelSSE41(src + (i + 0) * 4, f, op, gamma);
+			__m128i p1 = ResolvePixelSSE41(src + (i + 1) * 4, f, op, gamma);
+			__m128i p2 = ResolvePixelSSE41(src + (i + 2) * 4, f, op, gamma);
+			__m128i p3 = ResolvePixelSSE41(src + (i + 3) * 4, f, op, gamma);
+			__m128i packed = _mm_packus_epi16(_mm_packus_epi32(p0, p1), _mm_packus_epi32(p2, p3));
+			_mm_storeu_si128((__m128i*)(dst + i), packed);
+		}
+
+		ResolveScalar(src + i * 4, dst + i, pixelCount - i, factors, op, gamma);
+	}
+
+	WL_TARGET_SSE41 static void ToneMapSSE41(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure)
+	{
+		__m128 e = _mm_setr_ps(exposure, exposure, exposure, 1.0f);
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			__m128 v = _mm_loadu_ps(src + i * 4);
+			_mm_storeu_ps(dst + i * 4, _mm_blend_ps(ApplyToneMapSSE41(_mm_mul_ps(v, e), op), v, 0x8));
+		}
+	}
+
+	WL_TARGET_SSE41 static void ScaleSSE41(const float* src, float* dst, size_t count, float scale)
+	{
+		__m128 s = _mm_set1_ps(scale);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), s));
+
+		ScaleScalar(src + i, dst + i, count - i, scale);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// AVX2 + F16C, two pixels per register
+	////////////////////////////////////////////////////////////////////////////////////
+
+	WL_TARGET_AVX2 static inline __m256 ApplyToneMapAVX2(__m256 v, ToneMapOperator op)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		switch (op)
+		{
+			case ToneMapOperator::Reinhard:
+				return _mm256_div_ps(v, _mm256_add_ps(one, v));
+			case ToneMapOperator::ACES:
+			{
+				__m256 numerator = _mm256_mul_ps(v, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Utils::ACES_A), v), _mm256_set1_ps(Utils::ACES_B)));
+				__m256 denominator = _mm256_add_ps(_mm256_mul_ps(v, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Utils::ACES_C), v), _mm256_set1_ps(Utils::ACES_D))), _mm256_set1_ps(Utils::ACES_E));
+				return _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(numerator, denominator), _mm256_setzero_ps()), one);
+			}
+			default:
+				return v;
+		}
+	}
+
+	WL_TARGET_AVX2 static inline __m256i ResolvePixelsAVX2(const float* pixels, __m256 factors, ToneMapOperator op, bool gamma)
+	{
+		__m256 v = _mm256_mul_ps(_mm256_loadu_ps(pixels), factors);
+		v = _mm256_blend_ps(ApplyToneMapAVX2(v, op), v, 0x88);
+		v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		if (gamma)
+			v = _mm256_blend_ps(_mm256_sqrt_ps(v), v, 0x88);
+		return _mm256_cvttps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)));
+	}
+
+	WL_TARGET_AVX2 static void ResolveAVX2(const float* src, uint32_t* dst, size_t pixelCount, const float* factors, ToneMapOperator op, bool gamma)
+	{
+		__m256 f = _mm256_setr_ps(factors[0], factors[1], factors[2], factors[3], factors[0], factors[1], factors[2], factors[3]);
+		// The packs below work per 128-bit lane, leaving pixels ordered 0 2 4 6 | 1 3 5 7
+		const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+		size_t i = 0;
+		for (; i + 8 <= pixelCount; i += 8)
+		{
+			__m256i p01 = ResolvePixelsAVX2(src + (i + 0) * 4, f, op, gamma);
+			__m256i p23 = ResolvePixelsAVX2(src + (i + 2) * 4, f, op, gamma);
+			__m256i p45 = ResolvePixelsAVX2(src + (i + 4) * 4, f, op, gamma);
+			__m256i p67 = ResolvePixelsAVX2(src + (i + 6) * 4, f, op, gamma);
+			__m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(p01, p23), _mm256_packus_epi32(p45, p67));
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permutevar8x32_epi32(packed, order));
+		}
+
+		ResolveSSE41(src + i * 4, dst + i, pixelCount - i, factors, op, gamma);
+	}
+
+	WL_TARGET_AVX2 static void ToneMapAVX2(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure)
+	{
+		__m256 e = _mm256_setr_ps(exposure, exposure, exposure, 1.0f, exposure, exposure, exposure, 1.0f);
+		size_t i = 0;
+		for (; i + 2 <= pixelCount; i += 2)
+		{
+			__m256 v = _mm256_loadu_ps(src + i * 4);
+			_mm256_storeu_ps(dst + i * 4, _mm256_blend_ps(ApplyToneMapAVX2(_mm256_mul_ps(v, e), op), v, 0x88));
+		}
+
+		ToneMapSSE41(src + i * 4, dst + i * 4, pixelCount - i, op, exposure);
+	}
+
+	WL_TARGET_AVX2 static void ScaleAVX2(const float* src, float* dst, size_t count, float scale)
+	{
+		__m256 s = _mm256_set1_ps(scale);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), s));
+
+		ScaleScalar(src + i, dst + i, count - i, scale);
+	}
+
+	WL_TARGET_AVX2 static void FloatToHalfAVX2(const float* src, uint16_t* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+
+		FloatToHalfScalar(src + i, dst + i, count - i);
+	}
+
+	WL_TARGET_AVX2 static void HalfToFloatAVX2(const uint16_t* src, float* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+
+		HalfToFloatScalar(src + i, dst + i, count - i);
+	}
+
+#endif
+
+#ifdef WL_PIXEL_KERNELS_NEON
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// NEON (AArch64), one pixel per register
+	////////////////////////////////////////////////////////////////////////////////////
+
+	// maxnm/minnm return the number when one operand is NaN, matching Utils::Clamp01
+	static inline float32x4_t Clamp01NEON(float32x4_t v)
+	{
+		return vminnmq_f32(vmaxnmq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+	}
+
+	static inline float32x4_t ApplyToneMapNEON(float32x4_t v, ToneMapOperator op)
+	{
+		switch (op)
+		{
+			case ToneMapOperator::Reinhard:
+				return vdivq_f32(v, vaddq_f32(vdupq_n_f32(1.0f), v));
+			case ToneMapOperator::ACES:
+			{
+				float32x4_t numerator = vmulq_f32(v, vaddq_f32(vmulq_f32(vdupq_n_f32(Utils::ACES_A), v), vdupq_n_f32(Utils::ACES_B)));
+				float32x4_t denominator = vaddq_f32(vmulq_f32(v, vaddq_f32(vmulq_f32(vdupq_n_f32(Utils::ACES_C), v), vdupq_n_f32(Utils::ACES_D))), vdupq_n_f32(Utils::ACES_E));
+				return Clamp01NEON(vdivq_f32(numerator, denominator));
+			}
+			default:
+				return v;
+		}
+	}
+
+	static inline uint16x4_t ResolvePixelNEON(const float* pixel, float32x4_t factors, uint32x4_t alphaMask, ToneMapOperator op, bool gamma)
+	{
+		float32x4_t v = vmulq_f32(vld1q_f32(pixel), factors);
+		v = vbslq_f32(alphaMask, v, ApplyToneMapNEON(v, op));
+		v = Clamp01NEON(v);
+		if (gamma)
+			v = vbslq_f32(alphaMask, v, vsqrtq_f32(v));
+		return vmovn_u32(vcvtq_u32_f32(vmulq_f32(v, vdupq_n_f32(255.0f))));
+	}
+
+	static void ResolveNEON(const float* src, uint32_t* dst, size_t pixelCount, const float* factors, ToneMapOperator op, bool gamma)
+	{
+		float32x4_t f = vld1q_f32(factors);
+		const uint32_t alphaMaskBits[4] = { 0, 0, 0, 0xffffffff };
+		uint32x4_t alphaMask = vld1q_u32(alphaMaskBits);
+
+		size_t i = 0;
+		for (; i + 4 <= pixelCount; i += 4)
+		{
+			uint16x8_t p01 = vcombine_u16(ResolvePixelNEON(src + (i + 0) * 4, f, alphaMask, op, gamma), ResolvePixelNEON(src + (i + 1) * 4, f, alphaMask, op, gamma));
+			uint16x8_t p23 = vcombine_u16(ResolvePixelNEON(src + (i + 2) * 4, f, alphaMask, op, gamma), ResolvePixelNEON(src + (i + 3) * 4, f, alphaMask, op, gamma));
+			vst1q_u8((uint8_t*)(dst + i), vcombine_u8(vmovn_u16(p01), vmovn_u16(p23)));
+		}
+
+		ResolveScalar(src + i * 4, dst + i, pixelCount - i, factors, op, gamma);
+	}
+
+	static void ToneMapNEON(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure)
+	{
+		const float exposureFactors[4] = { exposure, exposure, exposure, 1.0f };
+		float32x4_t e = vld1q_f32(exposureFactors);
+		const uint32_t alphaMaskBits[4] = { 0, 0, 0, 0xffffffff };
+		uint32x4_t alphaMask = vld1q_u32(alphaMaskBits);
+
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			float32x4_t v = vld1q_f32(src + i * 4);
+			vst1q_f32(dst + i * 4, vbslq_f32(alphaMask, v, ApplyToneMapNEON(vmulq_f32(v, e), op)));
+		}
+	}
+
+	static void ScaleNEON(const float* src, float* dst, size_t count, float scale)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			vst1q_f32(dst + i, vmulq_n_f32(vld1q_f32(src + i), scale));
+
+		ScaleScalar(src + i, dst + i, count - i, scale);
+	}
+
+	static void FloatToHalfNEON(const float* src, uint16_t* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+
+		FloatToHalfScalar(src + i, dst + i, count - i);
+	}
+
+	static void HalfToFloatNEON(const uint16_t* src, float* dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+
+		HalfToFloatScalar(src + i, dst + i, count - i);
+	}
+
+#endif
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// Dispatch
+	////////////////////////////////////////////////////////////////////////////////////
+
+	struct PixelKernelTable
+	{
+		SIMDLevel Level;
+		void (*Resolve)(const float* src, uint32_t* dst, size_t pixelCount, const float* factors, ToneMapOperator op, bool gamma);
+		void (*ToneMap)(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure);
+		void (*Scale)(const float* src, float* dst, size_t count, float scale);
+		void (*FloatToHalf)(const float* src, uint16_t* dst, size_t count);
+		void (*HalfToFloat)(const uint16_t* src, float* dst, size_t count);
+	};
+
+	static const PixelKernelTable s_ScalarKernels = { SIMDLevel::Scalar, ResolveScalar, ToneMapScalar, ScaleScalar, FloatToHalfScalar, HalfToFloatScalar };
+#ifdef WL_PIXEL_KERNELS_X86
+	static const PixelKernelTable s_SSE41Kernels = { SIMDLevel::SSE41, ResolveSSE41, ToneMapSSE41, ScaleSSE41, FloatToHalfScalar, HalfToFloatScalar };
+	static const PixelKernelTable s_AVX2Kernels = { SIMDLevel::AVX2, ResolveAVX2, ToneMapAVX2, ScaleAVX2, FloatToHalfAVX2, HalfToFloatAVX2 };
+#endif
+#ifdef WL_PIXEL_KERNELS_NEON
+	static const PixelKernelTable s_NEONKernels = { SIMDLevel::NEON, ResolveNEON, ToneMapNEON, ScaleNEON, FloatToHalfNEON, HalfToFloatNEON };
+#endif
+
+	static const PixelKernelTable* GetKernelTable(SIMDLevel level)
+	{
+		const CPUFeatures& features = GetCPUFeatures();
+#ifdef WL_PIXEL_KERNELS_X86
+		if (level >= SIMDLevel::AVX2 && features.AVX2 && features.F16C)
+			return &s_AVX2Kernels;
+		if (level >= SIMDLevel::SSE41 && features.SSE41)
+			return &s_SSE41Kernels;
+#endif
+#ifdef WL_PIXEL_KERNELS_NEON
+		if (level >= SIMDLevel::NEON && features.NEON)
+			return &s_NEONKernels;
+#endif
+		return &s_ScalarKernels;
+	}
+
+	static std::atomic<const PixelKernelTable*> s_Kernels{ nullptr };
+
+	static const PixelKernelTable& GetKernels()
+	{
+		const PixelKernelTable* kernels = s_Kernels.load(std::memory_order_relaxed);
+		if (!kernels)
+		{
+			// Asking for the highest level gives the best one the CPU supports
+			kernels = GetKernelTable(SIMDLevel::NEON);
+			s_Kernels.store(kernels, std::memory_order_relaxed);
+		}
+		return *kernels;
+	}
+
+	static CPUFeatures DetectCPUFeatures()
+	{
+		CPUFeatures features;
+
+#ifdef WL_PIXEL_KERNELS_X86
+		int info[4] = {};
+	#ifdef _MSC_VER
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+	#else
+		unsigned int a, b, c, d;
+		__cpuid(0, a, b, c, d);
+		int maxLeaf = (int)a;
+		__cpuid(1, a, b, c, d);
+		info[0] = (int)a; info[1] = (int)b; info[2] = (int)c; info[3] = (int)d;
+	#endif
+		features.SSE41 = (info[2] & (1 << 19)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool f16c = (info[2] & (1 << 29)) != 0;
+
+		// The OS has to save the YMM registers on context switches as well
+		bool ymmEnabled = false;
+		if (osxsave)
+		{
+	#ifdef _MSC_VER
+			unsigned long long xcr0 = _xgetbv(0);
+	#else
+			unsigned int xcr0Low, xcr0High;
+			__asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+			unsigned long long xcr0 = ((unsigned long long)xcr0High << 32) | xcr0Low;
+	#endif
+			ymmEnabled = (xcr0 & 0x6) == 0x6;
+		}
+
+		bool avx2 = false;
+		if (maxLeaf >= 7)
+		{
+	#ifdef _MSC_VER
+			__cpuidex(info, 7, 0);
+	#else
+			__cpuid_count(7, 0, a, b, c, d);
+			info[1] = (int)b;
+	#endif
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		features.AVX2 = avx && avx2 && ymmEnabled;
+		features.F16C = f16c && ymmEnabled;
+#endif
+
+#ifdef WL_PIXEL_KERNELS_NEON
+		// Part of the AArch64 baseline
+		features.NEON = true;
+#endif
+
+		return features;
+	}
+
+	const CPUFeatures& GetCPUFeatures()
+	{
+		static CPUFeatures s_Features = DetectCPUFeatures();
+		return s_Features;
+	}
+
+	namespace PixelKernels {
+
+		SIMDLevel GetSIMDLevel()
+		{
+			return GetKernels().Level;
+		}
+
+		void SetSIMDLevel(SIMDLevel level)
+		{
+			s_Kernels.store(GetKernelTable(level), std::memory_order_relaxed);
+		}
+
+		const char* GetSIMDLevelName(SIMDLevel level)
+		{
+			switch (level)
+			{
+				case SIMDLevel::Scalar: return "Scalar";
+				case SIMDLevel::SSE41:  return "SSE4.1";
+				case SIMDLevel::AVX2:   return "AVX2";
+				case SIMDLevel::NEON:   return "NEON";
+			}
+			return "Unknown";
+		}
+
+		void ConvertRGBA32FToRGBA8(const float* src, uint32_t* dst, size_t pixelCount, bool gamma)
+		{
+			const float factors[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			GetKernels().Resolve(src, dst, pixelCount, factors, ToneMapOperator::None, gamma);
+		}
+
+		void ConvertFloatToHalf(const float* src, uint16_t* dst, size_t count)
+		{
+			GetKernels().FloatToHalf(src, dst, count);
+		}
+
+		void ConvertHalfToFloat(const uint16_t* src, float* dst, size_t count)
+		{
+			GetKernels().HalfToFloat(src, dst, count);
+		}
+
+		void ScaleFloats(const float* src, float* dst, size_t count, float scale)
+		{
+			GetKernels().Scale(src, dst, count, scale);
+		}
+
+		void ToneMap(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure)
+		{
+			GetKernels().ToneMap(src, dst, pixelCount, op, exposure);
+		}
+
+		void ResolveToRGBA8(const float* src, uint32_t* dst, size_t pixelCount, const ResolveSettings& settings)
+		{
+			float rgbFactor = settings.Scale * settings.Exposure;
+			const float factors[4] = { rgbFactor, rgbFactor, rgbFactor, settings.Scale };
+			GetKernels().Resolve(src, dst, pixelCount, factors, settings.ToneMap, settings.Gamma);
+		}
+
+	}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Walnut {
+
+	struct CPUFeatures
+	{
+		bool SSE41 = false;
+		bool AVX2 = false;
+		bool F16C = false;
+		bool NEON = false;
+	};
+
+	// Detected once (cpuid/xgetbv on x86, compile target on ARM)
+	const CPUFeatures& GetCPUFeatures();
+
+	enum class SIMDLevel
+	{
+		Scalar = 0,
+		SSE41,
+		AVX2, // Also requires F16C
+		NEON
+	};
+
+	enum class ToneMapOperator
+	{
+		None = 0,
+		Reinhard,
+		ACES // Narkowicz's fit
+	};
+
+	struct ResolveSettings
+	{
+		// Applied to all channels first, 1 / frameCount for an accumulation buffer
+		float Scale = 1.0f;
+		// Applied to RGB before tone mapping
+		float Exposure = 1.0f;
+		ToneMapOperator ToneMap = ToneMapOperator::None;
+		// Gamma 2.0 (sqrt) on RGB, close enough to sRGB for display
+		bool Gamma = true;
+	};
+
+	// Conversions for CPU-produced images, dispatched to the best SIMD level the CPU supports.
+	// Float pixels are RGBA (4 floats); RGBA8 pixels are packed as in memory order R, G, B, A.
+	// Every level performs the same operations in the same order as the scalar implementation, so
+	// results only differ if the compiler contracts the scalar math into FMAs (and in NaN payloads for FloatToHalf).
+	namespace PixelKernels {
+
+		SIMDLevel GetSIMDLevel();
+		// Clamped to what the CPU supports, mostly for benchmarking against the scalar baseline. Affects all threads.
+		void SetSIMDLevel(SIMDLevel level);
+		const char* GetSIMDLevelName(SIMDLevel level);
+
+		// Clamp to [0, 1], optional gamma, then to 8 bits (truncating, like (uint8_t)(c * 255.0f))
+		void ConvertRGBA32FToRGBA8(const float* src, uint32_t* dst, size_t pixelCount, bool gamma = true);
+
+		// For uploading ImageFormat::RGBA16F at half the size of RGBA32F, count is in floats
+		void ConvertFloatToHalf(const float* src, uint16_t* dst, size_t count);
+		// Exact, count is in floats
+		void ConvertHalfToFloat(const uint16_t* src, float* dst, size_t count);
+
+		// dst = src * scale for every float, count is in floats. src and dst may alias.
+		void ScaleFloats(const float* src, float* dst, size_t count, float scale);
+
+		// RGB = op(RGB * exposure), alpha is copied. src and dst may alias.
+		void ToneMap(const float* src, float* dst, size_t pixelCount, ToneMapOperator op, float exposure = 1.0f);
+
+		// Scale, exposure, tone mapping, clamp, gamma and packing in a single pass: accumulation buffer to displayable RGBA8
+		void ResolveToRGBA8(const float* src, uint32_t* dst, size_t pixelCount, const ResolveSettings& settings);
+
+	}
+
+}
@@ -0,0 +1,210 @@
+#include "ProfilerLayer.h"
+
+#include "Application.h"
+
+#include "imgui.h"
+
+#include <stdio.h>
+
+namespace Walnut {
+
+	static constexpr uint64_t s_RateIntervalNanoseconds = 1000000000ull;
+
+	namespace Utils {
+
+		static void FormatBytes(char* buffer, size_t size, uint64_t bytes)
+		{
+			if (bytes >= 1024ull * 1024 * 1024)
+				snprintf(buffer, size, "%.2f GB", (double)bytes / (1024.0 * 1024.0 * 1024.0));
+			else if (bytes >= 1024ull * 1024)
+				snprintf(buffer, size, "%.2f MB", (double)bytes / (1024.0 * 1024.0));
+			else if (bytes >= 1024ull)
+				snprintf(buffer, size, "%.1f KB", (double)bytes / 1024.0);
+			else
+				snprintf(buffer, size, "%llu B", (unsigned long long)bytes);
+		}
+
+		static void TableBytes(uint64_t bytes)
+		{
+			char buffer[32];
+			FormatBytes(buffer, sizeof(buffer), bytes);
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(buffer);
+		}
+
+		static void TableCount(uint64_t count)
+		{
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)count);
+		}
+
+	}
+
+	void ProfilerLayer::OnUIRender()
+	{
+		if (!m_Open)
+			return;
+
+		if (ImGui::Begin("Profiler", &m_Open))
+		{
+			if (ImGui::CollapsingHeader("Frame", ImGuiTreeNodeFlags_DefaultOpen))
+				DrawFrameStatistics();
+			if (ImGui::CollapsingHeader("Vulkan host allocations", ImGuiTreeNodeFlags_DefaultOpen))
+				DrawVulkanAllocations();
+			if (ImGui::CollapsingHeader("Heap allocations", ImGuiTreeNodeFlags_DefaultOpen))
+				DrawHeapAllocations();
+		}
+		ImGui::End();
+	}
+
+	void ProfilerLayer::DrawFrameStatistics()
+	{
+		const FrameStatistics& statistics = Application::Get().GetFrameStatistics();
+		FrameStatisticsSummary summary = statistics.GetSummary();
+		if (summary.WindowFrames == 0)
+		{
+			ImGui::TextUnformatted("No frames yet");
+			return;
+		}
+
+		ImGui::Text("%.1f FPS (%.2f ms mean over %u frames)", 1000.0 / summary.MeanMilliseconds, summary.MeanMilliseconds, summary.WindowFrames);
+		ImGui::Text("p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms", summary.P50Milliseconds, summary.P95Milliseconds, summary.P99Milliseconds, summary.MaxMilliseconds);
+		ImGui::Text("Jitter %.2f ms, std dev %.2f ms, %llu hitches", summary.JitterMilliseconds, summary.StdDevMilliseconds, (unsigned long long)summary.HitchCount);
+
+		FrameArena& arena = Application::GetFrameArena();
+		char used[32], capacity[32];
+		Utils::FormatBytes(used, sizeof(used), arena.GetLastFrameUsedBytes());
+		Utils::FormatBytes(capacity, sizeof(capacity), arena.GetCapacity());
+		ImGui::Text("Frame arena: %s used of %s", used, capacity);
+
+		statistics.GetFrameTimesMilliseconds(m_FrameTimes);
+		ImGui::PlotLines("##FrameTimes", m_FrameTimes.data(), (int)m_FrameTimes.size(), 0, "Frame time (ms)", 0.0f,
+			(float)summary.MaxMilliseconds * 1.1f, ImVec2(-1.0f, 80.0f));
+	}
+
+	void ProfilerLayer::DrawVulkanAllocations()
+	{
+		VulkanHostAllocator mode = VulkanAllocator::GetMode();
+		if (mode == VulkanHostAllocator::Default)
+		{
+			ImGui::TextWrapped("Not tracked, set ApplicationSpecification::HostAllocator or WALNUT_VK_HOST_ALLOCATOR to \"tracking\" or \"pooled\".");
+			return;
+		}
+
+		VulkanAllocationStatistics statistics = VulkanAllocator::GetStatistics();
+
+		uint64_t now = Clock::GetNanoseconds();
+		if (now - m_PreviousAllocationsTime >= s_RateIntervalNanoseconds)
+		{
+			if (m_PreviousAllocationsTime != 0)
+			{
+				double seconds = (double)(now - m_PreviousAllocationsTime) * 1e-9;
+				for (uint32_t i = 0; i <= VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE; i++)
+				{
+					uint64_t allocations = statistics.Scopes[i].TotalAllocations + statistics.Scopes[i].TotalReallocations -
+						m_PreviousAllocations.Scopes[i].TotalAllocations - m_PreviousAllocations.Scopes[i].TotalReallocations;
+					m_AllocationsPerSecond[i] = (float)((double)allocations / seconds);
+				}
+			}
+			m_PreviousAllocations = statistics;
+			m_PreviousAllocationsTime = now;
+		}
+
+		ImGui::Text("%s allocator", mode == VulkanHostAllocator::Pooled ? "Pooled" : "Tracking");
+		if (mode == VulkanHostAllocator::Pooled)
+		{
+			char buffer[32];
+			Utils::FormatBytes(buffer, sizeof(buffer), statistics.PooledFreeBytes);
+			ImGui::SameLine();
+			ImGui::Text("(%s in free lists, %llu reused blocks)", buffer, (unsigned long long)statistics.PoolHits);
+		}
+
+		ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp;
+		if (ImGui::BeginTable("VulkanAllocations", 8, flags))
+		{
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("Live");
+			ImGui::TableSetupColumn("Count");
+			ImGui::TableSetupColumn("Peak");
+			ImGui::TableSetupColumn("Allocs/s");
+			ImGui::TableSetupColumn("Allocs");
+			ImGui::TableSetupColumn("Reallocs");
+			ImGui::TableSetupColumn("Internal");
+			ImGui::TableHeadersRow();
+
+			float totalPerSecond = 0.0f;
+			for (uint32_t i = 0; i <= VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE; i++)
+			{
+				const VulkanAllocationScopeStatistics& scope = statistics.Scopes[i];
+				totalPerSecond += m_AllocationsPerSecond[i];
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(VulkanAllocator::GetScopeName((VkSystemAllocationScope)i));
+				Utils::TableBytes(scope.Bytes);
+				Utils::TableCount(scope.Allocations);
+				Utils::TableBytes(scope.PeakBytes);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", m_AllocationsPerSecond[i]);
+				Utils::TableCount(scope.TotalAllocations);
+				Utils::TableCount(scope.TotalReallocations);
+				Utils::TableBytes(scope.InternalBytes);
+			}
+
+			const VulkanAllocationScopeStatistics& total = statistics.Total;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted("Total");
+			Utils::TableBytes(total.Bytes);
+			Utils::TableCount(total.Allocations);
+			Utils::TableBytes(total.PeakBytes);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.0f", totalPerSecond);
+			Utils::TableCount(total.TotalAllocations);
+			Utils::TableCount(total.TotalReallocations);
+			Utils::TableBytes(total.InternalBytes);
+
+			ImGui::EndTable();
+		}
+	}
+
+	void ProfilerLayer::DrawHeapAllocations()
+	{
+		if (!AllocationTracker::IsEnabled())
+		{
+			ImGui::TextWrapped("Not tracked, build with WL_TRACK_ALLOCATIONS (premake5 --track-allocations).");
+			return;
+		}
+
+		Application& application = Application::Get();
+		const AllocationCounters& frame = application.GetFrameAllocations();
+		char buffer[32];
+		Utils::FormatBytes(buffer, sizeof(buffer), frame.Bytes);
+		ImGui::Text("Last frame: %llu allocations, %s, %llu frees (main thread)", (unsigned long long)frame.Allocations, buffer, (unsigned long long)frame.Frees);
+		ImGui::Text("Zero-allocation violations: %llu", (unsigned long long)AllocationTracker::GetViolationCount());
+
+		const std::vector<AllocationCounters>& layers = application.GetLayerAllocations();
+		ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp;
+		if (ImGui::BeginTable("LayerAllocations", 4, flags))
+		{
+			ImGui::TableSetupColumn("Layer");
+			ImGui::TableSetupColumn("Allocations");
+			ImGui::TableSetupColumn("Bytes");
+			ImGui::TableSetupColumn("Frees");
+			ImGui::TableHeadersRow();
+
+			for (size_t i = 0; i < layers.size(); i++)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", i);
+				Utils::TableCount(layers[i].Allocations);
+				Utils::TableBytes(layers[i].Bytes);
+				Utils::TableCount(layers[i].Frees);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+}
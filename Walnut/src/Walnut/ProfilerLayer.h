@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Layer.h"
+#include "VulkanAllocator.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace Walnut {
+
+	// "Profiler" window with the frame-time statistics of the Application, the host allocations of the Vulkan
+	// driver (see ApplicationSpecification::HostAllocator) and the heap allocations of the last frame (see
+	// AllocationTracker). Push it like any other layer:
+	//     app->PushLayer<Walnut::ProfilerLayer>();
+	class ProfilerLayer : public Layer
+	{
+	public:
+		virtual void OnUIRender() override;
+	private:
+		void DrawFrameStatistics();
+		void DrawVulkanAllocations();
+		void DrawHeapAllocations();
+	private:
+		bool m_Open = true;
+		std::vector<float> m_FrameTimes;
+
+		// Allocation rates are measured over about a second, per-frame numbers are too noisy to read
+		VulkanAllocationStatistics m_PreviousAllocations;
+		uint64_t m_PreviousAllocationsTime = 0;
+		float m_AllocationsPerSecond[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1] = {};
+	};
+
+}
@@ -0,0 +1,73 @@
+#include "Shader.h"
+
+#include "Application.h"
+
+#include <fstream>
+#include <iostream>
+
+namespace Walnut {
+
+	namespace Utils {
+
+		static std::vector<uint32_t> ReadSpirvFile(const std::string& path)
+		{
+			std::ifstream stream(path, std::ios::binary | std::ios::ate);
+			if (!stream)
+				return {};
+
+			size_t size = (size_t)stream.tellg();
+			if (size == 0 || size % sizeof(uint32_t) != 0)
+				return {};
+
+			std::vector<uint32_t> code(size / sizeof(uint32_t));
+			stream.seekg(0);
+			stream.read((char*)code.data(), size);
+			if (!stream)
+				return {};
+
+			return code;
+		}
+
+	}
+
+	Shader::Shader(std::string_view path)
+		: m_Filepath(path)
+	{
+		std::vector<uint32_t> code = Utils::ReadSpirvFile(m_Filepath);
+		if (code.empty())
+		{
+			std::cerr << "[Shader] Failed to read SPIR-V from " << m_Filepath << "\n";
+			return;
+		}
+
+		Create(code.data(), code.size() * sizeof(uint32_t));
+	}
+
+	Shader::Shader(const uint32_t* code, size_t size)
+	{
+		Create(code, size);
+	}
+
+	Shader::~Shader()
+	{
+		Application::GetDeletionQueue().Push(m_Module);
+	}
+
+	void Shader::Create(const uint32_t* code, size_t size)
+	{
+		const uint32_t SpirvMagic = 0x07230203;
+		if (size < sizeof(uint32_t) || code[0] != SpirvMagic)
+		{
+			std::cerr << "[Shader] Invalid SPIR-V" << (m_Filepath.empty() ? "" : " in " + m_Filepath) << "\n";
+			return;
+		}
+
+		VkShaderModuleCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		info.codeSize = size;
+		info.pCode = code;
+		VkResult err = vkCreateShaderModule(Application::GetDevice(), &info, Application::GetAllocator(), &m_Module);
+		check_vk_result(err);
+	}
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include "vulkan/vulkan.h"
+
+namespace Walnut {
+
+	// A SPIR-V shader module, compiled offline (e.g. glslc shader.comp -o shader.comp.spv)
+	class Shader
+	{
+	public:
+		Shader(std::string_view path);
+		// size in bytes
+		Shader(const uint32_t* code, size_t size);
+		~Shader();
+
+		bool IsValid() const { return m_Module != nullptr; }
+		VkShaderModule GetModule() const { return m_Module; }
+		const std::string& GetFilepath() const { return m_Filepath; }
+	private:
+		void Create(const uint32_t* code, size_t size);
+	private:
+		VkShaderModule m_Module = nullptr;
+		std::string m_Filepath;
+	};
+
+}
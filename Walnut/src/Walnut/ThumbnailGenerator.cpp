@@ -0,0 +1,110 @@
+#include "ThumbnailGenerator.h"
+
+#include "Application.h"
+
+#include <algorithm>
+
+namespace Walnut {
+
+	ThumbnailGenerator::ThumbnailGenerator(const ThumbnailSpecification& specification)
+		: m_Specification(specification)
+	{
+	}
+
+	std::shared_ptr<Image> ThumbnailGenerator::Request(const std::shared_ptr<Image>& source)
+	{
+		uint32_t width = source->GetWidth(), height = source->GetHeight();
+		float scale = std::min(1.0f, (float)std::max(m_Specification.MaxSize, 1u) / (float)std::max(width, height));
+
+		ImageSpecification specification;
+		specification.Width = std::max(1u, (uint32_t)(width * scale + 0.5f));
+		specification.Height = std::max(1u, (uint32_t)(height * scale + 0.5f));
+		specification.Format = m_Specification.Format;
+		std::shared_ptr<Image> thumbnail = std::make_shared<Image>(specification);
+
+		m_Pending.push_back({ source, thumbnail });
+		return thumbnail;
+	}
+
+	void ThumbnailGenerator::PrepareScratch()
+	{
+		// Sized for the first halving step of the largest source
+		uint32_t width = 0, height = 0;
+		for (const PendingThumbnail& pending : m_Pending)
+		{
+			uint32_t sourceWidth = pending.Source->GetWidth(), sourceHeight = pending.Source->GetHeight();
+			uint32_t thumbnailWidth = pending.Thumbnail->GetWidth(), thumbnailHeight = pending.Thumbnail->GetHeight();
+			if (sourceWidth <= thumbnailWidth * 2 && sourceHeight <= thumbnailHeight * 2)
+				continue;
+
+			width = std::max(width, std::max((sourceWidth + 1) / 2, thumbnailWidth));
+			height = std::max(height, std::max((sourceHeight + 1) / 2, thumbnailHeight));
+		}
+
+		if (width == 0)
+			return;
+
+		for (std::shared_ptr<Image>& scratch : m_Scratch)
+		{
+			if (scratch)
+			{
+				// Keeps the allocation when it fits, shrinks once it has been far too large for a while
+				scratch->Resize(width, height);
+			}
+			else
+			{
+				ImageSpecification specification;
+				specification.Width = width;
+				specification.Height = height;
+				specification.Format = m_Specification.Format;
+				scratch = std::make_shared<Image>(specification);
+
+				ImageResizePolicy policy;
+				policy.KeepCapacity = true;
+				scratch->SetResizePolicy(policy);
+			}
+		}
+	}
+
+	void ThumbnailGenerator::Record(VkCommandBuffer commandBuffer)
+	{
+		if (m_Pending.empty())
+			return;
+
+		PrepareScratch();
+
+		for (const PendingThumbnail& pending : m_Pending)
+		{
+			uint32_t thumbnailWidth = pending.Thumbnail->GetWidth(), thumbnailHeight = pending.Thumbnail->GetHeight();
+
+			// A linear blit samples 2x2 texels, so reduce by at most 2x per step
+			std::shared_ptr<Image> current = pending.Source;
+			ImageRegion region = { 0, 0, current->GetWidth(), current->GetHeight() };
+			uint32_t scratchIndex = 0;
+			while (region.Width > thumbnailWidth * 2 || region.Height > thumbnailHeight * 2)
+			{
+				ImageRegion next = { 0, 0, std::max((region.Width + 1) / 2, thumbnailWidth), std::max((region.Height + 1) / 2, thumbnailHeight) };
+				m_Batch.Blit(current, region, m_Scratch[scratchIndex], next);
+				current = m_Scratch[scratchIndex];
+				region = next;
+				scratchIndex ^= 1;
+			}
+
+			m_Batch.Blit(current, region, pending.Thumbnail, ImageRegion{ 0, 0, thumbnailWidth, thumbnailHeight });
+		}
+
+		m_Batch.Record(commandBuffer);
+		m_Pending.clear();
+	}
+
+	void ThumbnailGenerator::Flush()
+	{
+		if (m_Pending.empty())
+			return;
+
+		VkCommandBuffer commandBuffer = Application::GetCommandBuffer(true);
+		Record(commandBuffer);
+		Application::FlushCommandBuffer(commandBuffer);
+	}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "Image.h"
+#include "ImageBlit.h"
+
+namespace Walnut {
+
+	struct ThumbnailSpecification
+	{
+		// Thumbnails fit into MaxSize x MaxSize, keeping the aspect ratio. Smaller images are not scaled up.
+		uint32_t MaxSize = 128;
+		// RGBA32F sources are clamped, not tonemapped, when converted to RGBA
+		ImageFormat Format = ImageFormat::RGBA;
+	};
+
+	// Downscaled previews of images that are already on the GPU, e.g. for an asset browser. All pending thumbnails
+	// are built in one batch of blits, halving the image step by step so that every source pixel contributes.
+	class ThumbnailGenerator
+	{
+	public:
+		ThumbnailGenerator(const ThumbnailSpecification& specification = ThumbnailSpecification());
+
+		// The thumbnail is returned right away, it is written by the next Record or Flush: call Record in
+		// Layer::OnRender of the frame that first draws it
+		std::shared_ptr<Image> Request(const std::shared_ptr<Image>& source);
+
+		void Record(VkCommandBuffer commandBuffer);
+		// Records into a one-time command buffer and waits for it
+		void Flush();
+
+		size_t GetPendingCount() const { return m_Pending.size(); }
+	private:
+		void PrepareScratch();
+	private:
+		struct PendingThumbnail
+		{
+			std::shared_ptr<Image> Source;
+			std::shared_ptr<Image> Thumbnail;
+		};
+
+		ThumbnailSpecification m_Specification;
+		std::vector<PendingThumbnail> m_Pending;
+		ImageBlitBatch m_Batch;
+
+		// Ping-pong targets of the halving steps, shared by all thumbnails of a batch
+		std::shared_ptr<Image> m_Scratch[2];
+	};
+
+}
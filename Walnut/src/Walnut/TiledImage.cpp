@@ -0,0 +1,739 @@
+#include "TiledImage.h"
+
+#include "imgui.h"
+
+#include "Application.h"
+#include "Metrics.h"
+
+#include "stb_image.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace Walnut {
+
+	// Main thread only
+	static std::vector<TiledImage*> s_Instances;
+
+	static constexpr uint32_t s_FileVersion = 1;
+	// Staging slots per tile uploaded in a frame, enough for the frames in flight to finish copying from them
+	static constexpr uint32_t s_StagingSlotsPerUpload = 4;
+
+	struct TiledImageFileHeader
+	{
+		char Magic[4] = { 'W', 'T', 'I', 'L' };
+		uint32_t Version = s_FileVersion;
+		uint32_t Width = 0, Height = 0;
+		uint32_t TileSize = 0;
+		uint32_t LevelCount = 0;
+		uint32_t Reserved[10] = {};
+	};
+	static_assert(sizeof(TiledImageFileHeader) == 64, "The header size is part of the file format");
+
+	namespace Utils {
+
+		struct TiledImageMetrics
+		{
+			MetricCounter& TilesUploaded;
+			MetricCounter& TilesEvicted;
+			MetricCounter& BytesRead;
+		};
+
+		static TiledImageMetrics& GetTiledImageMetrics()
+		{
+			static TiledImageMetrics s_Metrics = {
+				Metrics::GetCounter("walnut_tiled_image_tiles_uploaded_total", "Tiles copied into a TiledImage atlas"),
+				Metrics::GetCounter("walnut_tiled_image_tiles_evicted_total", "Resident tiles evicted from a TiledImage atlas"),
+				Metrics::GetCounter("walnut_tiled_image_read_bytes_total", "Bytes read from tiled image files")
+			};
+			return s_Metrics;
+		}
+
+		static uint32_t GetVulkanMemoryType(VkMemoryPropertyFlags properties, uint32_t type_bits)
+		{
+			VkPhysicalDeviceMemoryProperties prop;
+			vkGetPhysicalDeviceMemoryProperties(Application::GetPhysicalDevice(), &prop);
+			for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
+			{
+				if ((prop.memoryTypes[i].propertyFlags & properties) == properties && type_bits & (1 << i))
+					return i;
+			}
+
+			return 0xffffffff;
+		}
+
+		static uint32_t GetMaxImageDimension2D()
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(Application::GetPhysicalDevice(), &properties);
+			return properties.limits.maxImageDimension2D;
+		}
+
+		static uint32_t ComputeLevelCount(uint32_t width, uint32_t height, uint32_t tileSize)
+		{
+			uint32_t levelCount = 1;
+			while (width > tileSize || height > tileSize)
+			{
+				width = (width + 1) / 2;
+				height = (height + 1) / 2;
+				levelCount++;
+			}
+			return levelCount;
+		}
+
+		// Level in the top 8 bits, then 28 bits each for the tile row and column
+		static uint64_t TileKey(uint32_t level, uint32_t tileX, uint32_t tileY)
+		{
+			return ((uint64_t)level << 56) | ((uint64_t)tileY << 28) | (uint64_t)tileX;
+		}
+
+		static void DecodeTileKey(uint64_t key, uint32_t& level, uint32_t& tileX, uint32_t& tileY)
+		{
+			level = (uint32_t)(key >> 56);
+			tileY = (uint32_t)(key >> 28) & 0xfffffff;
+			tileX = (uint32_t)key & 0xfffffff;
+		}
+
+		static bool ReadHeader(std::istream& stream, TiledImageInfo& info)
+		{
+			TiledImageFileHeader header;
+			if (!stream.read((char*)&header, sizeof(header)))
+				return false;
+			if (memcmp(header.Magic, "WTIL", 4) != 0 || header.Version != s_FileVersion)
+				return false;
+			if (header.Width == 0 || header.Height == 0 || header.TileSize == 0 || header.TileSize > 8192)
+				return false;
+			if (header.LevelCount != ComputeLevelCount(header.Width, header.Height, header.TileSize))
+				return false;
+
+			info.Width = header.Width;
+			info.Height = header.Height;
+			info.TileSize = header.TileSize;
+			info.LevelCount = header.LevelCount;
+			return true;
+		}
+
+		// Box filter of up to 2x2 child tiles, pixels outside the valid child region repeat its edge
+		static void DownsampleTile(const uint8_t* quad, uint32_t quadSize, uint32_t validWidth, uint32_t validHeight, uint8_t* tile, uint32_t tileSize)
+		{
+			uint32_t width = std::min(tileSize, (validWidth + 1) / 2);
+			uint32_t height = std::min(tileSize, (validHeight + 1) / 2);
+			for (uint32_t y = 0; y < height; y++)
+			{
+				uint32_t y0 = std::min(y * 2, validHeight - 1), y1 = std::min(y * 2 + 1, validHeight - 1);
+				for (uint32_t x = 0; x < width; x++)
+				{
+					uint32_t x0 = std::min(x * 2, validWidth - 1), x1 = std::min(x * 2 + 1, validWidth - 1);
+					const uint8_t* p00 = quad + ((size_t)y0 * quadSize + x0) * 4;
+					const uint8_t* p01 = quad + ((size_t)y0 * quadSize + x1) * 4;
+					const uint8_t* p10 = quad + ((size_t)y1 * quadSize + x0) * 4;
+					const uint8_t* p11 = quad + ((size_t)y1 * quadSize + x1) * 4;
+					uint8_t* out = tile + ((size_t)y * tileSize + x) * 4;
+					for (uint32_t c = 0; c < 4; c++)
+						out[c] = (uint8_t)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+				}
+			}
+		}
+
+	}
+
+	uint32_t TiledImageInfo::GetLevelWidth(uint32_t level) const
+	{
+		return std::max(1u, (uint32_t)(((uint64_t)Width + (1ull << level) - 1) >> level));
+	}
+
+	uint32_t TiledImageInfo::GetLevelHeight(uint32_t level) const
+	{
+		return std::max(1u, (uint32_t)(((uint64_t)Height + (1ull << level) - 1) >> level));
+	}
+
+	uint32_t TiledImageInfo::GetTilesX(uint32_t level) const
+	{
+		return (GetLevelWidth(level) + TileSize - 1) / TileSize;
+	}
+
+	uint32_t TiledImageInfo::GetTilesY(uint32_t level) const
+	{
+		return (GetLevelHeight(level) + TileSize - 1) / TileSize;
+	}
+
+	uint64_t TiledImageInfo::GetTileOffset(uint32_t level, uint32_t tileX, uint32_t tileY) const
+	{
+		uint64_t tileIndex = 0;
+		for (uint32_t i = 0; i < level; i++)
+			tileIndex += (uint64_t)GetTilesX(i) * GetTilesY(i);
+		tileIndex += (uint64_t)tileY * GetTilesX(level) + tileX;
+		return sizeof(TiledImageFileHeader) + tileIndex * GetTileBytes();
+	}
+
+	TiledImage::TiledImage(std::string_view path, const TiledImageSpecification& specification)
+		: m_Filepath(path), m_Specification(specification)
+	{
+		std::ifstream file(m_Filepath, std::ios::binary);
+		if (!file || !Utils::ReadHeader(file, m_Info))
+		{
+			std::cerr << "[TiledImage] " << m_Filepath << " is not a tiled image" << std::endl;
+			return;
+		}
+
+		file.seekg(0, std::ios::end);
+		uint64_t expectedSize = m_Info.GetTileOffset(m_Info.LevelCount, 0, 0);
+		if ((uint64_t)file.tellg() < expectedSize)
+		{
+			std::cerr << "[TiledImage] " << m_Filepath << " is truncated" << std::endl;
+			return;
+		}
+
+		uint32_t atlasSize = std::min(m_Specification.AtlasSize, Utils::GetMaxImageDimension2D());
+		if (m_Info.TileSize > atlasSize)
+		{
+			std::cerr << "[TiledImage] Tile size " << m_Info.TileSize << " exceeds the atlas size " << atlasSize << std::endl;
+			return;
+		}
+
+		m_Valid = true;
+		CreateAtlas();
+		s_Instances.push_back(this);
+
+		uint32_t loaderCount = std::max(m_Specification.LoaderThreads, 1u);
+		for (uint32_t i = 0; i < loaderCount; i++)
+			m_Loaders.emplace_back(&TiledImage::LoaderThread, this);
+	}
+
+	TiledImage::~TiledImage()
+	{
+		{
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+			m_StopLoaders = true;
+		}
+		m_Condition.notify_all();
+		for (std::thread& loader : m_Loaders)
+			loader.join();
+
+		s_Instances.erase(std::remove(s_Instances.begin(), s_Instances.end(), this), s_Instances.end());
+
+		// Freeing the memory implicitly unmaps it, the atlas is released by Image
+		DeletionQueue& deletionQueue = Application::GetDeletionQueue();
+		deletionQueue.Push(m_StagingBuffer);
+		deletionQueue.Push(m_StagingMemory);
+	}
+
+	void TiledImage::CreateAtlas()
+	{
+		VkDevice device = Application::GetDevice();
+
+		uint32_t atlasSize = std::min(m_Specification.AtlasSize, Utils::GetMaxImageDimension2D());
+		m_SlotsPerRow = atlasSize / m_Info.TileSize;
+
+		ImageSpecification specification;
+		specification.Width = m_SlotsPerRow * m_Info.TileSize;
+		specification.Height = m_SlotsPerRow * m_Info.TileSize;
+		specification.Format = ImageFormat::RGBA;
+		m_Atlas = std::make_shared<Image>(specification);
+
+		m_Slots.resize((size_t)m_SlotsPerRow * m_SlotsPerRow);
+		m_Resident.reserve(m_Slots.size());
+
+		// Persistently mapped, loaded tiles are copied into the next free slot of the ring
+		uint32_t maxUploads = std::max(m_Specification.MaxUploadsPerFrame, 1u);
+		m_StagingSlots.resize((size_t)maxUploads * s_StagingSlotsPerUpload);
+
+		VkBufferCreateInfo buffer_info = {};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = m_StagingSlots.size() * m_Info.GetTileBytes();
+		buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkResult err = vkCreateBuffer(device, &buffer_info, Application::GetAllocator(), &m_StagingBuffer);
+		check_vk_result(err);
+
+		VkMemoryRequirements req;
+		vkGetBufferMemoryRequirements(device, m_StagingBuffer, &req);
+
+		m_StagingCoherent = true;
+		uint32_t memoryType = Utils::GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+		if (memoryType == 0xffffffff)
+		{
+			m_StagingCoherent = false;
+			memoryType = Utils::GetVulkanMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, req.memoryTypeBits);
+		}
+
+		VkMemoryAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = req.size;
+		alloc_info.memoryTypeIndex = memoryType;
+		err = vkAllocateMemory(device, &alloc_info, Application::GetAllocator(), &m_StagingMemory);
+		check_vk_result(err);
+		err = vkBindBufferMemory(device, m_StagingBuffer, m_StagingMemory, 0);
+		check_vk_result(err);
+		err = vkMapMemory(device, m_StagingMemory, 0, VK_WHOLE_SIZE, 0, (void**)&m_StagingMapped);
+		check_vk_result(err);
+	}
+
+	void TiledImage::Draw(const ImVec2& size)
+	{
+		if (!m_Valid)
+		{
+			ImGui::TextUnformatted("Invalid tiled image");
+			return;
+		}
+
+		ImVec2 available = ImGui::GetContentRegionAvail();
+		ImVec2 widgetSize(size.x > 0.0f ? size.x : std::max(available.x, 1.0f), size.y > 0.0f ? size.y : std::max(available.y, 1.0f));
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+
+		ImGui::PushID(this);
+		ImGui::InvisibleButton("##TiledImage", widgetSize);
+		ImGui::PopID();
+
+		glm::dvec2 viewSize(widgetSize.x, widgetSize.y);
+		glm::dvec2 imageSize(m_Info.Width, m_Info.Height);
+		double fitZoom = glm::min(viewSize.x / imageSize.x, viewSize.y / imageSize.y);
+		if (m_View.Zoom <= 0.0)
+		{
+			m_View.Zoom = fitZoom;
+			m_View.Center = imageSize * 0.5;
+		}
+
+		// Pan and zoom, keeping the image point under the cursor in place
+		ImGuiIO& io = ImGui::GetIO();
+		glm::dvec2 widgetCenter = glm::dvec2(origin.x, origin.y) + viewSize * 0.5;
+		if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left, 0.0f))
+			m_View.Center -= glm::dvec2(io.MouseDelta.x, io.MouseDelta.y) / m_View.Zoom;
+		if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f)
+		{
+			glm::dvec2 mouse = glm::dvec2(io.MousePos.x, io.MousePos.y) - widgetCenter;
+			glm::dvec2 anchor = m_View.Center + mouse / m_View.Zoom;
+			m_View.Zoom = glm::clamp(m_View.Zoom * glm::pow(1.2, (double)io.MouseWheel), fitZoom * 0.25, 64.0);
+			m_View.Center = anchor - mouse / m_View.Zoom;
+		}
+
+		// Coarsest level that still has at least one texel per screen pixel
+		uint32_t level = (uint32_t)glm::clamp((int)glm::floor(glm::log2(1.0 / m_View.Zoom)), 0, (int)m_Info.LevelCount - 1);
+
+		glm::dvec2 visibleMin = glm::clamp(m_View.Center - viewSize * 0.5 / m_View.Zoom, glm::dvec2(0.0), imageSize);
+		glm::dvec2 visibleMax = glm::clamp(m_View.Center + viewSize * 0.5 / m_View.Zoom, glm::dvec2(0.0), imageSize);
+		m_Wanted.clear();
+
+		// Always resident once loaded, so something can be drawn for every region
+		uint32_t coarsest = m_Info.LevelCount - 1;
+		if (!m_Resident.count(Utils::TileKey(coarsest, 0, 0)))
+			m_Wanted.push_back(Utils::TileKey(coarsest, 0, 0));
+
+		uint64_t frameNumber = Application::GetCurrentFrameNumber();
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		drawList->PushClipRect(origin, ImVec2(origin.x + widgetSize.x, origin.y + widgetSize.y), true);
+
+		ImTextureID textureID = (ImTextureID)m_Atlas->GetDescriptorSet();
+		double atlasSize = (double)m_Atlas->GetWidth();
+		auto toScreen = [&](const glm::dvec2& position) {
+			glm::dvec2 screen = widgetCenter + (position - m_View.Center) * m_View.Zoom;
+			return ImVec2((float)screen.x, (float)screen.y);
+		};
+		// Level 0 region [min, max] from the resident tile, inset by half a texel so linear filtering stays inside the slot
+		auto drawFromTile = [&](uint32_t slot, uint32_t tileLevel, uint32_t tileX, uint32_t tileY, const glm::dvec2& min, const glm::dvec2& max) {
+			TouchSlot(slot, frameNumber);
+			double scale = (double)(1ull << tileLevel);
+			glm::dvec2 tileOrigin = glm::dvec2(tileX, tileY) * (double)m_Info.TileSize;
+			glm::dvec2 slotOrigin = glm::dvec2(slot % m_SlotsPerRow, slot / m_SlotsPerRow) * (double)m_Info.TileSize;
+			glm::dvec2 texel0 = glm::max(min / scale - tileOrigin, glm::dvec2(0.5));
+			glm::dvec2 texel1 = glm::min(max / scale - tileOrigin, glm::dvec2(m_Info.TileSize - 0.5));
+			glm::dvec2 uv0 = (slotOrigin + texel0) / atlasSize;
+			glm::dvec2 uv1 = (slotOrigin + texel1) / atlasSize;
+			drawList->AddImage(textureID, toScreen(min), toScreen(max), ImVec2((float)uv0.x, (float)uv0.y), ImVec2((float)uv1.x, (float)uv1.y));
+		};
+
+		// Coarser if the visible tiles would take more than half the atlas, they would evict each other otherwise
+		double tileExtent;
+		uint32_t tileX0, tileY0, tileX1, tileY1;
+		while (true)
+		{
+			tileExtent = (double)m_Info.TileSize * (double)(1ull << level);
+			tileX0 = (uint32_t)(visibleMin.x / tileExtent);
+			tileY0 = (uint32_t)(visibleMin.y / tileExtent);
+			tileX1 = std::min((uint32_t)glm::ceil(visibleMax.x / tileExtent), m_Info.GetTilesX(level));
+			tileY1 = std::min((uint32_t)glm::ceil(visibleMax.y / tileExtent), m_Info.GetTilesY(level));
+			if (level + 1 >= m_Info.LevelCount || (size_t)(tileX1 - tileX0) * (tileY1 - tileY0) <= m_Slots.size() / 2)
+				break;
+			level++;
+		}
+
+		size_t firstMissing = m_Wanted.size();
+		for (uint32_t tileY = tileY0; tileY < tileY1; tileY++)
+		{
+			for (uint32_t tileX = tileX0; tileX < tileX1; tileX++)
+			{
+				glm::dvec2 min = glm::dvec2(tileX, tileY) * tileExtent;
+				glm::dvec2 max = glm::min(min + tileExtent, imageSize);
+
+				uint64_t key = Utils::TileKey(level, tileX, tileY);
+				auto it = m_Resident.find(key);
+				if (it != m_Resident.end())
+				{
+					drawFromTile(it->second, level, tileX, tileY, min, max);
+					continue;
+				}
+
+				m_Wanted.push_back(key);
+
+				// Stand in with the closest resident ancestor
+				for (uint32_t parentLevel = level + 1; parentLevel < m_Info.LevelCount; parentLevel++)
+				{
+					double parentExtent = (double)m_Info.TileSize * (double)(1ull << parentLevel);
+					uint32_t parentX = (uint32_t)(min.x / parentExtent), parentY = (uint32_t)(min.y / parentExtent);
+					auto parent = m_Resident.find(Utils::TileKey(parentLevel, parentX, parentY));
+					if (parent != m_Resident.end())
+					{
+						drawFromTile(parent->second, parentLevel, parentX, parentY, min, max);
+						break;
+					}
+				}
+			}
+		}
+
+		drawList->PopClipRect();
+
+		// Tiles closest to the center of the view are loaded first
+		glm::dvec2 center = m_View.Center / tileExtent;
+		std::sort(m_Wanted.begin() + firstMissing, m_Wanted.end(), [&](uint64_t a, uint64_t b) {
+			uint32_t levelA, xA, yA, levelB, xB, yB;
+			Utils::DecodeTileKey(a, levelA, xA, yA);
+			Utils::DecodeTileKey(b, levelB, xB, yB);
+			glm::dvec2 da = glm::dvec2(xA + 0.5, yA + 0.5) - center, db = glm::dvec2(xB + 0.5, yB + 0.5) - center;
+			return glm::dot(da, da) < glm::dot(db, db);
+		});
+		RequestTiles(m_Wanted);
+	}
+
+	void TiledImage::RequestTiles(const std::vector<uint64_t>& tiles)
+	{
+		{
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+
+			// Replaces what was requested before, tiles that scrolled out of view are not loaded anymore
+			m_Queue.clear();
+			for (auto it = tiles.rbegin(); it != tiles.rend(); ++it)
+			{
+				uint64_t key = *it;
+				if (m_Loading.count(key))
+					continue;
+				auto loaded = std::find_if(m_Loaded.begin(), m_Loaded.end(), [key](const LoadedTile& tile) { return tile.Key == key; });
+				if (loaded == m_Loaded.end())
+					m_Queue.push_back(key);
+			}
+
+			if (m_Queue.empty())
+				return;
+		}
+		m_Condition.notify_all();
+	}
+
+	void TiledImage::LoaderThread()
+	{
+		std::ifstream file(m_Filepath, std::ios::binary);
+		bool reportedError = false;
+
+		while (true)
+		{
+			uint64_t key;
+			std::vector<uint8_t> pixels;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_Condition.wait(lock, [this]() { return m_StopLoaders || !m_Queue.empty(); });
+				if (m_StopLoaders)
+					return;
+
+				key = m_Queue.back();
+				m_Queue.pop_back();
+				m_Loading.insert(key);
+				if (!m_FreePixels.empty())
+				{
+					pixels = std::move(m_FreePixels.back());
+					m_FreePixels.pop_back();
+				}
+			}
+
+			uint32_t level, tileX, tileY;
+			Utils::DecodeTileKey(key, level, tileX, tileY);
+			pixels.resize(m_Info.GetTileBytes());
+			file.seekg((std::streamoff)m_Info.GetTileOffset(level, tileX, tileY));
+			if (!file.read((char*)pixels.data(), pixels.size()))
+			{
+				// Shown black rather than requested over and over
+				if (!reportedError)
+					std::cerr << "[TiledImage] Failed to read tiles from " << m_Filepath << std::endl;
+				reportedError = true;
+				file.clear();
+				memset(pixels.data(), 0, pixels.size());
+			}
+			Utils::GetTiledImageMetrics().BytesRead.Increment(pixels.size());
+
+			std::scoped_lock<std::mutex> lock(m_Mutex);
+			m_Loading.erase(key);
+			m_BytesRead += pixels.size();
+			m_Loaded.push_back({ key, std::move(pixels) });
+		}
+	}
+
+	void TiledImage::RecordUploads(VkCommandBuffer commandBuffer, uint64_t frameNumber)
+	{
+		for (TiledImage* image : s_Instances)
+			image->RecordInstanceUploads(commandBuffer, frameNumber);
+	}
+
+	void TiledImage::RecordInstanceUploads(VkCommandBuffer commandBuffer, uint64_t frameNumber)
+	{
+		uint64_t completedFrame = Application::GetCompletedFrameNumber();
+		uint32_t maxUploads = std::max(m_Specification.MaxUploadsPerFrame, 1u);
+		uint64_t tileBytes = m_Info.GetTileBytes();
+
+		// Copied into the staging ring under the lock, the loaders only wait for a few memcpys
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+
+		uint32_t uploads = 0;
+		size_t consumed = 0;
+		for (; consumed < m_Loaded.size() && uploads < maxUploads; consumed++)
+		{
+			LoadedTile& tile = m_Loaded[consumed];
+			if (m_Resident.count(tile.Key))
+				continue;
+
+			// The ring is used in order, if the next slot is still read by a frame in flight so are the ones after it
+			StagingSlot& staging = m_StagingSlots[m_NextStagingSlot];
+			if (staging.Frame > completedFrame)
+				break;
+
+			// Every slot was drawn this frame: drop the tile, it is requested again if it is still visible
+			uint32_t slot = AcquireSlot(frameNumber);
+			if (slot == UINT32_MAX)
+				continue;
+
+			uint64_t stagingOffset = (uint64_t)m_NextStagingSlot * tileBytes;
+			memcpy(m_StagingMapped + stagingOffset, tile.Pixels.data(), tileBytes);
+			staging.Frame = frameNumber;
+			m_NextStagingSlot = (m_NextStagingSlot + 1) % (uint32_t)m_StagingSlots.size();
+
+			if (uploads == 0)
+				m_Atlas->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+			VkBufferImageCopy region = {};
+			region.bufferOffset = stagingOffset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset.x = (int32_t)((slot % m_SlotsPerRow) * m_Info.TileSize);
+			region.imageOffset.y = (int32_t)((slot / m_SlotsPerRow) * m_Info.TileSize);
+			region.imageExtent.width = m_Info.TileSize;
+			region.imageExtent.height = m_Info.TileSize;
+			region.imageExtent.depth = 1;
+			vkCmdCopyBufferToImage(commandBuffer, m_StagingBuffer, m_Atlas->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+			AtlasSlot& atlasSlot = m_Slots[slot];
+			atlasSlot.Key = tile.Key;
+			atlasSlot.Resident = true;
+			atlasSlot.LastUsedFrame = 0;
+			LinkSlot(slot);
+			m_Resident[tile.Key] = slot;
+			uploads++;
+		}
+
+		// Keep the buffers of consumed tiles for the next loads
+		for (size_t i = 0; i < consumed; i++)
+			m_FreePixels.push_back(std::move(m_Loaded[i].Pixels));
+		m_Loaded.erase(m_Loaded.begin(), m_Loaded.begin() + consumed);
+
+		if (uploads == 0)
+			return;
+
+		if (!m_StagingCoherent)
+		{
+			VkMappedMemoryRange range = {};
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory = m_StagingMemory;
+			range.size = VK_WHOLE_SIZE;
+			VkResult err = vkFlushMappedMemoryRanges(Application::GetDevice(), 1, &range);
+			check_vk_result(err);
+		}
+
+		// Also orders the copies after the sampling of the evicted slots by earlier frames
+		m_Atlas->TransitionLayout(commandBuffer, m_Atlas->GetShaderReadLayout());
+
+		m_TilesUploaded += uploads;
+		Utils::GetTiledImageMetrics().TilesUploaded.Increment(uploads);
+	}
+
+	uint32_t TiledImage::AcquireSlot(uint64_t frameNumber)
+	{
+		if (m_UnusedSlots < (uint32_t)m_Slots.size())
+			return m_UnusedSlots++;
+
+		// Least recently used, unless it is drawn this frame
+		uint32_t slot = m_LRUTail;
+		if (slot == UINT32_MAX || m_Slots[slot].LastUsedFrame >= frameNumber)
+			return UINT32_MAX;
+
+		UnlinkSlot(slot);
+		m_Resident.erase(m_Slots[slot].Key);
+		m_Slots[slot].Resident = false;
+		m_TilesEvicted++;
+		Utils::GetTiledImageMetrics().TilesEvicted.Increment();
+		return slot;
+	}
+
+	void TiledImage::TouchSlot(uint32_t slot, uint64_t frameNumber)
+	{
+		m_Slots[slot].LastUsedFrame = frameNumber;
+		if (m_LRUHead == slot)
+			return;
+
+		UnlinkSlot(slot);
+		LinkSlot(slot);
+	}
+
+	void TiledImage::LinkSlot(uint32_t slot)
+	{
+		AtlasSlot& atlasSlot = m_Slots[slot];
+		atlasSlot.Previous = UINT32_MAX;
+		atlasSlot.Next = m_LRUHead;
+		if (m_LRUHead != UINT32_MAX)
+			m_Slots[m_LRUHead].Previous = slot;
+		m_LRUHead = slot;
+		if (m_LRUTail == UINT32_MAX)
+			m_LRUTail = slot;
+	}
+
+	void TiledImage::UnlinkSlot(uint32_t slot)
+	{
+		AtlasSlot& atlasSlot = m_Slots[slot];
+		if (atlasSlot.Previous != UINT32_MAX)
+			m_Slots[atlasSlot.Previous].Next = atlasSlot.Next;
+		else
+			m_LRUHead = atlasSlot.Next;
+		if (atlasSlot.Next != UINT32_MAX)
+			m_Slots[atlasSlot.Next].Previous = atlasSlot.Previous;
+		else
+			m_LRUTail = atlasSlot.Previous;
+		atlasSlot.Previous = UINT32_MAX;
+		atlasSlot.Next = UINT32_MAX;
+	}
+
+	TiledImageStats TiledImage::GetStats() const
+	{
+		TiledImageStats stats;
+		stats.ResidentTiles = (uint32_t)m_Resident.size();
+		stats.AtlasSlots = (uint32_t)m_Slots.size();
+		stats.TilesUploaded = m_TilesUploaded;
+		stats.TilesEvicted = m_TilesEvicted;
+
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+		stats.QueuedTiles = (uint32_t)m_Queue.size();
+		stats.LoadedTiles = (uint32_t)m_Loaded.size();
+		stats.BytesRead = m_BytesRead;
+		return stats;
+	}
+
+	bool TiledImage::Write(const std::string& path, uint32_t width, uint32_t height, const TiledImageSourceFunction& source, uint32_t tileSize)
+	{
+		if (width == 0 || height == 0 || tileSize == 0 || tileSize > 8192)
+		{
+			std::cerr << "[TiledImage] Invalid size " << width << "x" << height << " with tile size " << tileSize << std::endl;
+			return false;
+		}
+
+		TiledImageInfo info;
+		info.Width = width;
+		info.Height = height;
+		info.TileSize = tileSize;
+		info.LevelCount = Utils::ComputeLevelCount(width, height, tileSize);
+
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "[TiledImage] Failed to create " << path << std::endl;
+			return false;
+		}
+
+		TiledImageFileHeader header;
+		header.Width = width;
+		header.Height = height;
+		header.TileSize = tileSize;
+		header.LevelCount = info.LevelCount;
+		file.write((const char*)&header, sizeof(header));
+
+		std::vector<uint8_t> tile(info.GetTileBytes());
+		for (uint32_t tileY = 0; tileY < info.GetTilesY(0); tileY++)
+		{
+			for (uint32_t tileX = 0; tileX < info.GetTilesX(0); tileX++)
+			{
+				uint32_t x = tileX * tileSize, y = tileY * tileSize;
+				memset(tile.data(), 0, tile.size());
+				source(x, y, std::min(tileSize, width - x), std::min(tileSize, height - y), tile.data(), (size_t)tileSize * 4);
+				file.seekp((std::streamoff)info.GetTileOffset(0, tileX, tileY));
+				file.write((const char*)tile.data(), tile.size());
+			}
+		}
+
+		// Every coarser tile from the (up to) four tiles below it, read back from the file
+		uint32_t quadSize = tileSize * 2;
+		std::vector<uint8_t> quad((size_t)quadSize * quadSize * 4);
+		for (uint32_t level = 1; level < info.LevelCount && file; level++)
+		{
+			uint32_t childWidth = info.GetLevelWidth(level - 1), childHeight = info.GetLevelHeight(level - 1);
+			for (uint32_t tileY = 0; tileY < info.GetTilesY(level); tileY++)
+			{
+				for (uint32_t tileX = 0; tileX < info.GetTilesX(level); tileX++)
+				{
+					for (uint32_t child = 0; child < 4; child++)
+					{
+						uint32_t childX = tileX * 2 + (child & 1), childY = tileY * 2 + (child >> 1);
+						if (childX >= info.GetTilesX(level - 1) || childY >= info.GetTilesY(level - 1))
+							continue;
+
+						file.seekg((std::streamoff)info.GetTileOffset(level - 1, childX, childY));
+						file.read((char*)tile.data(), tile.size());
+						for (uint32_t row = 0; row < tileSize; row++)
+						{
+							uint8_t* destination = quad.data() + (((size_t)(child >> 1) * tileSize + row) * quadSize + (size_t)(child & 1) * tileSize) * 4;
+							memcpy(destination, tile.data() + (size_t)row * tileSize * 4, (size_t)tileSize * 4);
+						}
+					}
+
+					uint32_t validWidth = std::min(quadSize, childWidth - tileX * quadSize);
+					uint32_t validHeight = std::min(quadSize, childHeight - tileY * quadSize);
+					memset(tile.data(), 0, tile.size());
+					Utils::DownsampleTile(quad.data(), quadSize, validWidth, validHeight, tile.data(), tileSize);
+					file.seekp((std::streamoff)info.GetTileOffset(level, tileX, tileY));
+					file.write((const char*)tile.data(), tile.size());
+				}
+			}
+		}
+
+		if (!file)
+		{
+			std::cerr << "[TiledImage] Failed to write " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool TiledImage::Convert(const std::string& imagePath, const std::string& path, uint32_t tileSize)
+	{
+		int width, height, channels;
+		uint8_t* data = stbi_load(imagePath.c_str(), &width, &height, &channels, 4);
+		if (!data)
+		{
+			std::cerr << "[TiledImage] Failed to load " << imagePath << std::endl;
+			return false;
+		}
+
+		bool result = Write(path, (uint32_t)width, (uint32_t)height, [&](uint32_t x, uint32_t y, uint32_t regionWidth, uint32_t regionHeight, uint8_t* pixels, size_t rowPitch) {
+			for (uint32_t row = 0; row < regionHeight; row++)
+				memcpy(pixels + row * rowPitch, data + (((size_t)y + row) * width + x) * 4, (size_t)regionWidth * 4);
+		}, tileSize);
+
+		stbi_image_free(data);
+		return result;
+	}
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "imgui.h"
+#include "vulkan/vulkan.h"
+
+#include "Image.h"
+
+#include <glm/glm.hpp>
+
+namespace Walnut {
+
+	// Header of the tiled pyramid format (.wtiles). Level 0 is the full image, every further level halves it until
+	// it fits into one tile. Tiles are RGBA8, always TileSize x TileSize (edge tiles are padded), stored raw and
+	// back to back, level by level and row by row, right after the header.
+	struct TiledImageInfo
+	{
+		uint32_t Width = 0, Height = 0;
+		uint32_t TileSize = 256;
+		uint32_t LevelCount = 0;
+
+		uint32_t GetLevelWidth(uint32_t level) const;
+		uint32_t GetLevelHeight(uint32_t level) const;
+		uint32_t GetTilesX(uint32_t level) const;
+		uint32_t GetTilesY(uint32_t level) const;
+		// Offset of the tile in the file
+		uint64_t GetTileOffset(uint32_t level, uint32_t tileX, uint32_t tileY) const;
+		uint64_t GetTileBytes() const { return (uint64_t)TileSize * TileSize * 4; }
+	};
+
+	// Fills the level 0 region [x, x + width] x [y, y + height] with RGBA8 pixels, rows are rowPitch bytes apart
+	using TiledImageSourceFunction = std::function<void(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint8_t* pixels, size_t rowPitch)>;
+
+	struct TiledImageSpecification
+	{
+		// Square atlas of resident tiles, clamped to maxImageDimension2D (64 MB for 4096)
+		uint32_t AtlasSize = 4096;
+		// Threads reading tiles from disk
+		uint32_t LoaderThreads = 2;
+		// Tiles copied into the atlas per frame, bounds the upload cost of a frame
+		uint32_t MaxUploadsPerFrame = 16;
+	};
+
+	struct TiledImageStats
+	{
+		uint32_t ResidentTiles = 0;
+		uint32_t AtlasSlots = 0;
+		uint32_t QueuedTiles = 0;     // Requested, not loaded yet
+		uint32_t LoadedTiles = 0;     // Loaded, waiting for an upload slot
+		uint64_t TilesUploaded = 0;
+		uint64_t TilesEvicted = 0;
+		uint64_t BytesRead = 0;
+	};
+
+	// Visible region: the level 0 pixel at the center of the widget, and widget pixels per level 0 pixel
+	struct TiledImageView
+	{
+		glm::dvec2 Center = { 0.0, 0.0 };
+		double Zoom = 0.0; // 0 fits the image on the next Draw
+	};
+
+	// Image of any size (far beyond maxImageDimension2D and RAM), streamed from a tiled pyramid file. Only tiles
+	// of the visible region at the level matching the zoom are kept on the GPU, in an atlas with LRU eviction.
+	// Missing tiles are read by loader threads and drawn from a coarser resident level meanwhile.
+	// Use from the main thread: Draw in Layer::OnUIRender, the uploads are recorded by Application in the same frame.
+	class TiledImage
+	{
+	public:
+		TiledImage(std::string_view path, const TiledImageSpecification& specification = TiledImageSpecification());
+		~TiledImage();
+
+		TiledImage(const TiledImage&) = delete;
+		TiledImage& operator=(const TiledImage&) = delete;
+
+		// False if the file could not be opened or is not a tiled image
+		bool IsValid() const { return m_Valid; }
+		const TiledImageInfo& GetInfo() const { return m_Info; }
+		uint32_t GetWidth() const { return m_Info.Width; }
+		uint32_t GetHeight() const { return m_Info.Height; }
+
+		// Widget of the given size (0 = available region). Drag to pan, mouse wheel to zoom.
+		void Draw(const ImVec2& size = ImVec2(0.0f, 0.0f));
+
+		const TiledImageView& GetView() const { return m_View; }
+		void SetView(const TiledImageView& view) { m_View = view; }
+
+		TiledImageStats GetStats() const;
+
+		// Converts level 0, provided region by region by the source, into a tiled pyramid file. Coarser levels are
+		// built from the written tiles, so the image never has to fit into memory.
+		static bool Write(const std::string& path, uint32_t width, uint32_t height, const TiledImageSourceFunction& source, uint32_t tileSize = 256);
+		// For any image stb_image can load (which has to fit into memory)
+		static bool Convert(const std::string& imagePath, const std::string& path, uint32_t tileSize = 256);
+
+		// Called by Application
+		static void RecordUploads(VkCommandBuffer commandBuffer, uint64_t frameNumber);
+	private:
+		void CreateAtlas();
+		void RequestTiles(const std::vector<uint64_t>& tiles);
+		void RecordInstanceUploads(VkCommandBuffer commandBuffer, uint64_t frameNumber);
+		uint32_t AcquireSlot(uint64_t frameNumber);
+		void TouchSlot(uint32_t slot, uint64_t frameNumber);
+		void LinkSlot(uint32_t slot);
+		void UnlinkSlot(uint32_t slot);
+		void LoaderThread();
+	private:
+		struct LoadedTile
+		{
+			uint64_t Key;
+			std::vector<uint8_t> Pixels;
+		};
+
+		// Atlas slot, linked into the LRU list (front = most recently used) once it holds a tile
+		struct AtlasSlot
+		{
+			uint64_t Key = 0;
+			uint64_t LastUsedFrame = 0;
+			uint32_t Previous = UINT32_MAX, Next = UINT32_MAX;
+			bool Resident = false;
+		};
+
+		struct StagingSlot
+		{
+			uint64_t Frame = 0; // Last frame that copied from it
+		};
+
+		std::string m_Filepath;
+		TiledImageInfo m_Info;
+		TiledImageSpecification m_Specification;
+		bool m_Valid = false;
+
+		TiledImageView m_View;
+
+		// Main thread
+		std::shared_ptr<Image> m_Atlas;
+		uint32_t m_SlotsPerRow = 0;
+		std::vector<AtlasSlot> m_Slots;
+		std::unordered_map<uint64_t, uint32_t> m_Resident;
+		uint32_t m_LRUHead = UINT32_MAX, m_LRUTail = UINT32_MAX;
+		uint32_t m_UnusedSlots = 0; // Slots [m_UnusedSlots, count) have never held a tile
+		std::vector<uint64_t> m_Wanted;
+
+		VkBuffer m_StagingBuffer = nullptr;
+		VkDeviceMemory m_StagingMemory = nullptr;
+		uint8_t* m_StagingMapped = nullptr;
+		bool m_StagingCoherent = true;
+		std::vector<StagingSlot> m_StagingSlots;
+		uint32_t m_NextStagingSlot = 0;
+
+		uint64_t m_TilesUploaded = 0;
+		uint64_t m_TilesEvicted = 0;
+
+		// Shared with the loader threads
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::vector<uint64_t> m_Queue; // Back is loaded first
+		std::unordered_set<uint64_t> m_Loading;
+		std::vector<LoadedTile> m_Loaded;
+		std::vector<std::vector<uint8_t>> m_FreePixels;
+		uint64_t m_BytesRead = 0;
+		bool m_StopLoaders = false;
+		std::vector<std::thread> m_Loaders;
+	};
+
+}
@@ -2,7 +2,8 @@
 
 #include <iostream>
 #include <string>
-#include <chrono>
+
+#include "Clock.h"
 
 namespace Walnut {
 
@@ -16,21 +17,26 @@ namespace Walnut {
 
 		void Reset()
 		{
-			m_Start = std::chrono::high_resolution_clock::now();
+			m_Start = Clock::GetNanoseconds();
+		}
+
+		uint64_t ElapsedNanos()
+		{
+			return Clock::GetNanoseconds() - m_Start;
 		}
 
 		float Elapsed()
 		{
-			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - m_Start).count() * 0.001f * 0.001f * 0.001f;
+			return (float)(ElapsedNanos() * 0.001 * 0.001 * 0.001);
 		}
 
 		float ElapsedMillis()
 		{
-			return Elapsed() * 1000.0f;
+			return (float)(ElapsedNanos() * 0.001 * 0.001);
 		}
 
 	private:
-		std::chrono::time_point<std::chrono::high_resolution_clock> m_Start;
+		uint64_t m_Start = 0;
 	};
 
 	class ScopedTimer
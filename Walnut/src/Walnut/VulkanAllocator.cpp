@@ -0,0 +1,301 @@
+#include "VulkanAllocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+namespace Walnut {
+
+	// Stored right before every pointer handed to the driver
+	struct AllocationHeader
+	{
+		void* Base;
+		uint64_t Size;
+		uint32_t Scope;
+		uint32_t SizeClass;
+	};
+
+	struct ScopeCounters
+	{
+		std::atomic<uint64_t> Bytes{ 0 };
+		std::atomic<uint64_t> Allocations{ 0 };
+		std::atomic<uint64_t> PeakBytes{ 0 };
+		std::atomic<uint64_t> TotalAllocations{ 0 };
+		std::atomic<uint64_t> TotalFrees{ 0 };
+		std::atomic<uint64_t> TotalReallocations{ 0 };
+		std::atomic<uint64_t> InternalBytes{ 0 };
+	};
+
+	struct PooledBlock
+	{
+		PooledBlock* Next;
+	};
+
+	struct SizeClassPool
+	{
+		std::mutex Mutex;
+		PooledBlock* FreeList = nullptr;
+	};
+
+	static constexpr uint32_t s_ScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+	static constexpr size_t s_MinAlignment = 16;
+	static constexpr uint32_t s_NoSizeClass = UINT32_MAX;
+	// Block sizes including header and alignment padding, larger allocations always go to malloc
+	static constexpr size_t s_SizeClasses[] = { 64, 128, 256, 512, 1024, 2048, 4096 };
+	static constexpr uint32_t s_SizeClassCount = sizeof(s_SizeClasses) / sizeof(s_SizeClasses[0]);
+
+	static VulkanHostAllocator s_Mode = VulkanHostAllocator::Default;
+	static VkAllocationCallbacks s_Callbacks = {};
+
+	static ScopeCounters s_Scopes[s_ScopeCount];
+	static std::atomic<uint64_t> s_TotalBytes{ 0 };
+	static std::atomic<uint64_t> s_TotalPeakBytes{ 0 };
+
+	static SizeClassPool s_Pools[s_SizeClassCount];
+	static std::atomic<uint64_t> s_PooledFreeBytes{ 0 };
+	static std::atomic<uint64_t> s_PoolHits{ 0 };
+
+	namespace Utils {
+
+		static uint32_t ScopeIndex(VkSystemAllocationScope scope)
+		{
+			return (uint32_t)scope < s_ScopeCount ? (uint32_t)scope : VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+		}
+
+		static void UpdatePeak(std::atomic<uint64_t>& peak, uint64_t value)
+		{
+			uint64_t current = peak.load(std::memory_order_relaxed);
+			while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+				;
+		}
+
+		static void AddLive(uint32_t scope, int64_t bytes, int64_t allocations)
+		{
+			ScopeCounters& counters = s_Scopes[scope];
+			uint64_t scopeBytes = counters.Bytes.fetch_add((uint64_t)bytes, std::memory_order_relaxed) + (uint64_t)bytes;
+			counters.Allocations.fetch_add((uint64_t)allocations, std::memory_order_relaxed);
+			uint64_t totalBytes = s_TotalBytes.fetch_add((uint64_t)bytes, std::memory_order_relaxed) + (uint64_t)bytes;
+
+			if (bytes > 0)
+			{
+				UpdatePeak(counters.PeakBytes, scopeBytes);
+				UpdatePeak(s_TotalPeakBytes, totalBytes);
+			}
+		}
+
+		static AllocationHeader* GetHeader(void* memory)
+		{
+			return (AllocationHeader*)((uint8_t*)memory - sizeof(AllocationHeader));
+		}
+
+		static uint32_t FindSizeClass(size_t blockSize)
+		{
+			if (s_Mode != VulkanHostAllocator::Pooled)
+				return s_NoSizeClass;
+
+			for (uint32_t i = 0; i < s_SizeClassCount; i++)
+			{
+				if (blockSize <= s_SizeClasses[i])
+					return i;
+			}
+			return s_NoSizeClass;
+		}
+
+		// Allocation without statistics, shared by allocate and reallocate
+		static void* AllocateBlock(size_t size, size_t alignment, uint32_t scope)
+		{
+			alignment = std::max(alignment, s_MinAlignment);
+			size_t blockSize = size + sizeof(AllocationHeader) + alignment;
+
+			uint32_t sizeClass = FindSizeClass(blockSize);
+			void* base = nullptr;
+			if (sizeClass != s_NoSizeClass)
+			{
+				SizeClassPool& pool = s_Pools[sizeClass];
+				{
+					std::scoped_lock<std::mutex> lock(pool.Mutex);
+					if (pool.FreeList)
+					{
+						base = pool.FreeList;
+						pool.FreeList = pool.FreeList->Next;
+					}
+				}
+
+				if (base)
+				{
+					s_PooledFreeBytes.fetch_sub(s_SizeClasses[sizeClass], std::memory_order_relaxed);
+					s_PoolHits.fetch_add(1, std::memory_order_relaxed);
+				}
+				blockSize = s_SizeClasses[sizeClass];
+			}
+
+			if (!base)
+				base = malloc(blockSize);
+			if (!base)
+				return nullptr;
+
+			uintptr_t address = ((uintptr_t)base + sizeof(AllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			void* memory = (void*)address;
+
+			AllocationHeader* header = GetHeader(memory);
+			header->Base = base;
+			header->Size = size;
+			header->Scope = scope;
+			header->SizeClass = sizeClass;
+			return memory;
+		}
+
+		static void FreeBlock(AllocationHeader* header)
+		{
+			if (header->SizeClass == s_NoSizeClass)
+			{
+				free(header->Base);
+				return;
+			}
+
+			uint32_t sizeClass = header->SizeClass;
+			PooledBlock* block = (PooledBlock*)header->Base;
+			SizeClassPool& pool = s_Pools[sizeClass];
+			{
+				std::scoped_lock<std::mutex> lock(pool.Mutex);
+				block->Next = pool.FreeList;
+				pool.FreeList = block;
+			}
+			s_PooledFreeBytes.fetch_add(s_SizeClasses[sizeClass], std::memory_order_relaxed);
+		}
+
+	}
+
+	static void* VKAPI_CALL Allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope allocationScope)
+	{
+		uint32_t scope = Utils::ScopeIndex(allocationScope);
+		void* memory = Utils::AllocateBlock(size, alignment, scope);
+		if (!memory)
+			return nullptr;
+
+		Utils::AddLive(scope, (int64_t)size, 1);
+		s_Scopes[scope].TotalAllocations.fetch_add(1, std::memory_order_relaxed);
+		return memory;
+	}
+
+	static void VKAPI_CALL Free(void* userData, void* memory)
+	{
+		if (!memory)
+			return;
+
+		AllocationHeader* header = Utils::GetHeader(memory);
+		Utils::AddLive(header->Scope, -(int64_t)header->Size, -1);
+		s_Scopes[header->Scope].TotalFrees.fetch_add(1, std::memory_order_relaxed);
+		Utils::FreeBlock(header);
+	}
+
+	static void* VKAPI_CALL Reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope allocationScope)
+	{
+		if (!original)
+			return Allocate(userData, size, alignment, allocationScope);
+
+		if (size == 0)
+		{
+			Free(userData, original);
+			return nullptr;
+		}
+
+		// On failure the original has to stay valid
+		uint32_t scope = Utils::ScopeIndex(allocationScope);
+		void* memory = Utils::AllocateBlock(size, alignment, scope);
+		if (!memory)
+			return nullptr;
+
+		AllocationHeader* header = Utils::GetHeader(original);
+		memcpy(memory, original, std::min<size_t>((size_t)header->Size, size));
+
+		Utils::AddLive(header->Scope, -(int64_t)header->Size, -1);
+		Utils::AddLive(scope, (int64_t)size, 1);
+		s_Scopes[scope].TotalReallocations.fetch_add(1, std::memory_order_relaxed);
+		Utils::FreeBlock(header);
+		return memory;
+	}
+
+	static void VKAPI_CALL InternalAllocation(void* userData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+	{
+		s_Scopes[Utils::ScopeIndex(allocationScope)].InternalBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	static void VKAPI_CALL InternalFree(void* userData, size_t size, VkInternalAllocationType allocationType, VkSystemAllocationScope allocationScope)
+	{
+		s_Scopes[Utils::ScopeIndex(allocationScope)].InternalBytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+	void VulkanAllocator::Init(VulkanHostAllocator mode)
+	{
+		s_Mode = mode;
+
+		s_Callbacks = {};
+		s_Callbacks.pfnAllocation = Allocate;
+		s_Callbacks.pfnReallocation = Reallocate;
+		s_Callbacks.pfnFree = Free;
+		s_Callbacks.pfnInternalAllocation = InternalAllocation;
+		s_Callbacks.pfnInternalFree = InternalFree;
+
+#ifndef WL_DIST
+		if (mode != VulkanHostAllocator::Default)
+			std::cout << "[VULKAN ALLOCATOR] " << (mode == VulkanHostAllocator::Pooled ? "Pooled" : "Tracking") << " host allocator\n";
+#endif
+	}
+
+	VulkanHostAllocator VulkanAllocator::GetMode()
+	{
+		return s_Mode;
+	}
+
+	const VkAllocationCallbacks* VulkanAllocator::GetCallbacks()
+	{
+		return s_Mode == VulkanHostAllocator::Default ? nullptr : &s_Callbacks;
+	}
+
+	VulkanAllocationStatistics VulkanAllocator::GetStatistics()
+	{
+		VulkanAllocationStatistics statistics;
+		for (uint32_t i = 0; i < s_ScopeCount; i++)
+		{
+			const ScopeCounters& counters = s_Scopes[i];
+			VulkanAllocationScopeStatistics& scope = statistics.Scopes[i];
+			scope.Bytes = counters.Bytes.load(std::memory_order_relaxed);
+			scope.Allocations = counters.Allocations.load(std::memory_order_relaxed);
+			scope.PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+			scope.TotalAllocations = counters.TotalAllocations.load(std::memory_order_relaxed);
+			scope.TotalFrees = counters.TotalFrees.load(std::memory_order_relaxed);
+			scope.TotalReallocations = counters.TotalReallocations.load(std::memory_order_relaxed);
+			scope.InternalBytes = counters.InternalBytes.load(std::memory_order_relaxed);
+
+			statistics.Total.Bytes += scope.Bytes;
+			statistics.Total.Allocations += scope.Allocations;
+			statistics.Total.TotalAllocations += scope.TotalAllocations;
+			statistics.Total.TotalFrees += scope.TotalFrees;
+			statistics.Total.TotalReallocations += scope.TotalReallocations;
+			statistics.Total.InternalBytes += scope.InternalBytes;
+		}
+		statistics.Total.PeakBytes = s_TotalPeakBytes.load(std::memory_order_relaxed);
+		statistics.PooledFreeBytes = s_PooledFreeBytes.load(std::memory_order_relaxed);
+		statistics.PoolHits = s_PoolHits.load(std::memory_order_relaxed);
+		return statistics;
+	}
+
+	const char* VulkanAllocator::GetScopeName(VkSystemAllocationScope scope)
+	{
+		switch (scope)
+		{
+			case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "Command";
+			case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "Object";
+			case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "Cache";
+			case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "Device";
+			case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "Instance";
+		}
+		return "Unknown";
+	}
+
+}
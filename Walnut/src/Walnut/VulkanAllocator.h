@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "vulkan/vulkan.h"
+
+namespace Walnut {
+
+	enum class VulkanHostAllocator
+	{
+		// No callbacks, the driver uses its own allocator
+		Default = 0,
+		// Aligned malloc with per-scope statistics
+		Tracking,
+		// Tracking, plus small allocations are recycled through size-class free lists instead of going back to
+		// malloc, which absorbs the churn of short-lived command-scope allocations
+		Pooled
+	};
+
+	struct VulkanAllocationScopeStatistics
+	{
+		uint64_t Bytes = 0;       // Live
+		uint64_t Allocations = 0; // Live
+		uint64_t PeakBytes = 0;
+		uint64_t TotalAllocations = 0;
+		uint64_t TotalFrees = 0;
+		uint64_t TotalReallocations = 0;
+		// Reported through pfnInternalAllocation, allocated by the driver itself
+		uint64_t InternalBytes = 0;
+	};
+
+	struct VulkanAllocationStatistics
+	{
+		// Indexed by VkSystemAllocationScope
+		VulkanAllocationScopeStatistics Scopes[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1];
+		VulkanAllocationScopeStatistics Total;
+		// Pooled mode only: blocks currently sitting in the free lists
+		uint64_t PooledFreeBytes = 0;
+		uint64_t PoolHits = 0;
+	};
+
+	// Host allocations of the Vulkan driver, plugged in as VkAllocationCallbacks for every object Walnut creates.
+	// Chosen once through ApplicationSpecification::HostAllocator, before the instance is created, since
+	// objects have to be destroyed with callbacks compatible to the ones they were created with.
+	class VulkanAllocator
+	{
+	public:
+		static void Init(VulkanHostAllocator mode);
+
+		static VulkanHostAllocator GetMode();
+		// nullptr in Default mode
+		static const VkAllocationCallbacks* GetCallbacks();
+
+		// Relaxed snapshot, the counters of different scopes may be a few allocations apart
+		static VulkanAllocationStatistics GetStatistics();
+
+		static const char* GetScopeName(VkSystemAllocationScope scope);
+	};
+
+}
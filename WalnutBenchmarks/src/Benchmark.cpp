@@ -0,0 +1,244 @@
+#include "Benchmark.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace Walnut {
+
+	namespace Utils {
+
+		static double NowNanoseconds()
+		{
+			return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		static double Percentile(const std::vector<double>& sorted, double percentile)
+		{
+			if (sorted.empty())
+				return 0.0;
+
+			// Linear interpolation between the closest ranks
+			double rank = percentile * (double)(sorted.size() - 1);
+			size_t lower = (size_t)rank;
+			size_t upper = std::min(lower + 1, sorted.size() - 1);
+			double fraction = rank - (double)lower;
+			return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+		}
+
+		static std::string EscapeJSON(const std::string& text)
+		{
+			std::string result;
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\')
+					result += '\\';
+				result += c;
+			}
+			return result;
+		}
+
+		// Reads back what Finish writes: one result object per line with "name" and "p50_ns"
+		static std::unordered_map<std::string, double> ReadBaseline(const std::string& path)
+		{
+			std::unordered_map<std::string, double> baseline;
+			std::ifstream stream(path);
+			if (!stream)
+			{
+				std::cerr << "[BENCHMARK] Could not read baseline " << path << "\n";
+				return baseline;
+			}
+
+			std::string line;
+			while (std::getline(stream, line))
+			{
+				size_t name = line.find("\"name\": \"");
+				size_t p50 = line.find("\"p50_ns\": ");
+				if (name == std::string::npos || p50 == std::string::npos)
+					continue;
+
+				name += strlen("\"name\": \"");
+				std::string value;
+				for (size_t i = name; i < line.size() && line[i] != '"'; i++)
+				{
+					if (line[i] == '\\' && i + 1 < line.size())
+						i++;
+					value += line[i];
+				}
+				baseline[value] = strtod(line.c_str() + p50 + strlen("\"p50_ns\": "), nullptr);
+			}
+			return baseline;
+		}
+
+		static std::string FormatNanoseconds(double nanoseconds)
+		{
+			char buffer[32];
+			if (nanoseconds < 1e3)
+				snprintf(buffer, sizeof(buffer), "%.2f ns", nanoseconds);
+			else if (nanoseconds < 1e6)
+				snprintf(buffer, sizeof(buffer), "%.2f us", nanoseconds * 1e-3);
+			else
+				snprintf(buffer, sizeof(buffer), "%.2f ms", nanoseconds * 1e-6);
+			return buffer;
+		}
+
+	}
+
+	BenchmarkSuite::BenchmarkSuite(const BenchmarkSettings& settings)
+		: m_Settings(settings)
+	{
+	}
+
+	bool BenchmarkSuite::IsFiltered(const std::string& name) const
+	{
+		return !m_Settings.Filter.empty() && name.find(m_Settings.Filter) == std::string::npos;
+	}
+
+	void BenchmarkSuite::Run(const std::string& name, const BenchmarkFunction& function, uint64_t iterations, const std::function<void()>& cleanup)
+	{
+		if (IsFiltered(name))
+			return;
+
+		auto runSample = [&](uint64_t count)
+		{
+			double start = Utils::NowNanoseconds();
+			function(count);
+			double elapsed = Utils::NowNanoseconds() - start;
+			if (cleanup)
+				cleanup();
+			return elapsed;
+		};
+
+		// Double the iteration count until a sample is long enough, then scale to the target
+		if (iterations == 0)
+		{
+			double minSampleNanoseconds = m_Settings.MinSampleMilliseconds * 1e6;
+			iterations = 1;
+			while (true)
+			{
+				double elapsed = runSample(iterations);
+				if (elapsed >= minSampleNanoseconds)
+					break;
+				if (elapsed >= minSampleNanoseconds * 0.1)
+				{
+					iterations = (uint64_t)ceil((double)iterations * minSampleNanoseconds / elapsed);
+					break;
+				}
+				iterations *= 2;
+			}
+		}
+
+		for (uint32_t i = 0; i < m_Settings.WarmupSamples; i++)
+			runSample(iterations);
+
+		std::vector<double> nanoseconds(m_Settings.Samples);
+		for (double& sample : nanoseconds)
+			sample = runSample(iterations) / (double)iterations;
+
+		AddResult(name, std::move(nanoseconds), iterations);
+	}
+
+	void BenchmarkSuite::AddSamples(const std::string& name, std::vector<double> nanoseconds)
+	{
+		if (IsFiltered(name) || nanoseconds.empty())
+			return;
+
+		AddResult(name, std::move(nanoseconds), 1);
+	}
+
+	void BenchmarkSuite::AddResult(const std::string& name, std::vector<double> nanoseconds, uint64_t iterationsPerSample)
+	{
+		BenchmarkResult& result = m_Results.emplace_back();
+		result.Name = name;
+		result.Samples = (uint32_t)nanoseconds.size();
+		result.IterationsPerSample = iterationsPerSample;
+
+		std::sort(nanoseconds.begin(), nanoseconds.end());
+		double sum = 0.0;
+		for (double sample : nanoseconds)
+			sum += sample;
+		result.Mean = sum / (double)nanoseconds.size();
+
+		double squares = 0.0;
+		for (double sample : nanoseconds)
+			squares += (sample - result.Mean) * (sample - result.Mean);
+		result.StdDev = nanoseconds.size() > 1 ? sqrt(squares / (double)(nanoseconds.size() - 1)) : 0.0;
+		result.CI95 = 1.96 * result.StdDev / sqrt((double)nanoseconds.size());
+
+		result.Min = nanoseconds.front();
+		result.P50 = Utils::Percentile(nanoseconds, 0.50);
+		result.P95 = Utils::Percentile(nanoseconds, 0.95);
+		result.P99 = Utils::Percentile(nanoseconds, 0.99);
+		result.Max = nanoseconds.back();
+
+		std::cout << "[BENCHMARK] " << name << " - " << Utils::FormatNanoseconds(result.P50) << " (p95 " << Utils::FormatNanoseconds(result.P95) << ")\n";
+	}
+
+	uint32_t BenchmarkSuite::Finish()
+	{
+		uint32_t regressions = 0;
+		if (!m_Settings.BaselinePath.empty())
+		{
+			std::unordered_map<std::string, double> baseline = Utils::ReadBaseline(m_Settings.BaselinePath);
+			for (BenchmarkResult& result : m_Results)
+			{
+				auto it = baseline.find(result.Name);
+				if (it == baseline.end() || it->second <= 0.0)
+					continue;
+
+				result.BaselineP50 = it->second;
+				result.Regression = result.P50 > result.BaselineP50 * (1.0 + m_Settings.RegressionThreshold);
+				if (result.Regression)
+					regressions++;
+			}
+		}
+
+		printf("\n%-48s %12s %12s %12s %12s %10s\n", "Benchmark", "p50", "p95", "p99", "baseline", "change");
+		for (const BenchmarkResult& result : m_Results)
+		{
+			char change[32] = "";
+			if (result.BaselineP50 > 0.0)
+				snprintf(change, sizeof(change), "%+.1f%%%s", (result.P50 / result.BaselineP50 - 1.0) * 100.0, result.Regression ? " !" : "");
+			printf("%-48s %12s %12s %12s %12s %10s\n", result.Name.c_str(), Utils::FormatNanoseconds(result.P50).c_str(), Utils::FormatNanoseconds(result.P95).c_str(),
+				Utils::FormatNanoseconds(result.P99).c_str(), result.BaselineP50 > 0.0 ? Utils::FormatNanoseconds(result.BaselineP50).c_str() : "-", change);
+		}
+		if (!m_Settings.BaselinePath.empty())
+			printf("\n%u regression(s) over %.0f%%\n", regressions, m_Settings.RegressionThreshold * 100.0);
+
+		if (!m_Settings.OutputPath.empty())
+		{
+			std::ofstream stream(m_Settings.OutputPath, std::ios::trunc);
+			if (!stream)
+			{
+				std::cerr << "[BENCHMARK] Could not write " << m_Settings.OutputPath << "\n";
+				return regressions;
+			}
+
+			stream.precision(17);
+			stream << "{\n\t\"benchmarks\": [\n";
+			for (size_t i = 0; i < m_Results.size(); i++)
+			{
+				const BenchmarkResult& result = m_Results[i];
+				stream << "\t\t{ \"name\": \"" << Utils::EscapeJSON(result.Name) << "\", \"samples\": " << result.Samples
+					<< ", \"iterations_per_sample\": " << result.IterationsPerSample
+					<< ", \"mean_ns\": " << result.Mean << ", \"stddev_ns\": " << result.StdDev << ", \"ci95_ns\": " << result.CI95
+					<< ", \"min_ns\": " << result.Min << ", \"p50_ns\": " << result.P50 << ", \"p95_ns\": " << result.P95
+					<< ", \"p99_ns\": " << result.P99 << ", \"max_ns\": " << result.Max;
+				if (result.BaselineP50 > 0.0)
+					stream << ", \"baseline_p50_ns\": " << result.BaselineP50 << ", \"regression\": " << (result.Regression ? "true" : "false");
+				stream << " }" << (i + 1 < m_Results.size() ? "," : "") << "\n";
+			}
+			stream << "\t]\n}\n";
+		}
+
+		return regressions;
+	}
+
+}
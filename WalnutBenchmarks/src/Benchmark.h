@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Walnut {
+
+	struct BenchmarkSettings
+	{
+		// Unmeasured samples before the measured ones, to warm caches, allocators and drivers
+		uint32_t WarmupSamples = 3;
+		uint32_t Samples = 30;
+		// Iterations per sample are calibrated so that one sample takes at least this long,
+		// keeping the clock resolution and call overhead out of the per-iteration time
+		double MinSampleMilliseconds = 5.0;
+		// Only benchmarks whose name contains this run
+		std::string Filter;
+
+		// Written as JSON, one result per line. A previous output can be passed as baseline.
+		std::string OutputPath;
+		std::string BaselinePath;
+		// A median this much slower than the baseline median counts as a regression
+		double RegressionThreshold = 0.10;
+	};
+
+	struct BenchmarkResult
+	{
+		std::string Name;
+		uint32_t Samples = 0;
+		uint64_t IterationsPerSample = 0;
+
+		// Nanoseconds per iteration, over the samples
+		double Mean = 0.0, StdDev = 0.0, CI95 = 0.0;
+		double Min = 0.0, P50 = 0.0, P95 = 0.0, P99 = 0.0, Max = 0.0;
+
+		// Median of the baseline run, 0 if the baseline doesn't have this benchmark
+		double BaselineP50 = 0.0;
+		bool Regression = false;
+	};
+
+	// The function runs the benchmarked operation `iterations` times
+	using BenchmarkFunction = std::function<void(uint64_t iterations)>;
+
+	class BenchmarkSuite
+	{
+	public:
+		BenchmarkSuite(const BenchmarkSettings& settings);
+
+		// Iterations = 0 calibrates per sample count, otherwise every sample runs exactly that many.
+		// Cleanup runs after every sample, outside the measured time.
+		void Run(const std::string& name, const BenchmarkFunction& function, uint64_t iterations = 0, const std::function<void()>& cleanup = {});
+		// For measurements taken elsewhere (e.g. frame times), one iteration per sample
+		void AddSamples(const std::string& name, std::vector<double> nanoseconds);
+
+		// Writes OutputPath, compares against BaselinePath and prints a summary. Returns the number of regressions.
+		uint32_t Finish();
+
+		const std::vector<BenchmarkResult>& GetResults() const { return m_Results; }
+	private:
+		bool IsFiltered(const std::string& name) const;
+		void AddResult(const std::string& name, std::vector<double> nanoseconds, uint64_t iterationsPerSample);
+	private:
+		BenchmarkSettings m_Settings;
+		std::vector<BenchmarkResult> m_Results;
+	};
+
+	// Keeps the compiler from optimizing away a value the benchmark computes
+	template<typename T>
+	inline void DoNotOptimize(const T& value)
+	{
+#if defined(_MSC_VER)
+		static volatile char s_Sink;
+		s_Sink = *(const volatile char*)&value;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+}
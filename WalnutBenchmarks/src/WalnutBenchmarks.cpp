@@ -0,0 +1,344 @@
+#include "Walnut/Application.h"
+#include "Walnut/Image.h"
+#include "Walnut/PixelKernels.h"
+#include "Walnut/Random.h"
+#include "Walnut/Timer.h"
+
+#include "Benchmark.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Walnut/EntryPoint.h isn't used, the benchmarks have their own main
+bool g_ApplicationRunning = true;
+
+using namespace Walnut;
+
+class BenchmarkLayer : public Layer
+{
+public:
+	BenchmarkLayer(const BenchmarkSettings& settings, uint32_t warmupFrames, uint32_t frames)
+		: m_Suite(settings), m_WarmupFrames(warmupFrames), m_Frames(frames) {}
+
+	virtual void OnUpdate(float ts) override
+	{
+		// Everything runs from the second frame, when the device and ImGui are fully set up
+		// and Clock::Update has had a chance to calibrate the TSC
+		if (!m_MicroBenchmarksDone)
+		{
+			if (!m_FirstFrameSkipped)
+			{
+				m_FirstFrameSkipped = true;
+				return;
+			}
+
+			RunMicroBenchmarks();
+			m_MicroBenchmarksDone = true;
+			m_LastFrameTime = std::chrono::steady_clock::now();
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_LastFrameTime).count();
+		m_LastFrameTime = now;
+
+		if (m_FrameIndex++ < m_WarmupFrames)
+			return;
+
+		m_FrameTimes.push_back(nanoseconds);
+		if (m_FrameTimes.size() < m_Frames)
+			return;
+
+		// Capped by vsync unless built with IMGUI_UNLIMITED_FRAME_RATE
+		m_Suite.AddSamples("Application/FrameLoop (hidden window, demo UI)", std::move(m_FrameTimes));
+		m_Regressions = m_Suite.Finish();
+		Application::Get().Close();
+	}
+
+	virtual void OnUIRender() override
+	{
+		if (m_MicroBenchmarksDone)
+			ImGui::ShowDemoWindow();
+	}
+
+	uint32_t GetRegressions() const { return m_Regressions; }
+private:
+	void RunMicroBenchmarks()
+	{
+		RunRandomBenchmarks();
+		RunTimerBenchmarks();
+		RunImageBenchmarks();
+		RunCommandBufferBenchmarks();
+		RunPixelKernelBenchmarks();
+	}
+
+	void RunRandomBenchmarks()
+	{
+		Random::Init();
+
+		m_Suite.Run("Random/UInt", [](uint64_t iterations)
+		{
+			uint32_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += Random::UInt();
+			DoNotOptimize(sum);
+		});
+
+		m_Suite.Run("Random/Float", [](uint64_t iterations)
+		{
+			float sum = 0.0f;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += Random::Float();
+			DoNotOptimize(sum);
+		});
+
+		m_Suite.Run("Random/InUnitSphere", [](uint64_t iterations)
+		{
+			glm::vec3 sum(0.0f);
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += Random::InUnitSphere();
+			DoNotOptimize(sum);
+		});
+	}
+
+	void RunTimerBenchmarks()
+	{
+		m_Suite.Run("Timer/Construct+Elapsed", [](uint64_t iterations)
+		{
+			float sum = 0.0f;
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				Timer timer;
+				sum += timer.Elapsed();
+			}
+			DoNotOptimize(sum);
+		});
+
+		m_Suite.Run("Timer/ElapsedMillis", [](uint64_t iterations)
+		{
+			Timer timer;
+			float sum = 0.0f;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += timer.ElapsedMillis();
+			DoNotOptimize(sum);
+		});
+
+		m_Suite.Run(Clock::IsUsingTSC() ? "Clock/GetNanoseconds (TSC)" : "Clock/GetNanoseconds (steady_clock)", [](uint64_t iterations)
+		{
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += Clock::GetNanoseconds();
+			DoNotOptimize(sum);
+		});
+	}
+
+	void RunImageBenchmarks()
+	{
+		// Released images go through the deletion queue, which only drains as frames complete. Nothing
+		// is in flight while the benchmarks run, so everything can be destroyed between samples.
+		auto releaseDeferred = []()
+		{
+			VkDevice device = Application::GetDevice();
+			VkResult err = vkDeviceWaitIdle(device);
+			check_vk_result(err);
+			Application::GetDeletionQueue().FlushAll(device);
+		};
+
+		m_Suite.Run("Image/Create 256x256 RGBA", [](uint64_t iterations)
+		{
+			for (uint64_t i = 0; i < iterations; i++)
+				Image image(256, 256, ImageFormat::RGBA);
+		}, 0, releaseDeferred);
+
+		struct SetDataCase
+		{
+			const char* Name;
+			ImageFormat Format;
+		};
+		const SetDataCase formats[] = { { "RGBA", ImageFormat::RGBA }, { "RGBA16F", ImageFormat::RGBA16F }, { "RGBA32F", ImageFormat::RGBA32F } };
+		for (uint32_t size : { 64u, 512u, 2048u })
+		{
+			for (const SetDataCase& format : formats)
+			{
+				std::vector<uint8_t> data((size_t)size * size * GetBytesPerPixel(format.Format), 0x7f);
+				Image image(size, size, format.Format);
+
+				std::string name = "Image/SetData " + std::to_string(size) + "x" + std::to_string(size) + " " + format.Name;
+				m_Suite.Run(name, [&](uint64_t iterations)
+				{
+					for (uint64_t i = 0; i < iterations; i++)
+						image.SetData(data.data());
+				});
+			}
+		}
+
+		// Converted while writing into the staging buffer
+		{
+			ImageBuffer<PixelRGBA32F> pixels(2048, 2048);
+			pixels.Fill({ 0.25f, 0.5f, 0.75f, 1.0f });
+			Image image(2048, 2048, ImageFormat::RGBA);
+			m_Suite.Run("Image/SetData 2048x2048 RGBA32F->RGBA", [&](uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					image.SetData(pixels);
+			});
+		}
+		releaseDeferred();
+
+		// Panel-resize-like sequence, mostly within capacity with occasional growth past it
+		for (bool keepCapacity : { false, true })
+		{
+			{
+				Image image(512, 512, ImageFormat::RGBA);
+				ImageResizePolicy policy;
+				policy.KeepCapacity = keepCapacity;
+				image.SetResizePolicy(policy);
+
+				const uint32_t sizes[] = { 512, 530, 610, 580, 700, 690, 900, 640, 1200, 300, 1250, 800 };
+				uint64_t step = 0;
+				m_Suite.Run(keepCapacity ? "Image/Resize churn (KeepCapacity)" : "Image/Resize churn", [&](uint64_t iterations)
+				{
+					for (uint64_t i = 0; i < iterations; i++, step++)
+					{
+						uint32_t size = sizes[step % (sizeof(sizes) / sizeof(sizes[0]))];
+						image.Resize(size, size * 9 / 16);
+					}
+				}, 0, releaseDeferred);
+			}
+			releaseDeferred();
+		}
+	}
+
+	void RunCommandBufferBenchmarks()
+	{
+		m_Suite.Run("Application/GetCommandBuffer+Flush", [](uint64_t iterations)
+		{
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				VkCommandBuffer commandBuffer = Application::GetCommandBuffer(true);
+				Application::FlushCommandBuffer(commandBuffer);
+			}
+		});
+	}
+
+	void RunPixelKernelBenchmarks()
+	{
+		const size_t pixelCount = 1920 * 1080;
+		std::vector<float> src(pixelCount * 4);
+		for (size_t i = 0; i < src.size(); i++)
+			src[i] = (float)(i % 1021) / 1000.0f;
+		std::vector<uint32_t> dst(pixelCount);
+
+		ResolveSettings resolveSettings;
+		resolveSettings.Scale = 0.5f;
+		resolveSettings.ToneMap = ToneMapOperator::ACES;
+
+		SIMDLevel defaultLevel = PixelKernels::GetSIMDLevel();
+		for (SIMDLevel level : { SIMDLevel::Scalar, SIMDLevel::SSE41, SIMDLevel::AVX2, SIMDLevel::NEON })
+		{
+			PixelKernels::SetSIMDLevel(level);
+			if (PixelKernels::GetSIMDLevel() != level)
+				continue;
+
+			std::string suffix = std::string(" 1920x1080 ") + PixelKernels::GetSIMDLevelName(level);
+			m_Suite.Run("PixelKernels/ConvertRGBA32FToRGBA8" + suffix, [&](uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					PixelKernels::ConvertRGBA32FToRGBA8(src.data(), dst.data(), pixelCount);
+				DoNotOptimize(dst[0]);
+			});
+
+			m_Suite.Run("PixelKernels/ResolveToRGBA8 ACES" + suffix, [&](uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					PixelKernels::ResolveToRGBA8(src.data(), dst.data(), pixelCount, resolveSettings);
+				DoNotOptimize(dst[0]);
+			});
+		}
+		PixelKernels::SetSIMDLevel(defaultLevel);
+	}
+private:
+	BenchmarkSuite m_Suite;
+	bool m_FirstFrameSkipped = false;
+	bool m_MicroBenchmarksDone = false;
+
+	uint32_t m_WarmupFrames = 0, m_Frames = 0;
+	uint32_t m_FrameIndex = 0;
+	std::chrono::steady_clock::time_point m_LastFrameTime;
+	std::vector<double> m_FrameTimes;
+
+	uint32_t m_Regressions = 0;
+};
+
+static void PrintUsage()
+{
+	std::cout << "Usage: WalnutBenchmarks [options]\n"
+		"  --filter <text>          Only run benchmarks whose name contains text\n"
+		"  --samples <n>            Measured samples per benchmark (default 30)\n"
+		"  --warmup <n>             Unmeasured samples before those (default 3)\n"
+		"  --min-sample-ms <ms>     Minimum duration of one sample (default 5)\n"
+		"  --frames <n>             Frames measured for the frame loop (default 600, after 60 warmup frames)\n"
+		"  --output <file.json>     Write the results\n"
+		"  --baseline <file.json>   Compare against an earlier --output, exit code 1 on regressions\n"
+		"  --threshold <fraction>   Median slowdown that counts as a regression (default 0.10)\n";
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkSettings settings;
+	uint32_t warmupFrames = 60, frames = 600;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			PrintUsage();
+			return 0;
+		}
+		if (!value)
+		{
+			std::cerr << "Missing value for " << arg << "\n";
+			PrintUsage();
+			return 2;
+		}
+
+		if (strcmp(arg, "--filter") == 0)             settings.Filter = value;
+		else if (strcmp(arg, "--samples") == 0)       settings.Samples = (uint32_t)std::max(atoi(value), 1);
+		else if (strcmp(arg, "--warmup") == 0)        settings.WarmupSamples = (uint32_t)std::max(atoi(value), 0);
+		else if (strcmp(arg, "--min-sample-ms") == 0) settings.MinSampleMilliseconds = atof(value);
+		else if (strcmp(arg, "--frames") == 0)        frames = (uint32_t)std::max(atoi(value), 1);
+		else if (strcmp(arg, "--output") == 0)        settings.OutputPath = value;
+		else if (strcmp(arg, "--baseline") == 0)      settings.BaselinePath = value;
+		else if (strcmp(arg, "--threshold") == 0)     settings.RegressionThreshold = atof(value);
+		else
+		{
+			std::cerr << "Unknown option " << arg << "\n";
+			PrintUsage();
+			return 2;
+		}
+		i++;
+	}
+
+	ApplicationSpecification spec;
+	spec.Name = "Walnut Benchmarks";
+	spec.Width = 1280;
+	spec.Height = 720;
+	spec.Hidden = true;
+
+	Application* app = new Application(spec);
+	std::shared_ptr<BenchmarkLayer> layer = std::make_shared<BenchmarkLayer>(settings, warmupFrames, frames);
+	app->PushLayer(layer);
+	app->Run();
+	uint32_t regressions = layer->GetRegressions();
+	delete app;
+
+	return regressions ? 1 : 0;
+}
@@ -6,5 +6,12 @@ workspace "WalnutApp"
 
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 
+newoption
+{
+   trigger = "track-allocations",
+   description = "Count heap allocations per frame and per layer (defines WL_TRACK_ALLOCATIONS in Walnut)"
+}
+
 include "WalnutExternal.lua"
-include "WalnutApp"
\ No newline at end of file
+include "WalnutApp"
+include "WalnutBenchmarks"
\ No newline at end of file